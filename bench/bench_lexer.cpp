@@ -0,0 +1,98 @@
+// Microbenchmark for the lexer's word-break scanner.
+//
+// Builds 4 KB command lines from long plain arguments (paths, JSON-ish blobs
+// and base64 payloads) and compares the byte-at-a-time scanner with the
+// vector scanner selected at runtime, both on their own and through the full
+// lexCommandLine pass.
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lexer.hpp"
+
+namespace {
+
+const size_t LINE_LENGTH = 4096;
+const int LINES = 256;
+const int ROUNDS = 200;
+
+std::string makeLine(std::mt19937& rng) {
+    static const char* const prefixes[] = {"/usr/share/data/", "{\"key\":", "QmFzZTY0"};
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/_-.,:{}";
+
+    std::string line = "process-batch";
+    std::uniform_int_distribution<int> lengthDist(64, 512);
+    std::uniform_int_distribution<int> charDist(0, sizeof(alphabet) - 2);
+    std::uniform_int_distribution<int> prefixDist(0, 2);
+
+    while (line.size() < LINE_LENGTH) {
+        line += ' ';
+        line += prefixes[prefixDist(rng)];
+        int length = lengthDist(rng);
+        for (int i = 0; i < length; ++i) {
+            line += alphabet[charDist(rng)];
+        }
+    }
+    line.resize(LINE_LENGTH);
+    return line;
+}
+
+template <typename Scan>
+double timeScan(const std::vector<std::string>& lines, Scan scan, size_t& checksum) {
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (const std::string& line : lines) {
+            size_t pos = 0;
+            while (pos < line.size()) {
+                pos = scan(line, pos) + 1;
+                checksum += pos;
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void report(const char* name, double seconds, double baseline) {
+    double megabytes = static_cast<double>(LINE_LENGTH) * LINES * ROUNDS / (1024.0 * 1024.0);
+    std::cout << "  " << std::left << std::setw(22) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(9) << megabytes / seconds << " MB/s"
+              << std::setprecision(2) << std::setw(8) << baseline / seconds << "x\n";
+}
+
+}  // namespace
+
+int main() {
+    std::mt19937 rng(42);
+    std::vector<std::string> lines;
+    for (int i = 0; i < LINES; ++i) {
+        lines.push_back(makeLine(rng));
+    }
+
+    size_t checksum = 0;
+    double scalar = timeScan(lines, findWordBreakScalar, checksum);
+    double vector = timeScan(lines, findWordBreak, checksum);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (const std::string& line : lines) {
+            checksum += lexCommandLine(line).tokens.size();
+        }
+    }
+    std::chrono::duration<double> lexTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << "bench_lexer: " << LINES << " lines x " << LINE_LENGTH << " bytes, " << ROUNDS
+              << " rounds (scanner: " << wordBreakScannerName() << ")\n";
+    report("scan (scalar)", scalar, scalar);
+    report("scan (dispatched)", vector, scalar);
+    report("lexCommandLine", lexTime.count(), scalar);
+    std::cout << "  checksum " << checksum << "\n";
+    return 0;
+}
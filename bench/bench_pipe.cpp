@@ -0,0 +1,65 @@
+// Pipeline throughput under each pipe buffer policy.
+//
+// Streams a fixed amount of data through head | cat | cat | wc with the
+// kernel's default pipes, fixed 256 KB and 1 MB pipes, and the auto policy
+// that grows a pipe when its writer is seen blocking. Larger pipes mean
+// fewer wakeups and context switches between stages.
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "command.hpp"
+#include "executor.hpp"
+#include "pipe_tuning.hpp"
+
+namespace {
+
+const size_t MEGABYTE = 1024 * 1024;
+const size_t STREAM_BYTES = 1024 * MEGABYTE;
+const int ROUNDS = 3;
+
+double throughput(const ParsedCommand& pipeline, const char* setting) {
+    PipeBufferPolicy policy;
+    parsePipeBufferPolicy(setting, policy);
+    setPipeBufferPolicy(policy);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        executeExternal(pipeline);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(STREAM_BYTES) * ROUNDS / MEGABYTE / elapsed.count();
+}
+
+}  // namespace
+
+int main() {
+    std::string bytes = std::to_string(STREAM_BYTES);
+    ParsedCommand pipeline;
+    pipeline.addCommand({"head", "-c", bytes, "/dev/zero"});
+    pipeline.addCommand({"cat"});
+    pipeline.addCommand({"cat"});
+    pipeline.addCommand({"wc", "-c"}, "", "/dev/null");
+
+    std::cout << "bench_pipe: " << STREAM_BYTES / MEGABYTE
+              << " MB through head | cat | cat | wc, " << ROUNDS
+              << " rounds (pipe-max-size " << pipeMaxSize() << ")\n";
+
+    const char* const settings[] = {"default", "256K", "1M", "auto"};
+    double baseline = 0;
+    for (const char* setting : settings) {
+        double rate = throughput(pipeline, setting);
+        if (baseline == 0) {
+            baseline = rate;
+        }
+        std::cout << "  " << std::left << std::setw(10) << setting << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(9) << rate << " MB/s"
+                  << std::setprecision(2) << std::setw(8) << rate / baseline << "x\n";
+    }
+
+    setPipeBufferPolicy(PipeBufferPolicy());
+    return 0;
+}
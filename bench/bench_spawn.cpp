@@ -0,0 +1,67 @@
+// Launch latency of the two executor backends as the shell's memory grows.
+//
+// Inflates the process to a target resident size (touching every page so the
+// page tables are populated, as they are in a long-running shell with big
+// history and caches), then times foreground runs of /bin/true through
+// executeExternal with posix_spawn and with fork.
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "command.hpp"
+#include "executor.hpp"
+
+namespace {
+
+const size_t MEGABYTE = 1024 * 1024;
+const size_t RSS_TARGETS_MB[] = {10, 200, 1024};
+const int LAUNCHES = 200;
+
+double launchMicros(const ParsedCommand& command, LaunchBackend backend) {
+    setLaunchBackend(backend);
+    executeExternal(command);  // Warm up the binary's page cache
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < LAUNCHES; ++i) {
+        executeExternal(command);
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / LAUNCHES;
+}
+
+}  // namespace
+
+int main() {
+    ParsedCommand command;
+    command.addCommand({"/bin/true"});
+
+    std::cout << "bench_spawn: " << LAUNCHES << " foreground launches of /bin/true per backend\n";
+    std::cout << "  " << std::setw(8) << "RSS" << std::setw(14) << "posix_spawn" << std::setw(12)
+              << "fork" << std::setw(10) << "speedup\n";
+
+    std::vector<std::unique_ptr<char[]>> ballast;
+    size_t allocated = 0;
+    for (size_t targetMb : RSS_TARGETS_MB) {
+        size_t target = targetMb * MEGABYTE;
+        if (target > allocated) {
+            size_t size = target - allocated;
+            ballast.emplace_back(new char[size]);
+            std::memset(ballast.back().get(), 1, size);
+            allocated = target;
+        }
+
+        double spawn = launchMicros(command, LaunchBackend::PosixSpawn);
+        double fork = launchMicros(command, LaunchBackend::Fork);
+        std::cout << "  " << std::setw(5) << targetMb << " MB" << std::fixed << std::setprecision(1)
+                  << std::setw(11) << spawn << " us" << std::setw(9) << fork << " us"
+                  << std::setprecision(2) << std::setw(8) << fork / spawn << "x\n";
+    }
+
+    setLaunchBackend(LaunchBackend::PosixSpawn);
+    return 0;
+}
@@ -0,0 +1,160 @@
+// Cold-start latency of the shell binary, which tooling pays every time it
+// spawns a short-lived ninxsh.
+//
+// exec-to-first-prompt: the shell runs on pipes and is timed from spawn until
+// the first byte of its prompt can be read; closing its stdin then ends it.
+// exec-to-exit: `ninxsh -c true` timed from spawn until it is reaped, next to
+// /bin/true as the floor any process pays. HOME points at a temporary
+// directory holding a full HISTORY_LINES history, so no real history is read
+// or written. Exits non-zero if the shell's own share of -c true goes over
+// BUDGET_MS.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <poll.h>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char** environ;
+
+namespace {
+
+const char* SHELL_PATH = "bin/ninxsh";
+const int RUNS = 200;
+const int HISTORY_LINES = 1000;
+const double BUDGET_MS = 5.0;
+
+using Clock = std::chrono::steady_clock;
+
+double millisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Summary {
+    double median;
+    double p90;
+};
+
+Summary summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return {samples[samples.size() / 2], samples[samples.size() * 9 / 10]};
+}
+
+// Spawn to reap of argv, with stdout and stderr discarded
+double timeToExit(const std::vector<const char*>& argv) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    auto start = Clock::now();
+    pid_t pid;
+    int status = -1;
+    if (posix_spawn(&pid, argv[0], &actions, nullptr, const_cast<char**>(argv.data()),
+                    environ) == 0) {
+        waitpid(pid, &status, 0);
+    }
+    double elapsed = millisSince(start);
+    posix_spawn_file_actions_destroy(&actions);
+    return status == 0 ? elapsed : -1;
+}
+
+// Spawn of an interactive-mode shell to the first readable byte of its prompt
+double timeToPrompt() {
+    int input[2];
+    int output[2];
+    if (pipe(input) != 0 || pipe(output) != 0) {
+        return -1;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, input[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, output[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, input[1]);
+    posix_spawn_file_actions_addclose(&actions, output[0]);
+    const char* argv[] = {SHELL_PATH, nullptr};
+
+    auto start = Clock::now();
+    pid_t pid;
+    double elapsed = -1;
+    if (posix_spawn(&pid, SHELL_PATH, &actions, nullptr, const_cast<char**>(argv), environ) ==
+        0) {
+        pollfd ready = {output[0], POLLIN, 0};
+        if (poll(&ready, 1, 5000) == 1) {
+            elapsed = millisSince(start);
+        }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(input[0]);
+    close(output[1]);
+    close(input[1]);  // EOF: the shell exits
+    char drain[256];
+    while (read(output[0], drain, sizeof(drain)) > 0) {
+    }
+    close(output[0]);
+    waitpid(pid, nullptr, 0);
+    return elapsed;
+}
+
+void printRow(const char* name, const Summary& summary) {
+    std::cout << "  " << std::left << std::setw(22) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(8) << summary.median << " ms"
+              << std::setw(8) << summary.p90 << " ms\n";
+}
+
+}  // namespace
+
+int main() {
+    char home[] = "/tmp/bench_startup.XXXXXX";
+    if (!mkdtemp(home) || setenv("HOME", home, 1) != 0) {
+        std::cerr << "bench_startup: no temporary HOME\n";
+        return 1;
+    }
+    std::string history = std::string(home) + "/.ninxsh_history";
+    {
+        std::ofstream file(history);
+        for (int i = 0; i < HISTORY_LINES; ++i) {
+            file << "grep -rn 'pattern " << i << "' src | sort | uniq -c\n";
+        }
+    }
+
+    std::vector<double> prompt;
+    std::vector<double> shellExit;
+    std::vector<double> trueExit;
+    for (int i = 0; i < RUNS; ++i) {
+        prompt.push_back(timeToPrompt());
+        shellExit.push_back(timeToExit({SHELL_PATH, "-c", "true", nullptr}));
+        trueExit.push_back(timeToExit({"/bin/true", nullptr}));
+    }
+    unlink(history.c_str());
+    rmdir(home);
+
+    if (std::min({*std::min_element(prompt.begin(), prompt.end()),
+                  *std::min_element(shellExit.begin(), shellExit.end()),
+                  *std::min_element(trueExit.begin(), trueExit.end())}) < 0) {
+        std::cerr << "bench_startup: could not run " << SHELL_PATH << '\n';
+        return 1;
+    }
+
+    Summary toPrompt = summarize(prompt);
+    Summary toExit = summarize(shellExit);
+    Summary floor = summarize(trueExit);
+    std::cout << "bench_startup: " << RUNS << " cold starts of " << SHELL_PATH
+              << " (median, p90)\n";
+    printRow("exec to first prompt", toPrompt);
+    printRow("exec to exit, -c true", toExit);
+    printRow("/bin/true", floor);
+
+    double overhead = toExit.median - floor.median;
+    std::cout << "  -c true costs " << std::setprecision(2) << overhead
+              << " ms over /bin/true (budget " << BUDGET_MS << " ms)\n";
+    return overhead > BUDGET_MS ? 1 : 0;
+}
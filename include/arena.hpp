@@ -0,0 +1,50 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <string_view>
+
+// Bump allocator for short-lived, all-or-nothing data such as the strings and
+// argv tables of a parsed command line. Memory is handed out from large blocks
+// that never move, so pointers stay valid until the arena is destroyed; there
+// is no per-object free.
+class Arena {
+private:
+    struct Block;
+
+    Block* head = nullptr;
+    char* cursor = nullptr;
+    size_t remaining = 0;
+    size_t nextBlockSize;
+
+    void addBlock(size_t minSize);
+    void freeBlocks();
+
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 1024;
+
+    explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+    ~Arena();
+
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Size the next block so that at least `bytes` more fit without another allocation
+    void reserve(size_t bytes);
+
+    // Allocate uninitialized storage
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // Copy a string into the arena and NUL-terminate it
+    char* copyString(std::string_view str);
+
+    // Copy `count` pointers into a new table followed by a terminating nullptr
+    char** copyArgv(char* const* args, size_t count);
+
+    // Number of blocks allocated so far (each one is a single heap allocation)
+    size_t blockCount() const;
+};
+
+#endif  // ARENA_HPP
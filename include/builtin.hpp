@@ -1,11 +1,50 @@
 #ifndef BUILTIN_HPP
 #define BUILTIN_HPP
 
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "command.hpp"
+
+class CommandHash;
+class Environment;
+class History;
+class JobManager;
+class ParseCache;
+
+// Shell state a builtin may read or change. Any member can be null (for
+// example when a builtin runs outside the interactive shell); builtins that
+// need a missing piece report an error instead of crashing.
+struct BuiltinContext {
+    History* history = nullptr;
+    JobManager* jobManager = nullptr;
+    ParseCache* parseCache = nullptr;
+    Environment* environment = nullptr;
+    CommandHash* commandHash = nullptr;
+};
+
+// Every builtin has this signature: arguments (argv[0] is the name), shell
+// state, and the stream for its regular output. Returns the exit status.
+using BuiltinHandler = int (*)(const ArgList& args, const BuiltinContext& context,
+                               std::ostream& out);
+
+struct Builtin {
+    std::string_view name;
+    BuiltinHandler handler;
+    // Only reads shell state, so a pipeline can run it on a thread inside the
+    // shell. Others run as pipeline stages in a forked child, which keeps
+    // their changes (cd, export, ...) out of the shell as in other shells.
+    bool readOnly = false;
+};
+
+// Look a name up in the builtin table (a compile-time perfect hash), or nullptr
+const Builtin* findBuiltin(std::string_view name);
+
 bool executeBuiltin(const std::vector<char*>& argv);
+bool executeBuiltin(const ArgList& argv);
 bool executeBuiltin(const std::vector<const char*>& argv);  // Overload for const char*
-bool isBuiltin(const std::string& cmd);
+bool isBuiltin(std::string_view cmd);
 
 #endif  // BUILTIN_HPP
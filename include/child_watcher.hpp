@@ -0,0 +1,42 @@
+#ifndef CHILD_WATCHER_HPP
+#define CHILD_WATCHER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+
+class JobManager;
+
+// Child-process lifecycle for the interactive shell. SIGCHLD is turned into
+// an ordinary readable descriptor: a signalfd with the signal blocked on
+// Linux, elsewhere a non-blocking self-pipe written by a minimal handler.
+// Nothing runs in signal context beyond that write, and children are only
+// reaped when an exit has actually been signalled, never by polling waitpid
+// on every prompt.
+class ChildWatcher {
+public:
+    explicit ChildWatcher(JobManager& jobs);
+    ~ChildWatcher();
+
+    ChildWatcher(const ChildWatcher&) = delete;
+    ChildWatcher& operator=(const ChildWatcher&) = delete;
+
+    // If any child has exited since the last call, reap every exited child
+    // and print a notice for each finished job. Does not block. Returns the
+    // number of jobs reported.
+    size_t reap(std::ostream& out);
+
+    // Block until fd is readable. Jobs that finish in the meantime are
+    // reported on out as they exit (on a fresh line), followed by a call to
+    // redraw so the prompt can be printed again.
+    void waitForInput(int fd, std::ostream& out, const std::function<void()>& redraw);
+
+private:
+    JobManager& jobs;
+    int eventFd = -1;  // signalfd, or the read end of the self-pipe
+    int pollFd = -1;   // epoll instance (Linux only)
+
+    bool drainEvents();
+};
+
+#endif  // CHILD_WATCHER_HPP
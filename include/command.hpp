@@ -1,17 +1,71 @@
 #ifndef COMMAND_HPP
 #define COMMAND_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "arena.hpp"
+#include "lexer.hpp"
+#include "utils.hpp"
+
+// View over a NUL-terminated argv array owned by a ParsedCommand's arena.
+// size() counts the terminating nullptr, matching the layout execvp expects.
+class ArgList {
+private:
+    char** argv = nullptr;
+    size_t argc = 0;
+
+public:
+    ArgList() = default;
+    ArgList(char** argv, size_t argc) : argv(argv), argc(argc) {}
+
+    size_t size() const {
+        return argv ? argc + 1 : 0;
+    }
+    bool empty() const {
+        return argv == nullptr;
+    }
+    char* operator[](size_t index) const {
+        return argv[index];
+    }
+    char** data() const {
+        return argv;
+    }
+    char** begin() const {
+        return argv;
+    }
+    char** end() const {
+        return argv + size();
+    }
+};
+
 // Single Command in a pipeline
 struct Command {
-    std::vector<char*> args;
-    std::string inputFile;
-    std::string outputFile;
+    ArgList args;
+    std::string_view inputFile;   // NUL-terminated arena string, empty if not redirected
+    std::string_view outputFile;  // NUL-terminated arena string, empty if not redirected
     bool isBackground = false;
+
+    // Here-string (<<< word) or here-document body fed to stdin instead of
+    // inputFile or the previous pipe. Lives in the arena.
+    std::string_view inputText;
+    bool hasInputText = false;
+
+    // A << here-document whose body follows the command line. Set by parsing;
+    // whoever reads the lines after it (the shell) fills in inputText.
+    std::string_view hereDocDelimiter;  // Quote-removed; empty if there is none
+    bool hereDocExpands = false;        // Delimiter was unquoted: body gets $ expansion
+    bool hereDocStripsTabs = false;     // <<-: leading tabs are removed from body lines
 };
 
+// A parsed command line. Every argument, file name and argv table lives in a
+// single arena owned by this object, so it is move-only and the argv arrays
+// can be handed straight to execvp.
 struct ParsedCommand {
     // Vector of commands in a pipeline
     std::vector<Command> pipeline;
@@ -20,9 +74,106 @@ struct ParsedCommand {
     bool hasError = false;
     std::string errorMessage;
 
-    ~ParsedCommand();
+    // The line ended inside quotes or with a backslash; an interactive shell
+    // should read a continuation line rather than run this
+    bool isIncomplete = false;
+
+    // <(command) and >(command) arguments. Each command runs alongside the
+    // pipeline on its own pipe, and the argument is replaced with /dev/fd/N
+    // for the end its stage is given when the stage is launched.
+    struct Substitution {
+        size_t stage;     // Index into pipeline
+        size_t arg;       // Index into that stage's args
+        bool isOutput;    // >(command): the stage writes, the command reads
+        std::unique_ptr<ParsedCommand> command;
+    };
+    std::vector<Substitution> substitutions;
+
+    // Backing storage for the pipeline's strings and argv tables
+    Arena arena;
+
+    ParsedCommand() = default;
+    ParsedCommand(ParsedCommand&&) noexcept = default;
+    ParsedCommand& operator=(ParsedCommand&&) noexcept = default;
+    ParsedCommand(const ParsedCommand&) = delete;
+    ParsedCommand& operator=(const ParsedCommand&) = delete;
+
+    // Stages with a here-document still waiting for its body
+    bool needsHereDocs() const;
+
+    // Give a stage its here-document or here-string body, copied into the arena
+    void setInputText(Command& command, std::string_view text);
+
+    // Append a pipeline stage, copying its arguments and file names into the arena
+    Command& addCommand(const std::vector<std::string_view>& args,
+                        std::string_view inputFile = std::string_view(),
+                        std::string_view outputFile = std::string_view(),
+                        bool isBackground = false);
 };
 
+// Environment-independent structure of a command line: its tokens grouped into
+// pipeline stages. Expanding it against the current environment yields a
+// ParsedCommand, so one template can be expanded many times.
+struct CommandTemplate {
+    static const size_t NO_TOKEN = static_cast<size_t>(-1);
+
+    struct Word {
+        uint32_t token;       // Index into tokens.tokens
+        bool needsExpansion;  // Contains an expandable $ or starts with ~
+        bool isSubstitution;  // A <(...) or >(...) token
+    };
+
+    struct Stage {
+        size_t firstWord = 0;  // Stage arguments are words[firstWord, firstWord + wordCount)
+        size_t wordCount = 0;
+        size_t inputToken = NO_TOKEN;  // File, here-doc delimiter or here-string word
+        TokenKind inputKind = TokenKind::RedirectIn;
+        bool hereDocStripsTabs = false;
+        size_t outputToken = NO_TOKEN;
+        bool isBackground = false;
+    };
+
+    TokenStream tokens;  // Spans into the source line, which must outlive the template
+    std::vector<Word> words;
+    std::vector<Stage> stages;
+    // Inner commands of the substitution words, in word order, parsed once
+    // with the line so a cached template expands them without lexing again
+    std::vector<CommandTemplate> substitutions;
+
+    // Error state tracking
+    bool hasError = false;
+    std::string errorMessage;
+};
+
+// Memory budget for one command line, in bytes. It bounds the line as read and
+// the expanded argv as execve counts it (each string, its NUL and its pointer).
+// Defaults to the system ARG_MAX and is clamped to it; 0 restores the default.
+size_t inputBudget();
+void setInputBudget(size_t bytes);
+
+// sysconf(_SC_ARG_MAX) capped at MAX_ARG_MAX, or a conservative fallback if
+// it is unavailable
+size_t systemArgMax();
+
+// Lex and structure a line without touching the environment
+CommandTemplate parseTemplate(std::string_view input);
+
+// Delimiters of the here-documents a template opens, in the order their
+// bodies follow the line, and whether each strips leading tabs (<<-)
+std::vector<std::pair<std::string_view, bool>> hereDocDelimiters(const CommandTemplate& tmpl);
+
+// Leading tabs removed, as <<- does to each here-document line
+std::string_view stripLeadingTabs(std::string_view line);
+
+// Structure an already lexed line (for example from an IncrementalLexer)
+CommandTemplate buildTemplate(TokenStream tokens);
+
+// Apply $VAR and ~ expansion to a template, producing a runnable command.
+// Special parameters ($?, $!) are taken from context.
+ParsedCommand expandTemplate(const CommandTemplate& tmpl,
+                             const ExpansionContext& context = ExpansionContext());
+
+// parseTemplate followed by expandTemplate
 ParsedCommand parseCommand(const std::string& input);
 
 #endif  // COMMAND_HPP
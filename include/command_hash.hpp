@@ -0,0 +1,61 @@
+#ifndef COMMAND_HASH_HPP
+#define COMMAND_HASH_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Search PATH (as the shell sees it, through lookupEnv) for an executable
+// regular file. Names containing a '/' are returned unchanged. Returns an
+// empty string if nothing matches.
+std::string searchPath(std::string_view name);
+
+// Remembers where commands were found on PATH, like bash's hash table, so
+// a command costs one PATH search rather than one per run. Misses are kept
+// too, for NEGATIVE_TTL, so a mistyped command in a loop doesn't rescan every
+// directory each time. The table empties itself when PATH changes; the
+// executor calls forget() when a remembered path has gone away.
+class CommandHash {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::seconds NEGATIVE_TTL{2};
+
+    struct Entry {
+        std::string path;           // Empty for a remembered miss
+        size_t hits = 0;            // Lookups answered from the table
+        Clock::time_point expires;  // Only used by misses
+    };
+
+    // Path to run for name, or an empty string if it isn't on PATH. Names
+    // with a '/' bypass the table.
+    const std::string& find(std::string_view name);
+
+    // Cached path for name without searching or counting a hit, or nullptr.
+    // Changes nothing, so it is safe while nothing else changes the table.
+    const std::string* peek(std::string_view name) const;
+
+    // Search for name now and remember the result; false if not found
+    bool add(std::string_view name);
+
+    // Returns false if name was not in the table
+    bool forget(std::string_view name);
+
+    void clear();
+
+    // Found commands as (name, entry), sorted by name
+    std::vector<std::pair<std::string, Entry>> entries();
+
+private:
+    std::unordered_map<std::string, Entry> table;
+    std::string cachedPath;  // PATH the table was filled under
+    std::string scratch;     // Return slot for names that bypass the table
+
+    void checkPath();
+};
+
+#endif  // COMMAND_HASH_HPP
@@ -0,0 +1,73 @@
+#ifndef ENVIRONMENT_HPP
+#define ENVIRONMENT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Shell-owned copy of the environment. Variables live in an open-addressing
+// hash table (linear probing, power-of-two capacity) so lookups cost the same
+// with ten variables or ten thousand, unlike getenv's scan of environ. Each
+// slot stores its variable as a single "NAME=VALUE" string, so values can be
+// handed out as NUL-terminated C strings and the envp array for exec is just
+// a table of pointers into the slots, rebuilt only after a change.
+class Environment {
+private:
+    enum class SlotState : uint8_t { Empty, Occupied, Deleted };
+
+    struct Slot {
+        std::string entry;  // "NAME=VALUE"
+        size_t nameLength = 0;
+        uint64_t hash = 0;
+        SlotState state = SlotState::Empty;
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;       // Occupied slots
+    size_t tombstones = 0;  // Deleted slots, still counted against the load factor
+    std::vector<char*> envpCache;
+    bool envpDirty = true;
+
+    static uint64_t hashName(std::string_view name);
+    size_t findSlot(std::string_view name, uint64_t hash) const;
+    void rehash(size_t newCapacity);
+
+public:
+    static const size_t DEFAULT_CAPACITY = 64;
+
+    explicit Environment(size_t capacity = DEFAULT_CAPACITY);
+
+    // Replace the contents with a NULL-terminated "NAME=VALUE" array such as environ
+    void load(char* const* envp);
+
+    // Value of a variable as a NUL-terminated string, or nullptr if unset
+    const char* get(std::string_view name) const;
+
+    void set(std::string_view name, std::string_view value);
+
+    // Returns false if the variable was not set
+    bool unset(std::string_view name);
+
+    size_t size() const;
+    size_t capacity() const;
+
+    // NULL-terminated "NAME=VALUE" array for execve; valid until the next change
+    char** envp();
+
+    // All variables as (name, value) pairs, in table order
+    std::vector<std::pair<std::string_view, std::string_view>> entries() const;
+
+    // POSIX variable name: [A-Za-z_][A-Za-z0-9_]*
+    static bool isValidName(std::string_view name);
+};
+
+// Install the table consulted by lookupEnv and used for exec (nullptr to uninstall)
+void setActiveEnvironment(Environment* environment);
+Environment* activeEnvironment();
+
+// getenv replacement: reads the active table, or the process environment if none
+const char* lookupEnv(std::string_view name);
+
+#endif  // ENVIRONMENT_HPP
@@ -1,17 +1,70 @@
 #ifndef EXECUTOR_HPP
 #define EXECUTOR_HPP
 
+#include <ostream>
+#include <sys/resource.h>
+#include <vector>
+
 #include "command.hpp"
 
 // Forward declaration to avoid circular dependency
 class JobManager;
+struct BuiltinContext;
 
 extern bool isShellForeground;
 
-void executeExternal(const ParsedCommand& cmd, JobManager* jobManager = nullptr);
-void executePipeline(const ParsedCommand& cmd, JobManager* jobManager = nullptr);
+// Exit status for a command that could not be found, as in POSIX shells
+const int STATUS_COMMAND_NOT_FOUND = 127;
+// Exit status for a command that was found but could not be executed
+const int STATUS_NOT_EXECUTABLE = 126;
+
+// How external commands are started. PosixSpawn (the default) launches through
+// posix_spawn, whose cost does not grow with the shell's memory the way
+// fork's does; Fork is the classic fork + execvp. Builtins run as pipeline
+// stages, and scripts without a #! line, are forked with either backend.
+enum class LaunchBackend { PosixSpawn, Fork };
+
+void setLaunchBackend(LaunchBackend backend);
+LaunchBackend launchBackend();
+
+// Exit status and resource usage of one pipeline stage
+struct StageReport {
+    int status = 0;            // As for $?
+    double realSeconds = 0;    // From launch until the stage was reaped
+    struct rusage usage = {};  // From wait4; the helper thread's for in-process builtins
+};
+
+// What a run of a command line cost, stage by stage. Stages that never started
+// have only a status; a background run has statuses but no timings.
+struct PipelineReport {
+    std::vector<StageReport> stages;
+    double realSeconds = 0;  // From the first launch until the last stage was reaped
+};
+
+// Both return the exit status of the (last) command for $?: its exit code,
+// 128 + signal number if it was killed, or 0 when launched in the background.
+// Redirections are opened by the shell; if one fails, or a command can't be
+// found, that stage doesn't start and gets status 1 or 127 respectively.
+// Pipeline stages naming a builtin run its handler with builtins as their
+// shell state: read-only builtins (history, jobs, ...) on a helper thread in
+// the shell, the rest (and any in a background pipeline) in a forked child,
+// so their changes don't reach the parent shell.
+// Process substitutions (<(cmd), >(cmd)) start just before their stage, each
+// on its own pipe, and are waited for with the pipeline.
+// Pipes are sized according to pipeBufferPolicy() (see pipe_tuning.hpp).
+// If report is given it receives every stage's status and usage ($PIPESTATUS
+// and the time prefix).
+int executeExternal(const ParsedCommand& cmd, JobManager* jobManager = nullptr,
+                    const BuiltinContext* builtins = nullptr, PipelineReport* report = nullptr);
+int executePipeline(const ParsedCommand& cmd, JobManager* jobManager = nullptr,
+                    const BuiltinContext* builtins = nullptr, PipelineReport* report = nullptr);
+
+// Print a report as one row per stage (real, user and system time, max RSS,
+// voluntary/involuntary context switches, status, command) and, for a
+// pipeline, a total row: wall time, summed CPU and switches, largest RSS.
+void printPipelineReport(const ParsedCommand& cmd, const PipelineReport& report,
+                         std::ostream& out);
 void setupSignalHandlers();
 void cleanupZombieProcesses();
-void setGlobalJobManager(JobManager* jobManager);
 
 #endif  // EXECUTOR_HPP
@@ -0,0 +1,41 @@
+#ifndef FD_STREAM_HPP
+#define FD_STREAM_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+
+// Buffered std::streambuf over a raw file descriptor, so a builtin can write
+// straight into a pipe. A failed write (EPIPE once the reader has gone, for
+// example) sets the stream's badbit instead of throwing, and later output is
+// discarded. The descriptor is not owned and is never closed here.
+class FdStreamBuf : public std::streambuf {
+private:
+    static const size_t BUFFER_SIZE = 64 * 1024;
+
+    int fd;
+    char buffer[BUFFER_SIZE];
+
+    bool flushBuffer();
+
+protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+public:
+    explicit FdStreamBuf(int fd);
+    ~FdStreamBuf() override;
+
+    FdStreamBuf(const FdStreamBuf&) = delete;
+    FdStreamBuf& operator=(const FdStreamBuf&) = delete;
+};
+
+class FdOutputStream : public std::ostream {
+private:
+    FdStreamBuf streamBuf;
+
+public:
+    explicit FdOutputStream(int fd);
+};
+
+#endif  // FD_STREAM_HPP
@@ -1,39 +1,154 @@
 #ifndef HISTORY_HPP
 #define HISTORY_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+class History;
+
+// Read-only view of the history, oldest command first, indexed like the
+// vector it replaces. Commands are string_views into the history's storage:
+// valid until the next command is added, which may expire the oldest.
+class HistoryView {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view*;
+        using reference = std::string_view;
+
+        iterator(const History* history, size_t index) : history(history), index(index) {}
+        std::string_view operator*() const;
+        iterator& operator++() {
+            ++index;
+            return *this;
+        }
+        bool operator==(const iterator& other) const {
+            return index == other.index;
+        }
+        bool operator!=(const iterator& other) const {
+            return index != other.index;
+        }
+
+    private:
+        const History* history;
+        size_t index;
+    };
+
+    explicit HistoryView(const History& history) : history(&history) {}
+
+    size_t size() const;
+    bool empty() const;
+    std::string_view operator[](size_t index) const;
+    std::string_view back() const;
+    iterator begin() const;
+    iterator end() const;
+
+private:
+    const History* history;
+};
+
+// Command history, kept in memory and, once loadFromFile has attached the
+// history file, appended to that file one command at a time. Each command is
+// one line of the file, with newlines in a multi-line command escaped as \n
+// (and backslashes doubled). Appends and rewrites take an advisory flock on
+// the file, so concurrent shells interleave whole lines instead of clobbering
+// each other, and a crash loses at most the command being written. The file
+// is compacted back to maxSize lines (written to a temporary file and renamed
+// over it) whenever this shell has seen it reach twice that, so nothing needs
+// to be written at exit.
+//
+// In memory, commands sit in a ring of at most maxSize entries, each naming a
+// chunk, an offset and a length. Their text is packed into CHUNK_SIZE chunks
+// (a longer command gets a chunk of its own). Commands expire oldest first,
+// so a chunk is freed whole once all of its commands have expired: adding a
+// command to a full history costs O(1) and no allocation per command.
 class History {
 private:
     static const int DEFAULT_HISTORY_SIZE = 1000;
-    std::vector<std::string> commands;
+
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t capacity = 0;
+        size_t used = 0;
+        size_t live = 0;  // Commands in the ring still stored here
+    };
+
+    struct Entry {
+        uint32_t chunk;   // Chunk sequence number; chunks[chunk - firstChunk]
+        uint32_t offset;  // Within the chunk
+        uint32_t length;
+    };
+
+    std::deque<Chunk> chunks;
+    uint32_t firstChunk = 0;  // Sequence number of chunks.front()
+    std::vector<Entry> ring;  // Grows to maxSize, then wraps
+    size_t head = 0;          // Slot of the oldest command
+    size_t count = 0;
     std::string historyFilePath;
     size_t maxSize;
+    int fileFd = -1;       // History file open for appending, once attached
+    size_t fileLines = 0;  // Lines known to be in the file since the last compaction
+
+    // Store a command as the newest, expiring the oldest if the ring is full
+    void append(std::string_view command);
+    void expireOldest();
+    void clear();
+
+    // Lock the history file, reopening it first if another shell has
+    // replaced it by compacting. Returns false if there is no file.
+    bool lockFile();
+    void unlockFile();
 
-    void truncateIfNeeded();
+    // Replace the history file with text, atomically; the lock must be held
+    bool replaceFile(std::string_view text, size_t lines);
 
 public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
     History(size_t size = DEFAULT_HISTORY_SIZE);
     History(const std::string& filePath, size_t size = DEFAULT_HISTORY_SIZE);
+    ~History();
+
+    History(const History&) = delete;
+    History& operator=(const History&) = delete;
 
-    // Add a command to history
+    // Add a command to history (and append it to the file, once attached)
     void addCommand(const std::string& command);
 
-    // Get all commands in history
-    const std::vector<std::string>& getCommands() const;
+    // All commands in history, oldest first
+    HistoryView getCommands() const;
 
     // Get a specific command by index
     std::string getCommand(size_t index) const;
 
+    // Command at index (oldest is 0) without copying; index must be < size()
+    std::string_view at(size_t index) const;
+
     // Get the number of commands in history
     size_t size() const;
 
-    // Load history from file
+    // Chunks of command text currently allocated
+    size_t chunkCount() const;
+
+    // Load history from file (created if missing) and append to it from now
+    // on. A file that can only be read is loaded without appending.
     bool loadFromFile();
 
-    // Save history to file
-    bool saveToFile() const;
+    // Rewrite the file with the in-memory history
+    bool saveToFile();
+
+    // Rewrite the file with its newest maxSize lines, keeping what other
+    // shells have appended. Runs on its own as the file grows.
+    bool compact();
 
     // Set the history file path
     void setHistoryFilePath(const std::string& filePath);
@@ -1,9 +1,14 @@
 #ifndef JOBS_HPP
 #define JOBS_HPP
 
+#include <iostream>
+#include <list>
+#include <ostream>
 #include <string>
+#include <unordered_map>
 #include <unistd.h>
-#include <vector>
+
+#include "resource_limits.hpp"
 
 struct Job {
     int jobId;
@@ -11,6 +16,8 @@ struct Job {
     std::string command;
     bool isRunning;
     bool isStopped;
+    ResourceLimits limits;  // What the job was started with (limit builtin)
+    std::string cgroup;     // Its group while it runs, if it has one
 
     Job(int id, pid_t p, const std::string& cmd)
         : jobId(id), pid(p), command(cmd), isRunning(true), isStopped(false) {}
@@ -18,23 +25,27 @@ struct Job {
 
 class JobManager {
 private:
-    std::vector<Job> jobs;
+    // In launch order; a list, so removing a finished job moves no others
+    std::list<Job> jobs;
+    std::unordered_map<pid_t, std::list<Job>::iterator> pidIndex;  // pid -> its job
     int nextJobId;
 
 public:
     JobManager() : nextJobId(1) {}
 
-    // Add a new background job
-    int addJob(pid_t pid, const std::string& command);
+    // Add a new background job, which owns cgroup (see JobCgroup::detach)
+    int addJob(pid_t pid, const std::string& command,
+               const ResourceLimits& limits = ResourceLimits(),
+               const std::string& cgroup = std::string());
 
-    // Remove a job (when it finishes)
+    // Remove a job (when it finishes), releasing its cgroup
     void removeJob(pid_t pid);
 
     // Update job status
     void updateJobStatus(pid_t pid, bool isRunning, bool isStopped = false);
 
     // Get all jobs
-    const std::vector<Job>& getJobs() const {
+    const std::list<Job>& getJobs() const {
         return jobs;
     }
 
@@ -44,11 +55,13 @@ public:
     // Find job by job ID
     Job* findJobById(int jobId);
 
-    // Clean up finished jobs
-    void cleanupJobs();
+    // Record that pid has exited or been killed. If it is a job, the job is
+    // removed and copied to finished; returns false for any other child.
+    bool completeJob(pid_t pid, Job& finished);
 
-    // Print all jobs (for jobs command)
-    void printJobs() const;
+    // Print all jobs (for jobs command); a job with limits gets a second line
+    // with its usage against them
+    void printJobs(std::ostream& out = std::cout) const;
 };
 
 #endif  // JOBS_HPP
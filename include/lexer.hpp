@@ -0,0 +1,124 @@
+#ifndef LEXER_HPP
+#define LEXER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class TokenKind : uint8_t {
+    Word,         // Argument or redirection target
+    Pipe,         // Unquoted |
+    RedirectIn,   // Unquoted <
+    RedirectOut,  // Unquoted >
+    Background,   // Unquoted & standing on its own
+    HereDoc,      // Unquoted <<, or <<- (leading tabs stripped) when the token is 3 bytes
+    HereString,   // Unquoted <<<
+    ProcessSubIn,   // <(command): the token spans the command between the parentheses
+    ProcessSubOut,  // >(command), likewise
+};
+
+// A token is a span of bytes, not an owned string. Words whose bytes are
+// contiguous in the source (plain words, or a single quoted run) point straight
+// into the source line; only words broken up by quote removal or an escape are
+// rewritten into the stream's scratch buffer. Tokens are kept to 12 bytes so a
+// long line of short words costs little more than the argv it expands into;
+// inputBudget() never exceeds MAX_ARG_MAX (1 GiB), so offsets can't overflow.
+struct Token {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    TokenKind kind = TokenKind::Word;
+    bool rewritten = false;  // Span refers to TokenStream::scratch instead of the source
+    bool fromSingleQuotes = false;
+    bool fromDoubleQuotes = false;
+};
+
+struct TokenStream {
+    std::string_view source;  // Not owned; must outlive the stream
+    std::vector<Token> tokens;
+    std::string scratch;
+    bool isIncomplete = false;  // Source ended inside quotes or right after a backslash
+
+    std::string_view text(const Token& token) const {
+        std::string_view base = token.rewritten ? std::string_view(scratch) : source;
+        return base.substr(token.offset, token.length);
+    }
+};
+
+// Where the lexer stopped: everything needed to carry on from the next byte
+// of input without looking at earlier bytes again
+struct LexerState {
+    size_t position = 0;  // Next source byte to lex
+    Token word;           // Word being built while inWord
+    bool inWord = false;
+    bool literal = false;  // Current word contains quoted or escaped bytes
+    bool inSingleQuotes = false;
+    bool inDoubleQuotes = false;
+    bool pendingEscape = false;  // Source so far ends with an unquoted or double-quoted backslash
+
+    bool needsMore() const {
+        return inSingleQuotes || inDoubleQuotes || pendingEscape;
+    }
+
+    // Why more input is needed, for error messages ("" if it isn't)
+    const char* pendingConstruct() const {
+        if (inSingleQuotes) {
+            return "unterminated single quote";
+        }
+        if (inDoubleQuotes) {
+            return "unterminated double quote";
+        }
+        return pendingEscape ? "trailing backslash" : "";
+    }
+};
+
+// Split a command line into words and operators in a single pass. If the
+// line ends inside quotes the open word is closed as if quoted to the end,
+// a trailing backslash is dropped, and isIncomplete is set.
+TokenStream lexCommandLine(std::string_view input);
+
+// Lexes a command line that arrives one physical line at a time (unclosed
+// quotes, trailing backslashes). Lines are joined with '\n' in an owned
+// buffer; a quoted newline is kept, backslash-newline is removed. Each line is
+// lexed once when it is fed, so a long pasted block costs linear time.
+class IncrementalLexer {
+private:
+    std::string buffer;
+    TokenStream stream;
+    LexerState state;
+    bool started = false;
+
+public:
+    IncrementalLexer() = default;
+    IncrementalLexer(const IncrementalLexer&) = delete;
+    IncrementalLexer& operator=(const IncrementalLexer&) = delete;
+
+    // Append a line (without its newline) and lex it. Only meaningful for the
+    // first line or while needsMore() is true.
+    void feedLine(std::string_view line);
+
+    // The input so far stops inside quotes or after a backslash
+    bool needsMore() const;
+    const LexerState& currentState() const;
+
+    // The joined lines
+    const std::string& text() const;
+
+    // Close the last word and hand over the tokens. They point into text(),
+    // so the lexer must outlive them.
+    TokenStream finish();
+};
+
+// Index of the first byte at or after pos that can end a run of plain word
+// characters (a quote, backslash, blank or operator), or input.size() if none.
+// Uses the widest vector unit detected at runtime (AVX2, SSE2 or scalar).
+size_t findWordBreak(std::string_view input, size_t pos);
+
+// Byte-at-a-time reference implementation of findWordBreak
+size_t findWordBreakScalar(std::string_view input, size_t pos);
+
+// Implementation selected for findWordBreak: "avx2", "sse2" or "scalar"
+const char* wordBreakScannerName();
+
+#endif  // LEXER_HPP
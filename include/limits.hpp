@@ -7,14 +7,19 @@ namespace ninxsh {
 namespace limits {
 
 // DoS Protection Limits
-constexpr size_t MAX_INPUT_LENGTH = 4096;   // Maximum command line input length
-constexpr size_t MAX_PATH_LENGTH = 2048;    // Maximum file path length
-constexpr size_t MAX_STRING_LENGTH = 2048;  // Maximum string length for expansions
+constexpr size_t FALLBACK_ARG_MAX = 128 * 1024;  // Input budget if sysconf(_SC_ARG_MAX) fails
+constexpr size_t MAX_ARG_MAX = 1024 * 1024 * 1024;  // Cap on it (unlimited stack: no bound)
+constexpr size_t INPUT_CHUNK_SIZE = 64 * 1024;   // Bytes read per step from the terminal
+constexpr size_t MAX_PATH_LENGTH = 2048;         // Maximum file path length
+constexpr size_t MAX_CACHED_LINE_LENGTH = 1024;  // Longest line kept in the parse cache
+constexpr size_t MAX_HEREDOC_SIZE = 16 * 1024 * 1024;  // Bytes of here-document bodies per line
 
 // Test Constants (based on limits above)
-constexpr size_t TEST_LONG_INPUT = 8000;                  // Test input longer than MAX_INPUT_LENGTH
-constexpr size_t TEST_LONG_PATH = 4000;                   // Test path longer than MAX_PATH_LENGTH
-constexpr size_t TEST_OVER_LIMIT = MAX_INPUT_LENGTH + 1;  // Just over the input limit
+constexpr size_t TEST_INPUT_BUDGET = 4096;       // Small budget for over-limit tests
+constexpr size_t TEST_LONG_INPUT = 8000;         // Test input longer than TEST_INPUT_BUDGET
+constexpr size_t TEST_LONG_PATH = 4000;          // Test path longer than MAX_PATH_LENGTH
+constexpr size_t TEST_INPUT_64K = 64 * 1024;     // Generated command lines that must parse
+constexpr size_t TEST_INPUT_1M = 1024 * 1024;
 
 }  // namespace limits
 }  // namespace ninxsh
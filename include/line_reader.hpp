@@ -0,0 +1,35 @@
+#ifndef LINE_READER_HPP
+#define LINE_READER_HPP
+
+#include <cstddef>
+#include <istream>
+#include <string>
+
+#include "limits.hpp"
+
+// Reads command lines in fixed-size chunks under a byte budget. Unlike
+// std::getline, a line that blows the budget is never held in memory: once it
+// goes over, the rest of it is read and thrown away one chunk at a time.
+class LineReader {
+private:
+    std::istream& in;
+    size_t maxBytes;
+    size_t chunkSize;
+
+public:
+    static const size_t DEFAULT_CHUNK_SIZE = ninxsh::limits::INPUT_CHUNK_SIZE;
+
+    enum class Status {
+        Ok,       // A full line was read (without its newline)
+        TooLong,  // The line exceeded the budget and was discarded
+        Eof,      // Nothing left to read
+    };
+
+    LineReader(std::istream& in, size_t budget, size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+    Status read(std::string& line);
+
+    size_t budget() const;
+};
+
+#endif  // LINE_READER_HPP
@@ -0,0 +1,27 @@
+#ifndef LINT_HPP
+#define LINT_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A syntax error found without executing anything
+struct LintError {
+    size_t line;  // 1-based
+    std::string message;
+};
+
+// Parse every line of a script buffer and collect the errors. Only the
+// environment-independent parse runs, so this touches no shell state and is
+// safe to call from many threads at once.
+std::vector<LintError> lintBuffer(std::string_view text);
+
+// Check each file (memory-mapped) on a pool of worker threads, one per CPU
+// unless workers is given. Errors are printed as "file:line: message" in the
+// order the files were named. Returns 0 if everything parsed, 1 if any file
+// had syntax errors and 2 if a file could not be read.
+int lintFiles(const std::vector<std::string>& files, std::ostream& out, unsigned workers = 0);
+
+#endif  // LINT_HPP
@@ -0,0 +1,29 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole file, mapped for one sequential pass and
+// unmapped on destruction. On failure error says why and text() is empty.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view text() const {
+        return std::string_view(data, size);
+    }
+
+    std::string error;
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+#endif  // MAPPED_FILE_HPP
@@ -0,0 +1,46 @@
+#ifndef PARSE_CACHE_HPP
+#define PARSE_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "command.hpp"
+
+// Bounded LRU cache of parsed command structure, keyed by the exact input line.
+// Only the environment-independent CommandTemplate is cached; every lookup
+// still runs $VAR and ~ expansion so results track the current environment.
+class ParseCache {
+private:
+    struct Entry {
+        std::string line;  // Owns the bytes the template's tokens point into
+        CommandTemplate tmpl;
+    };
+
+    std::list<Entry> entries;  // Most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    size_t maxEntries;
+    size_t hitCount = 0;
+    size_t missCount = 0;
+
+public:
+    static const size_t DEFAULT_CACHE_SIZE = 256;
+
+    explicit ParseCache(size_t size = DEFAULT_CACHE_SIZE);
+
+    // Parse a line, reusing the cached structure when the same line was seen before
+    ParsedCommand parse(const std::string& line,
+                        const ExpansionContext& context = ExpansionContext());
+
+    // Drop all entries and reset the counters
+    void clear();
+
+    size_t size() const;
+    size_t capacity() const;
+    size_t hits() const;
+    size_t misses() const;
+};
+
+#endif  // PARSE_CACHE_HPP
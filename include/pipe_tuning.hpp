@@ -0,0 +1,52 @@
+#ifndef PIPE_TUNING_HPP
+#define PIPE_TUNING_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <vector>
+
+// How the pipes between pipeline stages are sized. Default leaves the
+// kernel's size (64 KB on Linux); Fixed sets every pipe to bytes; Auto starts
+// at the default and doubles a pipe each time its writer is seen blocked on
+// it. Sizes are capped at pipeMaxSize(). Resizing needs F_SETPIPE_SZ (Linux);
+// elsewhere every mode behaves like Default.
+struct PipeBufferPolicy {
+    enum class Mode { Default, Fixed, Auto };
+
+    Mode mode = Mode::Default;
+    size_t bytes = 0;  // Fixed only
+};
+
+// Policy for pipelines that don't set their own (pipesize builtin)
+void setPipeBufferPolicy(const PipeBufferPolicy& policy);
+const PipeBufferPolicy& pipeBufferPolicy();
+
+// "default", "auto", or a byte count with an optional K or M suffix.
+// Returns false if text is none of these.
+bool parsePipeBufferPolicy(std::string_view text, PipeBufferPolicy& policy);
+std::string describePipeBufferPolicy(const PipeBufferPolicy& policy);
+
+// Largest pipe an unprivileged process may ask for (/proc/sys/fs/pipe-max-size)
+size_t pipeMaxSize();
+
+// Give a newly created pipe (either end) the size a Fixed policy asks for
+void sizePipe(int fd, const PipeBufferPolicy& policy);
+
+// Called as each stage is reaped with its index, raw wait status and usage
+using StageReaped =
+    std::function<void(size_t stage, int waitStatus, const struct rusage& usage)>;
+
+// Wait for every stage in pids (entries of -1 are skipped), storing each raw
+// wait status in waitStatuses and calling reaped, if given, as each one is
+// collected. A stage that can't be waited for (not a child, or already
+// reaped) gets an EXIT_FAILURE status. While waiting, stages other than the last are sampled with a
+// backoff from 1 ms to 50 ms; one found blocked writing to its stdout pipe
+// has that pipe doubled. Returns the number of resizes.
+size_t waitAdaptively(const std::vector<pid_t>& pids, std::vector<int>& waitStatuses,
+                      const StageReaped& reaped = StageReaped());
+
+#endif  // PIPE_TUNING_HPP
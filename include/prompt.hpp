@@ -0,0 +1,30 @@
+#ifndef PROMPT_HPP
+#define PROMPT_HPP
+
+#include <string>
+
+// The interactive prompt, username@hostname:path$. User and host are looked up
+// once, when the prompt is first drawn, and the colored (or plain) text around
+// the path is composed then too. The path is the logical working directory
+// that cd keeps in $PWD, so no getcwd is needed: only the path segment is
+// rebuilt, and only when $PWD or $HOME has changed since the last prompt.
+class Prompt {
+public:
+    // The prompt for the current $PWD and $HOME
+    const std::string& text();
+
+    // Draw the prompt with a single write; false if the write failed
+    bool write(int fd);
+
+private:
+    bool composed = false;
+    std::string head;    // user@host: with its colors, up to the path color
+    std::string tail;    // $ and the color reset
+    std::string pwd;     // $PWD and $HOME the current text was built for
+    std::string home;
+    std::string buffer;  // head + path + tail
+
+    void compose();
+};
+
+#endif  // PROMPT_HPP
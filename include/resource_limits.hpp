@@ -0,0 +1,115 @@
+#ifndef RESOURCE_LIMITS_HPP
+#define RESOURCE_LIMITS_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <utility>
+#include <vector>
+
+// What the commands of one job may use. cpu, mem and pids are cgroup v2
+// controls (cpu.weight, memory.max, pids.max) covering the job as a whole;
+// the rest are setrlimit resources, applied to each of its processes.
+// cgroup fields left at UNSET (and rlimits not listed) are not limited.
+struct ResourceLimits {
+    static const uint64_t UNSET = 0;
+    static const uint64_t UNLIMITED = UINT64_MAX;  // Written to the cgroup as "max"
+
+    uint64_t cpuWeight = UNSET;  // 1 to 10000; the kernel's default is 100
+    uint64_t memoryMax = UNSET;  // Bytes
+    uint64_t pidsMax = UNSET;
+    std::vector<std::pair<int, rlim_t>> rlimits;  // RLIMIT_* and its soft = hard limit
+
+    bool empty() const {
+        return !usesCgroup() && rlimits.empty();
+    }
+    bool usesCgroup() const {
+        return cpuWeight != UNSET || memoryMax != UNSET || pidsMax != UNSET;
+    }
+
+    // Take every limit overrides sets, keeping the rest
+    void merge(const ResourceLimits& overrides);
+};
+
+// Limits for commands that don't set their own (limit builtin)
+void setResourceLimits(const ResourceLimits& limits);
+const ResourceLimits& resourceLimits();
+
+// One "name=value" setting: cpu=WEIGHT, mem=BYTES, pids=N, or one of the
+// rlimits cputime=SECONDS, as/data/stack/fsize/core=BYTES, nofile/nproc=N.
+// Sizes take a K, M or G suffix; any limit but cpu may be "unlimited".
+// Returns false, leaving limits alone, if text is not a valid setting.
+bool parseLimitSetting(std::string_view text, ResourceLimits& limits);
+
+// The settings as parseLimitSetting takes them ("mem=512M pids=64"), or "none"
+std::string describeResourceLimits(const ResourceLimits& limits);
+
+// Set the rlimits on the calling process. Only calls setrlimit, so it is safe
+// in a child between fork/clone and exec. Returns false if any was refused
+// (raising a hard limit needs privilege).
+bool applyRlimits(const ResourceLimits& limits);
+
+// A cgroup v2 group for one job, created under ninxsh-<shell pid> next to
+// the shell's own cgroup, with the job's cgroup limits written to it. Where
+// cgroups are not delegated to the shell (no cgroup2 mount, no write access,
+// a controller not enabled for the subtree) the job runs without the limits
+// that can't be enforced, mem falls back to RLIMIT_AS, and a warning is
+// printed once per controller. Outside ninxsh-<shell pid>, the only change
+// made is enabling a controller that the shell's cgroup offers but does not
+// yet pass down, which applies to every child of that cgroup.
+class JobCgroup {
+public:
+    JobCgroup() = default;
+    ~JobCgroup();
+    JobCgroup(const JobCgroup&) = delete;
+    JobCgroup& operator=(const JobCgroup&) = delete;
+
+    // Make the group for limits (see above). Returns false if there is none
+    // to put the job in; the limits a child must apply itself are in
+    // processLimits() either way.
+    bool create(const ResourceLimits& limits);
+
+    // Directory descriptor for clone3's CLONE_INTO_CGROUP, or -1
+    int fd() const {
+        return dirFd;
+    }
+    const std::string& path() const {
+        return groupPath;
+    }
+    // The group's cgroup.procs, made here so a forked child need not build it
+    const char* procsPath() const {
+        return procsFile.c_str();
+    }
+    const ResourceLimits& processLimits() const {
+        return perProcess;
+    }
+
+    // Stop owning the group and return its path, for a background job to
+    // hand to releaseCgroup() when it finishes. Otherwise the destructor does.
+    std::string detach();
+
+private:
+    int dirFd = -1;
+    std::string groupPath;
+    std::string procsFile;
+    ResourceLimits perProcess;
+};
+
+// Move the calling process into a group, given its cgroup.procs (see
+// JobCgroup::procsPath). Only open/write/close with nothing allocated, so
+// safe in a forked child before exec (the fallback when clone3 can't be used).
+bool enterCgroup(const char* procsPath);
+
+// Remove the group at path once it has no processes left; one still in use
+// is retried by later calls to releaseIdleCgroups()
+void releaseCgroup(const std::string& path);
+void releaseIdleCgroups();
+
+// "cpu 0.42s  mem 12.3M/512M  pids 3/64", the group's usage against its
+// limits (usage a missing controller can't report shows as "-"), followed by
+// any rlimits
+void printCgroupUsage(const std::string& path, const ResourceLimits& limits, std::ostream& out);
+
+#endif  // RESOURCE_LIMITS_HPP
@@ -0,0 +1,89 @@
+#ifndef SCRIPT_HPP
+#define SCRIPT_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "command.hpp"
+#include "lexer.hpp"
+
+// One command of a script with its structure already parsed: a line, the
+// lines an open quote or trailing backslash continues it onto, and the
+// bodies of any here-documents it opens.
+struct ScriptCommand {
+    size_t line = 0;        // 1-based line the command starts on
+    std::string_view text;  // The command, into the script or into continued
+    std::unique_ptr<IncrementalLexer> continued;  // Owns the text of a multi-line command
+    CommandTemplate tmpl;                         // Tokens point into text
+    std::vector<std::string> hereDocs;  // Bodies, in the order of hereDocDelimiters(tmpl)
+    std::string unterminatedHereDoc;    // Delimiter of a body that ran to end of text
+    std::string error;                  // Syntax error; tmpl is not usable if set
+};
+
+// Splits script text into commands the way the prompt reads them. Blank
+// lines and lines starting with # (a #! line, comments) are skipped. Only
+// the environment-independent parse runs, so this touches no shell state.
+class ScriptSplitter {
+public:
+    // text must outlive the splitter and every command it returns. Without
+    // collectHereDocs, here-document bodies are skipped but not copied.
+    explicit ScriptSplitter(std::string_view text, bool collectHereDocs = true);
+
+    // The next command, or false at the end of the text
+    bool next(ScriptCommand& command);
+
+private:
+    std::string_view text;
+    size_t pos = 0;
+    size_t lineNumber = 0;
+    bool collectHereDocs;
+
+    bool nextLine(std::string_view& line);
+    void readHereDocs(ScriptCommand& command);
+};
+
+// Parses a script on a worker thread while the shell runs it, so lexing and
+// parsing the next commands overlaps with waiting for the current one. The
+// worker hands commands over in batches (growing from 1 to MAX_BATCH, so the
+// first command is ready at once) and stays at most MAX_AHEAD commands in
+// front, counting those taken but not yet run. Texts under MIN_WORKER_SIZE,
+// such as most -c strings, are split on the calling thread: starting a thread
+// would cost more than parsing them.
+class ParseAhead {
+public:
+    static constexpr size_t MAX_BATCH = 64;
+    static constexpr size_t MAX_AHEAD = 4096;
+    static constexpr size_t MIN_WORKER_SIZE = 4096;
+
+    // text must outlive the ParseAhead
+    explicit ParseAhead(std::string_view text);
+    ~ParseAhead();
+
+    ParseAhead(const ParseAhead&) = delete;
+    ParseAhead& operator=(const ParseAhead&) = delete;
+
+    // The next command in script order, or false at the end of the script
+    bool next(ScriptCommand& command);
+
+private:
+    ScriptSplitter splitter;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<ScriptCommand> ready;  // Parsed, waiting to be taken (guarded by mutex)
+    std::deque<ScriptCommand> taken;  // Taken as a batch; the shell's thread only
+    size_t inHand = 0;                // Size of the batch being run (guarded by mutex)
+    bool finished = false;            // Worker has reached the end (guarded by mutex)
+    bool stopping = false;            // Shell no longer wants commands (guarded by mutex)
+    std::thread worker;  // Not started for short texts
+
+    void work();
+};
+
+#endif  // SCRIPT_HPP
@@ -1,15 +1,40 @@
 #ifndef SHELL_HPP
 #define SHELL_HPP
 
+#include <string>
+#include <string_view>
+
+#include "builtin.hpp"
+#include "child_watcher.hpp"
+#include "command_hash.hpp"
+#include "environment.hpp"
+#include "executor.hpp"
 #include "history.hpp"
 #include "jobs.hpp"
+#include "line_reader.hpp"
+#include "parse_cache.hpp"
+#include "prompt.hpp"
+#include "utils.hpp"
 
 class Shell {
 private:
+    Environment environment;  // Loaded once from environ; what children are exec'd with
     History history;
+    bool historyLoaded = false;  // Read by run(); scripts and -c keep none
     JobManager jobManager;
-    void printPrompt() const;
-    void displayHistory(const std::vector<std::string>& args) const;
+    ChildWatcher childWatcher;  // Reaps jobManager's children as they exit
+    ParseCache parseCache;
+    CommandHash commandHash;            // Where PATH commands were found
+    ExpansionContext expansionContext;  // $?, $! and $PIPESTATUS for the next expansion
+    BuiltinContext builtinContext;      // Points at the members above
+    Prompt prompt;
+    void setStatus(int status);  // $? for anything but a pipeline run
+    PipelineReport runBuiltin(const Builtin& builtin, const ArgList& args);
+    void printPrompt();
+    bool readContinuation(LineReader& reader, std::string& input, ParsedCommand& parsed);
+    bool readHereDocs(LineReader& reader, ParsedCommand& parsed);
+    void setHereDoc(ParsedCommand& parsed, Command& command, const std::string& body);
+    void execute(ParsedCommand& parsed);  // Prefixes, builtins, then the executor
     std::string expandHistoryCommand(const std::string& input) const;
 
 public:
@@ -17,6 +42,11 @@ public:
     ~Shell();
     void run();
 
+    // Run a whole script (a mapped file, or the text given to -c) and return
+    // the last command's status, or 2 at a syntax error. name is used in
+    // error messages.
+    int runScript(std::string_view script, const std::string& name);
+
     // Allow access to job manager for executor
     JobManager& getJobManager() {
         return jobManager;
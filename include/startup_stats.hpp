@@ -0,0 +1,20 @@
+#ifndef STARTUP_STATS_HPP
+#define STARTUP_STATS_HPP
+
+#include <ostream>
+
+// Where the time between exec and the first prompt (or exit) goes, for
+// --startup-stats. Phases are timed back to back from the call to
+// enableStartupStats at the top of main; what happened before main (dynamic
+// loading, static constructors) shows as the CPU time already used by then.
+// Recording is a no-op unless enabled. Once enabled, whatever has not been
+// reported by the time the process exits is printed on stderr then.
+void enableStartupStats();
+
+// Record the phase that just ended, timed from the end of the previous one
+void startupPhase(const char* name);
+
+// Print the phases recorded so far, once; later calls print nothing
+void reportStartupStats(std::ostream& out);
+
+#endif  // STARTUP_STATS_HPP
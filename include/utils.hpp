@@ -2,13 +2,42 @@
 #define UTIL_HPP
 
 #include <string>
+#include <string_view>
+#include <sys/types.h>
 #include <vector>
 
+// Shell state consulted by special parameter expansion
+struct ExpansionContext {
+    int lastStatus = 0;           // $?
+    pid_t lastBackgroundPid = 0;  // $! (unset while 0)
+    std::vector<int> pipeStatus;  // $PIPESTATUS per stage; just $? when empty
+};
+
 std::string expandPath(const std::string& path);
-std::string expandEnvVars(const std::string& str);
+
+// Expand $VAR, ${VAR}, ${VAR:-default}, ${VAR-default}, $?, $$ and $!.
+// $PIPESTATUS is the last pipeline's stage statuses separated by spaces;
+// ${PIPESTATUS[n]} is stage n (from 0) and ${PIPESTATUS[@]} all of them.
+std::string expandEnvVars(const std::string& str,
+                          const ExpansionContext& context = ExpansionContext());
+
+// Same as expandEnvVars, appending the result to out
+void expandEnvVarsInto(std::string_view str, const ExpansionContext& context, std::string& out);
 std::vector<std::string> tokenize(const std::string& str, char delimiter);
 std::string trim(const std::string& str);
 
+// write(2) until all of data is written, retrying on EINTR
+bool writeAll(int fd, std::string_view data);
+
+// path resolved against the absolute directory cwd without touching the
+// filesystem: "." and empty components are dropped and ".." removes the
+// component before it, as cd -L does. Empty if path is relative and cwd is
+// not absolute.
+std::string logicalPath(std::string_view cwd, std::string_view path);
+
+// path as the prompt shows it: home replaced by ~, long paths cut to their end
+std::string displayPath(std::string_view path, std::string_view home);
+
 // Terminal prompt utilities
 std::string getCurrentUsername();
 std::string getCurrentHostname();
@@ -16,31 +45,31 @@ std::string getCurrentWorkingDir();
 std::string getColoredPrompt();
 bool isOutputToTerminal();
 
-// ANSI Color codes
+// ANSI Color codes. Compile-time constants, so nothing is built before main.
 namespace Colors {
-extern const std::string RESET;
-extern const std::string BOLD;
-extern const std::string DIM;
+inline constexpr std::string_view RESET = "\033[0m";
+inline constexpr std::string_view BOLD = "\033[1m";
+inline constexpr std::string_view DIM = "\033[2m";
 
 // Foreground colors
-extern const std::string BLACK;
-extern const std::string RED;
-extern const std::string GREEN;
-extern const std::string YELLOW;
-extern const std::string BLUE;
-extern const std::string MAGENTA;
-extern const std::string CYAN;
-extern const std::string WHITE;
+inline constexpr std::string_view BLACK = "\033[30m";
+inline constexpr std::string_view RED = "\033[31m";
+inline constexpr std::string_view GREEN = "\033[32m";
+inline constexpr std::string_view YELLOW = "\033[33m";
+inline constexpr std::string_view BLUE = "\033[34m";
+inline constexpr std::string_view MAGENTA = "\033[35m";
+inline constexpr std::string_view CYAN = "\033[36m";
+inline constexpr std::string_view WHITE = "\033[37m";
 
 // Bright foreground colors
-extern const std::string BRIGHT_BLACK;
-extern const std::string BRIGHT_RED;
-extern const std::string BRIGHT_GREEN;
-extern const std::string BRIGHT_YELLOW;
-extern const std::string BRIGHT_BLUE;
-extern const std::string BRIGHT_MAGENTA;
-extern const std::string BRIGHT_CYAN;
-extern const std::string BRIGHT_WHITE;
+inline constexpr std::string_view BRIGHT_BLACK = "\033[90m";
+inline constexpr std::string_view BRIGHT_RED = "\033[91m";
+inline constexpr std::string_view BRIGHT_GREEN = "\033[92m";
+inline constexpr std::string_view BRIGHT_YELLOW = "\033[93m";
+inline constexpr std::string_view BRIGHT_BLUE = "\033[94m";
+inline constexpr std::string_view BRIGHT_MAGENTA = "\033[95m";
+inline constexpr std::string_view BRIGHT_CYAN = "\033[96m";
+inline constexpr std::string_view BRIGHT_WHITE = "\033[97m";
 }  // namespace Colors
 
 #endif  // UTIL_HPP
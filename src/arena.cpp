@@ -0,0 +1,121 @@
+#include "arena.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Blocks are a single malloc each: this header followed by the payload
+struct alignas(std::max_align_t) Arena::Block {
+    Block* next;
+    size_t size;
+};
+
+Arena::Arena(size_t blockSize) : nextBlockSize(blockSize) {}
+
+Arena::~Arena() {
+    freeBlocks();
+}
+
+void Arena::freeBlocks() {
+    while (head) {
+        Block* next = head->next;
+        std::free(head);
+        head = next;
+    }
+    cursor = nullptr;
+    remaining = 0;
+}
+
+Arena::Arena(Arena&& other) noexcept
+    : head(other.head),
+      cursor(other.cursor),
+      remaining(other.remaining),
+      nextBlockSize(other.nextBlockSize) {
+    other.head = nullptr;
+    other.cursor = nullptr;
+    other.remaining = 0;
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this != &other) {
+        freeBlocks();
+        head = other.head;
+        cursor = other.cursor;
+        remaining = other.remaining;
+        nextBlockSize = other.nextBlockSize;
+        other.head = nullptr;
+        other.cursor = nullptr;
+        other.remaining = 0;
+    }
+    return *this;
+}
+
+void Arena::addBlock(size_t minSize) {
+    size_t size = nextBlockSize > minSize ? nextBlockSize : minSize;
+    Block* block = static_cast<Block*>(std::malloc(sizeof(Block) + size));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+
+    block->next = head;
+    block->size = size;
+    head = block;
+    cursor = reinterpret_cast<char*>(block + 1);
+    remaining = size;
+
+    // Grow geometrically so a long line needs only a handful of blocks
+    nextBlockSize = size * 2;
+}
+
+void Arena::reserve(size_t bytes) {
+    if (bytes <= remaining) {
+        return;
+    }
+    if (!head) {
+        // Nothing handed out yet: make the first block big enough
+        if (bytes > nextBlockSize) {
+            nextBlockSize = bytes;
+        }
+        return;
+    }
+    addBlock(bytes);
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    size_t padding = (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+    if (!head || padding + size > remaining) {
+        addBlock(size + alignment);
+        padding = (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+    }
+
+    char* result = cursor + padding;
+    cursor = result + size;
+    remaining -= padding + size;
+    return result;
+}
+
+char* Arena::copyString(std::string_view str) {
+    char* result = static_cast<char*>(allocate(str.size() + 1, 1));
+    std::memcpy(result, str.data(), str.size());
+    result[str.size()] = '\0';
+    return result;
+}
+
+char** Arena::copyArgv(char* const* args, size_t count) {
+    char** table = static_cast<char**>(allocate((count + 1) * sizeof(char*), alignof(char*)));
+    if (count > 0) {
+        std::memcpy(table, args, count * sizeof(char*));
+    }
+    table[count] = nullptr;
+    return table;
+}
+
+size_t Arena::blockCount() const {
+    size_t count = 0;
+    for (Block* block = head; block; block = block->next) {
+        ++count;
+    }
+    return count;
+}
@@ -1,28 +1,545 @@
+#include "builtin.hpp"
+
+#include <algorithm>
+#include <array>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
 
-bool executeBuiltin(const std::vector<char*>& argv) {
-    if (argv.empty() || argv[0] == nullptr)
-        return false;
-    std::string cmd = argv[0];
+#include "command.hpp"
+#include "command_hash.hpp"
+#include "environment.hpp"
+#include "history.hpp"
+#include "jobs.hpp"
+#include "parse_cache.hpp"
+#include "pipe_tuning.hpp"
+#include "resource_limits.hpp"
+#include "utils.hpp"
+
+namespace {
+
+// Number of real arguments; ArgList::size() also counts the terminating nullptr
+size_t argCount(const ArgList& args) {
+    return args.empty() ? 0 : args.size() - 1;
+}
 
-    if (cmd == "exit") {
-        std::exit(0);
-    } else if (cmd == "cd") {
-        const char* path = (argv.size() > 1 && argv[1]) ? argv[1] : getenv("HOME");
+int builtinExit(const ArgList& args, const BuiltinContext& /* context */, std::ostream& out) {
+    // exit N ends a script with that status
+    int status = 0;
+    if (argCount(args) > 1) {
+        char* end = nullptr;
+        long value = std::strtol(args[1], &end, 10);
+        if (*args[1] == '\0' || *end != '\0') {
+            out << "exit: " << args[1] << ": numeric argument required\n";
+            status = 2;
+        } else {
+            status = static_cast<int>(value & 0xff);
+        }
+    }
+    out.flush();
+    std::exit(status);
+}
+
+int builtinCd(const ArgList& args, const BuiltinContext& context, std::ostream& /* out */) {
+    const char* path = argCount(args) > 1 ? args[1] : lookupEnv("HOME");
+    if (!path) {
+        std::cerr << "cd: HOME not set\n";
+        return 1;
+    }
+
+    // Move logically, as cd -L does: ".." leaves a symlinked directory the
+    // way it was entered. If that path doesn't work, fall back to the
+    // physical one and record where it led.
+    const char* pwd = lookupEnv("PWD");
+    std::string target = logicalPath(pwd ? pwd : "", path);
+    if (target.empty() || chdir(target.c_str()) != 0) {
         if (chdir(path) != 0) {
             std::perror("cd");
+            return 1;
+        }
+        char* cwd = getcwd(nullptr, 0);
+        target = cwd ? cwd : "";
+        free(cwd);
+    }
+
+    // The prompt reads $PWD instead of calling getcwd
+    if (context.environment && !target.empty()) {
+        if (pwd) {
+            context.environment->set("OLDPWD", pwd);
+        }
+        context.environment->set("PWD", target);
+    }
+    return 0;
+}
+
+int builtinClear(const ArgList& /* args */, const BuiltinContext& /* context */,
+                 std::ostream& out) {
+    out << "\033[2J\033[0H" << std::flush;
+    return 0;
+}
+
+int builtinHistory(const ArgList& args, const BuiltinContext& context, std::ostream& out) {
+    if (!context.history) {
+        out << "history: not available\n";
+        return 1;
+    }
+
+    const auto& commands = context.history->getCommands();
+    size_t numToDisplay = commands.size();
+
+    // If an argument is provided, use it to limit the number of commands displayed
+    if (argCount(args) > 1) {
+        try {
+            numToDisplay = std::min(numToDisplay, static_cast<size_t>(std::stoi(args[1])));
+        } catch (const std::exception& e) {
+            // If argument isn't a valid number, show all
+        }
+    }
+
+    // Calculate the starting index
+    size_t startIdx = (numToDisplay < commands.size()) ? commands.size() - numToDisplay : 0;
+
+    // Display the commands with their indices
+    for (size_t i = startIdx; i < commands.size(); ++i) {
+        out << (i + 1) << "  " << commands[i] << '\n';
+    }
+    return 0;
+}
+
+int builtinParseCache(const ArgList& args, const BuiltinContext& context, std::ostream& out) {
+    ParseCache* parseCache = context.parseCache;
+    if (!parseCache) {
+        out << "parsecache: not available\n";
+        return 1;
+    }
+
+    // parsecache -c empties the cache and resets the counters
+    if (argCount(args) > 1 && std::string(args[1]) == "-c") {
+        parseCache->clear();
+        return 0;
+    }
+
+    size_t lookups = parseCache->hits() + parseCache->misses();
+    out << "entries: " << parseCache->size() << "/" << parseCache->capacity() << '\n';
+    out << "hits:    " << parseCache->hits() << '\n';
+    out << "misses:  " << parseCache->misses() << '\n';
+    if (lookups > 0) {
+        out << "hit rate: " << (parseCache->hits() * 100 / lookups) << "%\n";
+    }
+    return 0;
+}
+
+int builtinJobs(const ArgList& /* args */, const BuiltinContext& context, std::ostream& out) {
+    if (!context.jobManager) {
+        out << "jobs: not available\n";
+        return 1;
+    }
+    context.jobManager->printJobs(out);
+    return 0;
+}
+
+int builtinKill(const ArgList& args, const BuiltinContext& /* context */, std::ostream& out) {
+    if (argCount(args) < 2) {
+        out << "Usage: kill <pid>\n";
+        return 1;
+    }
+
+    try {
+        pid_t pid = std::stoi(args[1]);
+        if (kill(pid, SIGTERM) != 0) {
+            std::perror("kill");
+            return 1;
+        }
+        out << "Process " << pid << " terminated\n";
+        return 0;
+    } catch (const std::exception& e) {
+        out << "kill: invalid PID '" << args[1] << "'\n";
+        return 1;
+    }
+}
+
+int builtinFg(const ArgList& args, const BuiltinContext& context, std::ostream& out) {
+    JobManager* jobManager = context.jobManager;
+    if (!jobManager) {
+        out << "fg: no job control\n";
+        return 1;
+    }
+
+    Job* job = nullptr;
+    if (argCount(args) > 1) {
+        try {
+            int jobId = std::stoi(args[1]);
+            job = jobManager->findJobById(jobId);
+            if (!job) {
+                out << "fg: job " << jobId << " not found\n";
+                return 1;
+            }
+        } catch (const std::exception& e) {
+            out << "fg: invalid job ID '" << args[1] << "'\n";
+            return 1;
+        }
+    } else {
+        // No job ID specified, use most recent job
+        const auto& jobs = jobManager->getJobs();
+        if (jobs.empty()) {
+            out << "fg: no current job\n";
+            return 1;
+        }
+        job = const_cast<Job*>(&jobs.back());
+    }
+
+    out << job->command << std::endl;
+    if (job->isStopped) {
+        // Resume the job
+        kill(job->pid, SIGCONT);
+        job->isStopped = false;
+        job->isRunning = true;
+    }
+
+    // Wait for the job to complete
+    pid_t pid = job->pid;
+    int status = 0;
+    waitpid(pid, &status, 0);
+    jobManager->removeJob(pid);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+int builtinBg(const ArgList& args, const BuiltinContext& context, std::ostream& out) {
+    JobManager* jobManager = context.jobManager;
+    if (!jobManager) {
+        out << "bg: no job control\n";
+        return 1;
+    }
+
+    Job* job = nullptr;
+    if (argCount(args) > 1) {
+        try {
+            int jobId = std::stoi(args[1]);
+            job = jobManager->findJobById(jobId);
+            if (!job) {
+                out << "bg: job " << jobId << " not found\n";
+                return 1;
+            }
+            if (!job->isStopped) {
+                out << "bg: job " << jobId << " already running\n";
+                return 0;
+            }
+        } catch (const std::exception& e) {
+            out << "bg: invalid job ID '" << args[1] << "'\n";
+            return 1;
         }
-    } else if (cmd == "clear") {
-        std::cout << "\033[2J\033[0H" << std::flush;
     } else {
+        // No job ID specified, use most recent stopped job
+        for (const Job& candidate : jobManager->getJobs()) {
+            if (candidate.isStopped) {
+                job = const_cast<Job*>(&candidate);
+                break;
+            }
+        }
+        if (!job) {
+            out << "bg: no stopped jobs\n";
+            return 1;
+        }
+    }
+
+    // Resume the job in background
+    kill(job->pid, SIGCONT);
+    job->isStopped = false;
+    job->isRunning = true;
+    out << "[" << job->jobId << "] " << job->command << " &\n";
+    return 0;
+}
+
+int builtinExport(const ArgList& args, const BuiltinContext& context, std::ostream& out) {
+    Environment* environment = context.environment;
+    if (!environment) {
+        out << "export: no shell environment\n";
+        return 1;
+    }
+
+    // Bare export lists the environment, sorted for stable output
+    if (argCount(args) < 2) {
+        auto variables = environment->entries();
+        std::sort(variables.begin(), variables.end());
+        for (const auto& variable : variables) {
+            out << "export " << variable.first << "=\"" << variable.second << "\"\n";
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (size_t i = 1; i < argCount(args); ++i) {
+        std::string_view arg(args[i]);
+        size_t equals = arg.find('=');
+        std::string_view name = arg.substr(0, equals);
+
+        if (!Environment::isValidName(name)) {
+            out << "export: '" << arg << "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+
+        // Every variable is exported, so a bare name has nothing left to do
+        if (equals != std::string_view::npos) {
+            environment->set(name, arg.substr(equals + 1));
+        }
+    }
+    return status;
+}
+
+int builtinUnset(const ArgList& args, const BuiltinContext& context, std::ostream& out) {
+    Environment* environment = context.environment;
+    if (!environment) {
+        out << "unset: no shell environment\n";
+        return 1;
+    }
+
+    int status = 0;
+    for (size_t i = 1; i < argCount(args); ++i) {
+        std::string_view name(args[i]);
+        if (!Environment::isValidName(name)) {
+            out << "unset: '" << name << "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+        environment->unset(name);
+    }
+    return status;
+}
+
+int builtinHash(const ArgList& args, const BuiltinContext& context, std::ostream& out) {
+    CommandHash* commandHash = context.commandHash;
+    if (!commandHash) {
+        out << "hash: not available\n";
+        return 1;
+    }
+
+    // Bare hash lists the remembered commands with their hit counts
+    if (argCount(args) < 2) {
+        auto entries = commandHash->entries();
+        if (entries.empty()) {
+            out << "hash: hash table empty\n";
+            return 0;
+        }
+        out << "hits\tcommand\n";
+        for (const auto& entry : entries) {
+            out << std::setw(4) << entry.second.hits << "\t" << entry.second.path << '\n';
+        }
+        return 0;
+    }
+
+    std::string_view option(args[1]);
+    if (option == "-r") {
+        commandHash->clear();
+        return 0;
+    }
+
+    // hash -d name... forgets; hash name... looks each up now
+    bool forget = option == "-d";
+    int status = 0;
+    for (size_t i = forget ? 2 : 1; i < argCount(args); ++i) {
+        bool known = forget ? commandHash->forget(args[i]) : commandHash->add(args[i]);
+        if (!known) {
+            out << "hash: " << args[i] << ": not found\n";
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int builtinPipeSize(const ArgList& args, const BuiltinContext& /* context */,
+                    std::ostream& out) {
+    if (argCount(args) < 2) {
+        out << "pipesize: " << describePipeBufferPolicy(pipeBufferPolicy()) << '\n';
+        return 0;
+    }
+
+    // With a command after the size, the shell runs it with that size instead
+    PipeBufferPolicy policy;
+    if (argCount(args) > 2 || !parsePipeBufferPolicy(args[1], policy)) {
+        out << "Usage: pipesize [default | auto | bytes[K|M]] [command...]\n";
+        return 1;
+    }
+    setPipeBufferPolicy(policy);
+    return 0;
+}
+
+int builtinLimit(const ArgList& args, const BuiltinContext& /* context */, std::ostream& out) {
+    if (argCount(args) < 2) {
+        out << "limit: " << describeResourceLimits(resourceLimits()) << '\n';
+        return 0;
+    }
+    if (argCount(args) == 2 && std::string_view(args[1]) == "-r") {
+        setResourceLimits(ResourceLimits());
+        return 0;
+    }
+
+    // Settings add to the defaults; with a command after them, the shell
+    // runs just that command under them instead
+    ResourceLimits limits = resourceLimits();
+    for (size_t i = 1; i < argCount(args); ++i) {
+        if (!parseLimitSetting(args[i], limits)) {
+            out << "Usage: limit [-r | name=value...] [command...]\n"
+                << "  cpu=WEIGHT mem=BYTES pids=N cputime=SECONDS as=BYTES data=BYTES\n"
+                << "  stack=BYTES fsize=BYTES core=BYTES nofile=N nproc=N (or =unlimited)\n";
+            return 1;
+        }
+    }
+    setResourceLimits(limits);
+    return 0;
+}
+
+// type and which share the lookup; only the wording differs
+int describeCommands(const ArgList& args, const BuiltinContext& context, std::ostream& out,
+                     bool verbose) {
+    int status = 0;
+    for (size_t i = 1; i < argCount(args); ++i) {
+        std::string_view name(args[i]);
+        if (findBuiltin(name)) {
+            out << name << (verbose ? " is a shell builtin\n" : ": shell builtin\n");
+            continue;
+        }
+
+        const std::string* hashed = context.commandHash ? context.commandHash->peek(name) : nullptr;
+        std::string path = hashed ? *hashed : searchPath(name);
+        if (path.empty()) {
+            out << (verbose ? "type: " : "") << name << ": not found\n";
+            status = 1;
+        } else if (!verbose) {
+            out << path << '\n';
+        } else if (hashed) {
+            out << name << " is hashed (" << path << ")\n";
+        } else {
+            out << name << " is " << path << '\n';
+        }
+    }
+    return status;
+}
+
+int builtinType(const ArgList& args, const BuiltinContext& context, std::ostream& out) {
+    return describeCommands(args, context, out, true);
+}
+
+int builtinWhich(const ArgList& args, const BuiltinContext& context, std::ostream& out) {
+    return describeCommands(args, context, out, false);
+}
+
+// The one list of builtins. Everything else (dispatch in the shell and the
+// executor, isBuiltin) is derived from it.
+constexpr Builtin kBuiltins[] = {
+    {"exit", builtinExit},
+    {"cd", builtinCd},
+    {"clear", builtinClear, true},
+    {"history", builtinHistory, true},
+    {"jobs", builtinJobs, true},
+    {"kill", builtinKill},
+    {"fg", builtinFg},
+    {"bg", builtinBg},
+    {"parsecache", builtinParseCache},  // parsecache -c clears
+    {"export", builtinExport},
+    {"unset", builtinUnset},
+    {"hash", builtinHash},  // hash -r, hash name change the table
+    {"type", builtinType, true},
+    {"which", builtinWhich, true},
+    {"pipesize", builtinPipeSize},
+    {"limit", builtinLimit},  // limit -r, limit name=value change the defaults
+};
+
+constexpr size_t kBuiltinCount = sizeof(kBuiltins) / sizeof(kBuiltins[0]);
+
+// Perfect hash: a seeded FNV-1a whose seed is searched for at compile time so
+// that every builtin lands in its own slot. A lookup is one hash, one table
+// load and at most one string compare.
+constexpr size_t kTableSize = 32;  // Power of two, comfortably above kBuiltinCount
+static_assert(kBuiltinCount < kTableSize, "builtin table too small");
+
+constexpr uint32_t hashName(std::string_view name, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+constexpr bool seedIsPerfect(uint32_t seed) {
+    bool used[kTableSize] = {};
+    for (const Builtin& builtin : kBuiltins) {
+        size_t slot = hashName(builtin.name, seed) & (kTableSize - 1);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t findPerfectSeed() {
+    for (uint32_t seed = 0; seed < 100000; ++seed) {
+        if (seedIsPerfect(seed)) {
+            return seed;
+        }
+    }
+    return UINT32_MAX;
+}
+
+constexpr uint32_t kSeed = findPerfectSeed();
+static_assert(kSeed != UINT32_MAX, "no perfect hash seed found; grow kTableSize");
+
+// Slot -> index into kBuiltins, or -1 for an empty slot
+constexpr std::array<int8_t, kTableSize> makeSlotTable() {
+    std::array<int8_t, kTableSize> slots{};
+    for (size_t i = 0; i < kTableSize; ++i) {
+        slots[i] = -1;
+    }
+    for (size_t i = 0; i < kBuiltinCount; ++i) {
+        slots[hashName(kBuiltins[i].name, kSeed) & (kTableSize - 1)] = static_cast<int8_t>(i);
+    }
+    return slots;
+}
+
+constexpr std::array<int8_t, kTableSize> kSlots = makeSlotTable();
+
+// Shared by the executeBuiltin overloads below; runs without shell state
+bool runBuiltin(char* const* argv, size_t size) {
+    if (size == 0 || argv[0] == nullptr)
+        return false;
+
+    const Builtin* builtin = findBuiltin(argv[0]);
+    if (!builtin) {
         return false;
     }
+    // size counts the terminating nullptr
+    builtin->handler(ArgList(const_cast<char**>(argv), size - 1), BuiltinContext(), std::cout);
     return true;
 }
 
+}  // namespace
+
+const Builtin* findBuiltin(std::string_view name) {
+    int8_t index = kSlots[hashName(name, kSeed) & (kTableSize - 1)];
+    if (index < 0 || kBuiltins[index].name != name) {
+        return nullptr;
+    }
+    return &kBuiltins[index];
+}
+
+bool executeBuiltin(const std::vector<char*>& argv) {
+    return runBuiltin(argv.data(), argv.size());
+}
+
+bool executeBuiltin(const ArgList& argv) {
+    return runBuiltin(argv.data(), argv.size());
+}
+
 bool executeBuiltin(const std::vector<const char*>& argv) {
     // Convert from const char* to char* for compatibility
     std::vector<char*> nonConstArgv;
@@ -37,7 +554,6 @@ bool executeBuiltin(const std::vector<const char*>& argv) {
     return executeBuiltin(nonConstArgv);
 }
 
-bool isBuiltin(const std::string& cmd) {
-    return cmd == "exit" || cmd == "clear" || cmd == "cd" || cmd == "history" || cmd == "jobs" ||
-           cmd == "kill" || cmd == "fg" || cmd == "bg";
+bool isBuiltin(std::string_view cmd) {
+    return findBuiltin(cmd) != nullptr;
 }
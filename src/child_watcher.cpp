@@ -0,0 +1,197 @@
+#include "child_watcher.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#else
+#include <poll.h>
+#endif
+
+#include "jobs.hpp"
+#include "resource_limits.hpp"
+
+namespace {
+
+#ifndef __linux__
+int selfPipe[2] = {-1, -1};
+
+// All the handler does: one async-signal-safe write to wake the shell
+void sigchldHandler(int /* sig */) {
+    int savedErrno = errno;
+    char byte = 0;
+    ssize_t written = write(selfPipe[1], &byte, 1);
+    (void)written;  // A full pipe already has a wakeup pending
+    errno = savedErrno;
+}
+#endif
+
+// "Done", "Exit 3" or the signal's description, for job notices
+std::string describeStatus(int status) {
+    if (WIFEXITED(status)) {
+        int code = WEXITSTATUS(status);
+        return code == 0 ? "Done" : "Exit " + std::to_string(code);
+    }
+    if (WIFSIGNALED(status)) {
+        const char* description = strsignal(WTERMSIG(status));
+        return description ? description : "Killed";
+    }
+    return "Done";
+}
+
+}  // namespace
+
+ChildWatcher::ChildWatcher(JobManager& jobs) : jobs(jobs) {
+#ifdef __linux__
+    // Blocked, SIGCHLD stays pending until the signalfd is read
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+    eventFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    pollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (eventFd >= 0 && pollFd >= 0) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = eventFd;
+        epoll_ctl(pollFd, EPOLL_CTL_ADD, eventFd, &event);
+    }
+#else
+    if (pipe(selfPipe) == 0) {
+        for (int fd : selfPipe) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        eventFd = selfPipe[0];
+
+        struct sigaction sa;
+        sa.sa_handler = sigchldHandler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+        sigaction(SIGCHLD, &sa, nullptr);
+    }
+#endif
+}
+
+ChildWatcher::~ChildWatcher() {
+#ifdef __linux__
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+    if (pollFd >= 0) {
+        close(pollFd);
+    }
+    if (eventFd >= 0) {
+        close(eventFd);
+    }
+#else
+    signal(SIGCHLD, SIG_DFL);
+    if (eventFd >= 0) {
+        close(selfPipe[0]);
+        close(selfPipe[1]);
+        selfPipe[0] = selfPipe[1] = -1;
+    }
+#endif
+}
+
+bool ChildWatcher::drainEvents() {
+    // Without a descriptor there is nothing to tell us, so always look
+    if (eventFd < 0) {
+        return true;
+    }
+
+    // Signals coalesce, so the count read says nothing; any read means "look"
+    bool signalled = false;
+    char buffer[512];  // Room for several signalfd_siginfo records
+    while (read(eventFd, buffer, sizeof(buffer)) > 0) {
+        signalled = true;
+    }
+    return signalled;
+}
+
+size_t ChildWatcher::reap(std::ostream& out) {
+    if (!drainEvents()) {
+        return 0;
+    }
+
+    // Each waitpid returns one child that has exited, so this is O(exits).
+    // Children that aren't jobs (earlier stages of a background pipeline,
+    // foreground commands already waited for) are simply reaped.
+    size_t reported = 0;
+    int status;
+    pid_t pid;
+    Job finished(0, 0, "");
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (jobs.completeJob(pid, finished)) {
+            out << "[" << finished.jobId << "]  " << describeStatus(status)
+                << "                 " << finished.command << '\n';
+            ++reported;
+        }
+    }
+
+    // Groups left behind by jobs whose other processes outlived them
+    releaseIdleCgroups();
+    out.flush();
+    return reported;
+}
+
+void ChildWatcher::waitForInput(int fd, std::ostream& out, const std::function<void()>& redraw) {
+    if (eventFd < 0) {
+        return;
+    }
+
+    while (true) {
+        bool inputReady = false;
+        bool childEvent = false;
+
+#ifdef __linux__
+        if (pollFd < 0) {
+            return;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        // Regular files can't be watched (EPERM) but never block either
+        if (epoll_ctl(pollFd, EPOLL_CTL_ADD, fd, &event) != 0 && errno != EEXIST) {
+            return;
+        }
+
+        epoll_event events[2];
+        int ready = epoll_wait(pollFd, events, 2, -1);
+        for (int i = 0; i < ready; ++i) {
+            (events[i].data.fd == fd ? inputReady : childEvent) = true;
+        }
+#else
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {eventFd, POLLIN, 0}};
+        int ready = poll(fds, 2, -1);
+        inputReady = ready > 0 && fds[0].revents != 0;
+        childEvent = ready > 0 && fds[1].revents != 0;
+#endif
+
+        if (ready < 0 && errno != EINTR) {
+            return;
+        }
+
+        // Notices go out immediately, on their own line, then the prompt again
+        if (childEvent) {
+            std::ostringstream notices;
+            if (reap(notices) > 0) {
+                out << '\n' << notices.str();
+                redraw();
+            }
+        }
+        if (inputReady) {
+            return;
+        }
+    }
+}
@@ -1,222 +1,331 @@
 #include "command.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
-#include <cstdlib>
-#include <cstring>
-#include <iostream>
-#include <sstream>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
+#include "lexer.hpp"
 #include "limits.hpp"
 #include "utils.hpp"
 
-ParsedCommand::~ParsedCommand() {
-    for (auto& command : pipeline) {
-        for (auto arg : command.args) {
-            free(arg);
-        }
+Command& ParsedCommand::addCommand(const std::vector<std::string_view>& args,
+                                   std::string_view inputFile, std::string_view outputFile,
+                                   bool isBackground) {
+    std::vector<char*> argv;
+    argv.reserve(args.size());
+    for (std::string_view arg : args) {
+        argv.push_back(arena.copyString(arg));
+    }
+
+    Command cmd;
+    cmd.args = ArgList(arena.copyArgv(argv.data(), argv.size()), argv.size());
+    if (!inputFile.empty()) {
+        cmd.inputFile = std::string_view(arena.copyString(inputFile), inputFile.size());
     }
+    if (!outputFile.empty()) {
+        cmd.outputFile = std::string_view(arena.copyString(outputFile), outputFile.size());
+    }
+    cmd.isBackground = isBackground;
+
+    pipeline.push_back(cmd);
+    return pipeline.back();
 }
 
-// Token with context about how it was quoted
-struct TokenInfo {
-    std::string value;
-    bool fromSingleQuotes;
-    bool fromDoubleQuotes;
-
-    TokenInfo(const std::string& val, bool singleQ = false, bool doubleQ = false)
-        : value(val), fromSingleQuotes(singleQ), fromDoubleQuotes(doubleQ) {}
-};
-
-// Enhanced tokenizer that handles quotes and escapes and preserves quote context
-std::vector<TokenInfo> tokenizeWithQuotesDetailed(const std::string& input) {
-    std::vector<TokenInfo> tokens;
-    std::string currentToken;
-    bool inDoubleQuotes = false;
-    bool inSingleQuotes = false;
-    bool escaped = false;
-    bool tokenFromSingleQuotes = false;
-    bool tokenFromDoubleQuotes = false;
-
-    for (size_t i = 0; i < input.length(); ++i) {
-        char c = input[i];
-
-        if (escaped) {
-            // Handle escaped character
-            currentToken += c;
-            escaped = false;
-            continue;
+bool ParsedCommand::needsHereDocs() const {
+    for (const Command& command : pipeline) {
+        if (!command.hereDocDelimiter.empty() && !command.hasInputText) {
+            return true;
         }
+    }
+    return false;
+}
 
-        if (c == '\\' && !inSingleQuotes) {
-            // Escape next character (except in single quotes)
-            escaped = true;
-            continue;
-        }
+void ParsedCommand::setInputText(Command& command, std::string_view text) {
+    command.inputText = std::string_view(arena.copyString(text), text.size());
+    command.hasInputText = true;
+}
 
-        if (c == '"' && !inSingleQuotes) {
-            // Toggle double quote state
-            if (!inDoubleQuotes) {
-                tokenFromDoubleQuotes = true;
-            }
-            inDoubleQuotes = !inDoubleQuotes;
-            continue;
-        }
+namespace {
 
-        if (c == '\'' && !inDoubleQuotes) {
-            // Toggle single quote state
-            if (!inSingleQuotes) {
-                tokenFromSingleQuotes = true;
-            }
-            inSingleQuotes = !inSingleQuotes;
-            continue;
-        }
+// 0 means "not configured": use the system ARG_MAX. Atomic because parsing
+// may run on several threads (lint mode) while the budget is read.
+std::atomic<size_t> configuredBudget(0);
 
-        if ((c == ' ' || c == '\t') && !inDoubleQuotes && !inSingleQuotes) {
-            // Whitespace outside quotes - end current token
-            if (!currentToken.empty()) {
-                tokens.emplace_back(currentToken, tokenFromSingleQuotes, tokenFromDoubleQuotes);
-                currentToken.clear();
-                tokenFromSingleQuotes = false;
-                tokenFromDoubleQuotes = false;
-            }
-            continue;
+}  // namespace
+
+// Token offsets are 32-bit, so no line may come near 4 GiB
+static_assert(ninxsh::limits::MAX_ARG_MAX < UINT32_MAX, "token offsets would overflow");
+
+size_t systemArgMax() {
+    static const size_t argMax = [] {
+        // With an unlimited stack, Linux derives an ARG_MAX with no real bound
+        long value = sysconf(_SC_ARG_MAX);
+        if (value <= 0) {
+            return ninxsh::limits::FALLBACK_ARG_MAX;
         }
+        return std::min(static_cast<size_t>(value), ninxsh::limits::MAX_ARG_MAX);
+    }();
+    return argMax;
+}
 
-        // Regular character - add to current token
-        currentToken += c;
-    }
+size_t inputBudget() {
+    size_t budget = configuredBudget.load(std::memory_order_relaxed);
+    return budget != 0 ? budget : systemArgMax();
+}
+
+void setInputBudget(size_t bytes) {
+    // Anything bigger could never be exec'd anyway
+    configuredBudget.store(bytes < systemArgMax() ? bytes : 0, std::memory_order_relaxed);
+}
+
+CommandTemplate parseTemplate(std::string_view input) {
+    CommandTemplate result;
 
-    // Add final token if exists
-    if (!currentToken.empty()) {
-        tokens.emplace_back(currentToken, tokenFromSingleQuotes, tokenFromDoubleQuotes);
+    // Early validation: the line itself must fit the budget to prevent DoS
+    size_t budget = inputBudget();
+    if (input.length() > budget) {
+        result.hasError = true;
+        result.errorMessage = "Input too long (maximum " + std::to_string(budget) + " bytes)";
+        return result;
     }
 
-    return tokens;
+    // Lex once; pipes, redirections and & all come out of the same pass
+    return buildTemplate(lexCommandLine(input));
 }
 
-// Split input by pipes, handling quotes properly
-std::vector<std::string> splitByPipes(const std::string& input) {
-    std::vector<std::string> commands;
-    std::string currentCommand;
-    bool inDoubleQuotes = false;
-    bool inSingleQuotes = false;
-    bool escaped = false;
-
-    for (size_t i = 0; i < input.length(); ++i) {
-        char c = input[i];
-
-        if (escaped) {
-            currentCommand += c;
-            escaped = false;
-            continue;
+CommandTemplate buildTemplate(TokenStream stream) {
+    CommandTemplate result;
+    result.tokens = std::move(stream);
+    const std::vector<Token>& tokens = result.tokens.tokens;
+    result.words.reserve(tokens.size());
+
+    size_t stageBegin = 0;
+    while (stageBegin <= tokens.size()) {
+        size_t stageEnd = stageBegin;
+        while (stageEnd < tokens.size() && tokens[stageEnd].kind != TokenKind::Pipe) {
+            ++stageEnd;
         }
 
-        if (c == '\\' && !inSingleQuotes) {
-            escaped = true;
-            currentCommand += c;
-            continue;
-        }
+        CommandTemplate::Stage stage;
+        stage.firstWord = result.words.size();
 
-        if (c == '"' && !inSingleQuotes) {
-            inDoubleQuotes = !inDoubleQuotes;
-            currentCommand += c;
-            continue;
+        // Parse tokens for redirections and arguments
+        for (size_t i = stageBegin; i < stageEnd; ++i) {
+            const Token& token = tokens[i];
+
+            if (token.kind == TokenKind::RedirectIn || token.kind == TokenKind::RedirectOut) {
+                if (i + 1 >= stageEnd || tokens[i + 1].kind != TokenKind::Word) {
+                    result.hasError = true;
+                    result.errorMessage = std::string("syntax error: missing file name after '") +
+                                          (token.kind == TokenKind::RedirectIn ? '<' : '>') + "'";
+                    return result;
+                }
+                if (token.kind == TokenKind::RedirectIn) {
+                    stage.inputToken = ++i;
+                    stage.inputKind = TokenKind::RedirectIn;
+                } else {
+                    stage.outputToken = ++i;
+                }
+            } else if (token.kind == TokenKind::HereDoc || token.kind == TokenKind::HereString) {
+                // The last stdin redirection of a stage wins, as in POSIX shells
+                std::string_view op = result.tokens.text(token);
+                bool hasWord = i + 1 < stageEnd && tokens[i + 1].kind == TokenKind::Word;
+                bool emptyDelimiter = hasWord && token.kind == TokenKind::HereDoc &&
+                                      result.tokens.text(tokens[i + 1]).empty();
+                if (!hasWord || emptyDelimiter) {
+                    result.hasError = true;
+                    result.errorMessage =
+                        std::string(token.kind == TokenKind::HereDoc
+                                        ? "syntax error: missing delimiter after '"
+                                        : "syntax error: missing word after '") +
+                        std::string(op) + "'";
+                    return result;
+                }
+                stage.inputToken = ++i;
+                stage.inputKind = token.kind;
+                stage.hereDocStripsTabs = op.size() == 3 && op[2] == '-';
+            } else if (token.kind == TokenKind::ProcessSubIn ||
+                       token.kind == TokenKind::ProcessSubOut) {
+                std::string_view inner = result.tokens.text(token);
+                const std::string_view& source = result.tokens.source;
+                size_t close = static_cast<size_t>(inner.data() - source.data()) + inner.size();
+                CommandTemplate innerTemplate = parseTemplate(inner);
+                if (close >= source.size() || source[close] != ')') {
+                    result.hasError = true;
+                    result.errorMessage = "syntax error: unterminated process substitution";
+                    return result;
+                }
+                if (innerTemplate.hasError || innerTemplate.stages.empty()) {
+                    result.hasError = true;
+                    result.errorMessage = "syntax error in process substitution: " +
+                                          (innerTemplate.hasError ? innerTemplate.errorMessage
+                                                                  : std::string("empty command"));
+                    return result;
+                }
+                result.words.push_back({static_cast<uint32_t>(i), false, true});
+                result.substitutions.push_back(std::move(innerTemplate));
+            } else if (token.kind == TokenKind::Background && i == stageEnd - 1) {
+                // & at the end means background
+                stage.isBackground = true;
+            } else {
+                // Regular argument; decide once whether expansion can change it
+                std::string_view text = result.tokens.text(token);
+                bool needsExpansion = (!token.fromSingleQuotes &&
+                                       text.find('$') != std::string_view::npos) ||
+                                      (!text.empty() && text[0] == '~');
+                result.words.push_back({static_cast<uint32_t>(i), needsExpansion, false});
+            }
         }
 
-        if (c == '\'' && !inDoubleQuotes) {
-            inSingleQuotes = !inSingleQuotes;
-            currentCommand += c;
-            continue;
-        }
+        stageBegin = stageEnd + 1;
 
-        if (c == '|' && !inDoubleQuotes && !inSingleQuotes) {
-            // Pipe outside quotes - split here
-            commands.push_back(trim(currentCommand));
-            currentCommand.clear();
-            continue;
+        stage.wordCount = result.words.size() - stage.firstWord;
+        if (stage.wordCount == 0) {
+            continue;  // Skip commands with no actual command
         }
 
-        currentCommand += c;
+        result.stages.push_back(stage);
     }
 
-    // Add final command
-    if (!currentCommand.empty()) {
-        commands.push_back(trim(currentCommand));
-    }
-
-    return commands;
+    return result;
 }
 
-ParsedCommand parseCommand(const std::string& input) {
+ParsedCommand expandTemplate(const CommandTemplate& tmpl, const ExpansionContext& context) {
     ParsedCommand result;
+    result.isIncomplete = tmpl.tokens.isIncomplete;
 
-    // Early validation: reject excessively long input to prevent DoS
-    if (input.length() > ninxsh::limits::MAX_INPUT_LENGTH) {
+    if (tmpl.hasError) {
         result.hasError = true;
-        result.errorMessage = "Input too long (maximum " +
-                              std::to_string(ninxsh::limits::MAX_INPUT_LENGTH) + " characters)";
+        result.errorMessage = tmpl.errorMessage;
         return result;
     }
 
-    // Split the input by pipe character, respecting quotes
-    std::vector<std::string> pipeCommands = splitByPipes(input);
+    const TokenStream& stream = tmpl.tokens;
 
-    // Process each command in the pipeline
-    for (const auto& cmdStr : pipeCommands) {
-        // Tokenize the command, handling quotes and escapes with context
-        std::vector<TokenInfo> allTokens = tokenizeWithQuotesDetailed(cmdStr);
+    // Size the arena for the common case up front: every byte of the line plus
+    // a pointer per word fits in the first block unless expansion grows it
+    result.arena.reserve(stream.source.size() + tmpl.words.size() * (sizeof(char*) + 1) + 256);
+    result.pipeline.reserve(tmpl.stages.size());
 
-        if (allTokens.empty()) {
-            continue;  // Skip empty commands
-        }
+    std::vector<char*> argv;  // Reused across stages; copied into the arena per stage
+    std::string expanded;
+    size_t nextSubstitution = 0;  // Into tmpl.substitutions
 
-        std::vector<std::string> cmdTokens;
-        std::string infile, outfile;
-        bool isBackground = false;
+    // Expansion can grow a line well past its source length, so the budget is
+    // charged again here the way execve counts it
+    const size_t budget = inputBudget();
+    size_t argvBytes = 0;
 
-        // Parse tokens for redirections and arguments
-        for (size_t i = 0; i < allTokens.size(); ++i) {
-            const TokenInfo& tokenInfo = allTokens[i];
-            const std::string& token = tokenInfo.value;
-
-            if (token == "<" && i + 1 < allTokens.size()) {
-                infile = allTokens[++i].value;  // Get next token as input file
-            } else if (token == ">" && i + 1 < allTokens.size()) {
-                outfile = allTokens[++i].value;  // Get next token as output file
-            } else if (token == "&" && i == allTokens.size() - 1) {
-                // & at the end means background
-                isBackground = true;
-            } else {
-                // Regular argument - handle expansion based on quote context
-                std::string processedToken = token;
+    for (const CommandTemplate::Stage& stage : tmpl.stages) {
+        Command cmd;
+        argv.clear();
+
+        for (size_t w = stage.firstWord; w < stage.firstWord + stage.wordCount; ++w) {
+            const CommandTemplate::Word& word = tmpl.words[w];
+            const Token& token = stream.tokens[word.token];
+            std::string_view text = stream.text(token);
+
+            if (word.isSubstitution) {
+                // Inner commands are expanded now, with the same context
+                ParsedCommand::Substitution substitution;
+                substitution.stage = result.pipeline.size();
+                substitution.arg = argv.size();
+                substitution.isOutput = token.kind == TokenKind::ProcessSubOut;
+                substitution.command.reset(new ParsedCommand(
+                    expandTemplate(tmpl.substitutions[nextSubstitution++], context)));
+                if (substitution.command->hasError) {
+                    result.pipeline.clear();
+                    result.hasError = true;
+                    result.errorMessage = substitution.command->errorMessage;
+                    return result;
+                }
+                result.substitutions.push_back(std::move(substitution));
+
+                // Placeholder until the stage is launched and the descriptor known
+                argvBytes += sizeof("/dev/fd/") + 10 + sizeof(char*);
+                argv.push_back(result.arena.copyString(text));
+                continue;
+            }
 
-                // Only expand environment variables if NOT from single quotes
-                if (!tokenInfo.fromSingleQuotes) {
-                    processedToken = expandEnvVars(processedToken);
+            if (!word.needsExpansion) {
+                argvBytes += text.size() + 1 + sizeof(char*);
+                if (argvBytes > budget) {
+                    break;
                 }
+                // Nothing to expand: copy the span straight into the arena
+                argv.push_back(result.arena.copyString(text));
+                continue;
+            }
+
+            // Only expand environment variables if NOT from single quotes
+            if (!token.fromSingleQuotes) {
+                expanded.clear();
+                expandEnvVarsInto(text, context, expanded);
+            } else {
+                expanded.assign(text.data(), text.size());
+            }
 
-                // Always expand paths (~ expansion)
-                processedToken = expandPath(processedToken);
+            // Always expand paths (~ expansion)
+            expanded = expandPath(expanded);
 
-                cmdTokens.push_back(processedToken);
+            argvBytes += expanded.size() + 1 + sizeof(char*);
+            if (argvBytes > budget) {
+                break;
             }
+            argv.push_back(result.arena.copyString(expanded));
         }
 
-        if (cmdTokens.empty()) {
-            continue;  // Skip commands with no actual command
+        argvBytes += sizeof(char*);  // Terminating nullptr
+        if (argvBytes > budget) {
+            result.pipeline.clear();
+            result.hasError = true;
+            result.errorMessage =
+                "Input too long (arguments exceed " + std::to_string(budget) + " bytes)";
+            return result;
         }
 
-        // Create a Command struct for this part of the pipeline
-        Command cmd;
-        for (const auto& token : cmdTokens) {
-            cmd.args.push_back(strdup(token.c_str()));
+        if (stage.inputToken != CommandTemplate::NO_TOKEN) {
+            const Token& token = stream.tokens[stage.inputToken];
+            std::string_view text = stream.text(token);
+            if (stage.inputKind == TokenKind::HereString) {
+                // Expanded like an argument, then fed with a trailing newline
+                expanded.clear();
+                if (token.fromSingleQuotes) {
+                    expanded.assign(text.data(), text.size());
+                } else {
+                    expandEnvVarsInto(text, context, expanded);
+                }
+                expanded += '\n';
+                if (expanded.size() > budget) {
+                    result.pipeline.clear();
+                    result.hasError = true;
+                    result.errorMessage =
+                        "Input too long (here-string exceeds " + std::to_string(budget) + " bytes)";
+                    return result;
+                }
+                cmd.inputText =
+                    std::string_view(result.arena.copyString(expanded), expanded.size());
+                cmd.hasInputText = true;
+            } else if (stage.inputKind == TokenKind::HereDoc) {
+                cmd.hereDocDelimiter = std::string_view(result.arena.copyString(text), text.size());
+                cmd.hereDocExpands = !token.fromSingleQuotes && !token.fromDoubleQuotes;
+                cmd.hereDocStripsTabs = stage.hereDocStripsTabs;
+            } else {
+                cmd.inputFile = std::string_view(result.arena.copyString(text), text.size());
+            }
         }
-        cmd.args.push_back(nullptr);
-        cmd.inputFile = infile;
-        cmd.outputFile = outfile;
-        cmd.isBackground = isBackground;
+        if (stage.outputToken != CommandTemplate::NO_TOKEN) {
+            std::string_view file = stream.text(stream.tokens[stage.outputToken]);
+            cmd.outputFile = std::string_view(result.arena.copyString(file), file.size());
+        }
+        cmd.isBackground = stage.isBackground;
+        cmd.args = ArgList(result.arena.copyArgv(argv.data(), argv.size()), argv.size());
 
         // Add this command to the pipeline
         result.pipeline.push_back(cmd);
@@ -224,3 +333,24 @@ ParsedCommand parseCommand(const std::string& input) {
 
     return result;
 }
+
+std::vector<std::pair<std::string_view, bool>> hereDocDelimiters(const CommandTemplate& tmpl) {
+    std::vector<std::pair<std::string_view, bool>> delimiters;
+    for (const CommandTemplate::Stage& stage : tmpl.stages) {
+        if (stage.inputToken != CommandTemplate::NO_TOKEN &&
+            stage.inputKind == TokenKind::HereDoc) {
+            delimiters.emplace_back(tmpl.tokens.text(tmpl.tokens.tokens[stage.inputToken]),
+                                    stage.hereDocStripsTabs);
+        }
+    }
+    return delimiters;
+}
+
+std::string_view stripLeadingTabs(std::string_view line) {
+    size_t start = line.find_first_not_of('\t');
+    return start == std::string_view::npos ? std::string_view() : line.substr(start);
+}
+
+ParsedCommand parseCommand(const std::string& input) {
+    return expandTemplate(parseTemplate(input));
+}
@@ -0,0 +1,125 @@
+#include "command_hash.hpp"
+
+#include <algorithm>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "environment.hpp"
+
+std::string searchPath(std::string_view name) {
+    if (name.find('/') != std::string_view::npos) {
+        return std::string(name);
+    }
+    if (name.empty()) {
+        return std::string();
+    }
+
+    const char* path = lookupEnv("PATH");
+    std::string_view dirs = path ? path : "/bin:/usr/bin";  // execvp's default
+    std::string candidate;
+    while (true) {
+        size_t colon = dirs.find(':');
+        std::string_view dir = dirs.substr(0, colon);
+
+        // An empty PATH entry means the current directory
+        candidate.assign(dir.empty() ? std::string_view(".") : dir);
+        candidate += '/';
+        candidate += name;
+
+        struct stat info;
+        if (stat(candidate.c_str(), &info) == 0 && S_ISREG(info.st_mode) &&
+            access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+        if (colon == std::string_view::npos) {
+            return std::string();
+        }
+        dirs.remove_prefix(colon + 1);
+    }
+}
+
+void CommandHash::checkPath() {
+    const char* path = lookupEnv("PATH");
+    std::string_view current = path ? path : "";
+    if (current != cachedPath) {
+        table.clear();
+        cachedPath.assign(current);
+    }
+}
+
+const std::string& CommandHash::find(std::string_view name) {
+    if (name.find('/') != std::string_view::npos || name.empty()) {
+        scratch.assign(name);
+        return scratch;
+    }
+
+    checkPath();
+    auto it = table.find(std::string(name));
+    if (it != table.end()) {
+        Entry& entry = it->second;
+        if (!entry.path.empty()) {
+            ++entry.hits;
+            return entry.path;
+        }
+        if (Clock::now() < entry.expires) {
+            return entry.path;
+        }
+        table.erase(it);
+    }
+
+    Entry entry;
+    entry.path = searchPath(name);
+    if (entry.path.empty()) {
+        entry.expires = Clock::now() + NEGATIVE_TTL;
+    } else {
+        entry.hits = 1;
+    }
+    return table.insert_or_assign(std::string(name), std::move(entry)).first->second.path;
+}
+
+const std::string* CommandHash::peek(std::string_view name) const {
+    // A table filled under another PATH answers nothing, but is left for
+    // find() to clear
+    const char* path = lookupEnv("PATH");
+    if (std::string_view(path ? path : "") != cachedPath) {
+        return nullptr;
+    }
+    auto it = table.find(std::string(name));
+    if (it == table.end() || it->second.path.empty()) {
+        return nullptr;
+    }
+    return &it->second.path;
+}
+
+bool CommandHash::add(std::string_view name) {
+    checkPath();
+    Entry entry;
+    entry.path = searchPath(name);
+    if (entry.path.empty()) {
+        table.erase(std::string(name));
+        return false;
+    }
+    table.insert_or_assign(std::string(name), std::move(entry));
+    return true;
+}
+
+bool CommandHash::forget(std::string_view name) {
+    return table.erase(std::string(name)) > 0;
+}
+
+void CommandHash::clear() {
+    table.clear();
+}
+
+std::vector<std::pair<std::string, CommandHash::Entry>> CommandHash::entries() {
+    checkPath();
+    std::vector<std::pair<std::string, Entry>> found;
+    for (const auto& item : table) {
+        if (!item.second.path.empty()) {
+            found.push_back(item);
+        }
+    }
+    std::sort(found.begin(), found.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    return found;
+}
@@ -0,0 +1,215 @@
+#include "environment.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const size_t NOT_FOUND = static_cast<size_t>(-1);
+
+Environment* currentEnvironment = nullptr;
+
+size_t roundUpToPowerOfTwo(size_t n) {
+    size_t capacity = 8;
+    while (capacity < n) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+}  // namespace
+
+Environment::Environment(size_t capacity) : slots(roundUpToPowerOfTwo(capacity)) {}
+
+uint64_t Environment::hashName(std::string_view name) {
+    // FNV-1a: short keys, no need for anything stronger
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+size_t Environment::findSlot(std::string_view name, uint64_t hash) const {
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Slot& slot = slots[i];
+        if (slot.state == SlotState::Empty) {
+            return NOT_FOUND;
+        }
+        if (slot.state == SlotState::Occupied && slot.hash == hash &&
+            std::string_view(slot.entry).substr(0, slot.nameLength) == name) {
+            return i;
+        }
+    }
+}
+
+void Environment::rehash(size_t newCapacity) {
+    std::vector<Slot> old(roundUpToPowerOfTwo(newCapacity));
+    old.swap(slots);
+    tombstones = 0;
+
+    size_t mask = slots.size() - 1;
+    for (Slot& slot : old) {
+        if (slot.state != SlotState::Occupied) {
+            continue;
+        }
+        size_t i = slot.hash & mask;
+        while (slots[i].state != SlotState::Empty) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = std::move(slot);
+    }
+    envpDirty = true;
+}
+
+void Environment::load(char* const* envp) {
+    size_t entriesGiven = 0;
+    while (envp && envp[entriesGiven]) {
+        ++entriesGiven;
+    }
+
+    slots.assign(roundUpToPowerOfTwo(entriesGiven * 2), Slot());
+    count = 0;
+    tombstones = 0;
+    envpDirty = true;
+
+    for (size_t i = 0; i < entriesGiven; ++i) {
+        std::string_view entry(envp[i]);
+        size_t equals = entry.find('=');
+        if (equals == std::string_view::npos || equals == 0) {
+            continue;  // Malformed entry, as getenv would never match it
+        }
+        set(entry.substr(0, equals), entry.substr(equals + 1));
+    }
+}
+
+const char* Environment::get(std::string_view name) const {
+    size_t i = findSlot(name, hashName(name));
+    if (i == NOT_FOUND) {
+        return nullptr;
+    }
+    return slots[i].entry.c_str() + slots[i].nameLength + 1;
+}
+
+void Environment::set(std::string_view name, std::string_view value) {
+    uint64_t hash = hashName(name);
+    size_t existing = findSlot(name, hash);
+    envpDirty = true;
+
+    if (existing != NOT_FOUND) {
+        Slot& slot = slots[existing];
+        slot.entry.replace(slot.nameLength + 1, std::string::npos, value.data(), value.size());
+        return;
+    }
+
+    // Keep at most 70% of slots in use (tombstones included) so probes stay short
+    if ((count + tombstones + 1) * 10 > slots.size() * 7) {
+        rehash(count * 2 + 2 > slots.size() ? slots.size() * 2 : slots.size());
+    }
+
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    while (slots[i].state == SlotState::Occupied) {
+        i = (i + 1) & mask;
+    }
+
+    Slot& slot = slots[i];
+    if (slot.state == SlotState::Deleted) {
+        --tombstones;
+    }
+    slot.entry.reserve(name.size() + value.size() + 1);
+    slot.entry.assign(name.data(), name.size());
+    slot.entry += '=';
+    slot.entry.append(value.data(), value.size());
+    slot.nameLength = name.size();
+    slot.hash = hash;
+    slot.state = SlotState::Occupied;
+    ++count;
+}
+
+bool Environment::unset(std::string_view name) {
+    size_t i = findSlot(name, hashName(name));
+    if (i == NOT_FOUND) {
+        return false;
+    }
+
+    Slot& slot = slots[i];
+    slot.entry.clear();
+    slot.entry.shrink_to_fit();
+    slot.state = SlotState::Deleted;
+    --count;
+    ++tombstones;
+    envpDirty = true;
+    return true;
+}
+
+size_t Environment::size() const {
+    return count;
+}
+
+size_t Environment::capacity() const {
+    return slots.size();
+}
+
+char** Environment::envp() {
+    if (envpDirty) {
+        envpCache.clear();
+        envpCache.reserve(count + 1);
+        for (Slot& slot : slots) {
+            if (slot.state == SlotState::Occupied) {
+                envpCache.push_back(slot.entry.data());
+            }
+        }
+        envpCache.push_back(nullptr);
+        envpDirty = false;
+    }
+    return envpCache.data();
+}
+
+std::vector<std::pair<std::string_view, std::string_view>> Environment::entries() const {
+    std::vector<std::pair<std::string_view, std::string_view>> result;
+    result.reserve(count);
+    for (const Slot& slot : slots) {
+        if (slot.state == SlotState::Occupied) {
+            std::string_view entry(slot.entry);
+            result.emplace_back(entry.substr(0, slot.nameLength),
+                                entry.substr(slot.nameLength + 1));
+        }
+    }
+    return result;
+}
+
+bool Environment::isValidName(std::string_view name) {
+    if (name.empty() || !(std::isalpha(static_cast<unsigned char>(name[0])) || name[0] == '_')) {
+        return false;
+    }
+    for (char c : name) {
+        if (!(std::isalnum(static_cast<unsigned char>(c)) || c == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void setActiveEnvironment(Environment* environment) {
+    currentEnvironment = environment;
+}
+
+Environment* activeEnvironment() {
+    return currentEnvironment;
+}
+
+const char* lookupEnv(std::string_view name) {
+    if (currentEnvironment) {
+        return currentEnvironment->get(name);
+    }
+    // getenv needs a NUL-terminated name
+    std::string key(name);
+    return getenv(key.c_str());
+}
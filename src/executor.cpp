@@ -1,39 +1,48 @@
 #include "executor.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
 #include <csignal>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
 #include <iostream>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
+#include <string>
+#include <string_view>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
 #include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
+#ifdef __linux__
+#include <linux/sched.h>
+#endif
+
+#include "builtin.hpp"
 #include "command.hpp"
+#include "command_hash.hpp"
+#include "environment.hpp"
+#include "fd_stream.hpp"
 #include "jobs.hpp"
+#include "pipe_tuning.hpp"
+#include "resource_limits.hpp"
+#include "utils.hpp"
 
-bool isShellForeground = true;
-static JobManager* globalJobManager = nullptr;
+extern char** environ;
 
-void sigchldHandler(int /* sig */) {
-    // Loop through all zombies and reap them
-    int status;
-    pid_t pid;
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        // Update job status if we have a job manager
-        if (globalJobManager) {
-            Job* job = globalJobManager->findJobByPid(pid);
-            if (job) {
-                if (WIFEXITED(status) || WIFSIGNALED(status)) {
-                    // Job finished, remove it
-                    globalJobManager->removeJob(pid);
-                }
-            }
-        }
-    }
-}
+bool isShellForeground = true;
 
 void sigintHandler(int /* sig */) {
     if (isShellForeground) {
@@ -52,14 +61,8 @@ void sigtstpHandler(int /* sig */) {
 }
 
 void setupSignalHandlers() {
+    // SIGCHLD is left to ChildWatcher, which never reaps from signal context
     struct sigaction sa;
-    sa.sa_handler = sigchldHandler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-
-    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
-        std::cout << "ninxsh: sigaction error for SIGCHLD\n";
-    }
 
     // Set up SIGINT (Ctrl+C) handler
     sa.sa_handler = sigintHandler;
@@ -80,6 +83,24 @@ void setupSignalHandlers() {
     }
 }
 
+// Environment children should see: the shell's table if one is active. Called
+// before fork so the cached envp is (re)built once in the parent, not per child.
+static char** environmentForExec() {
+    Environment* environment = activeEnvironment();
+    return environment ? environment->envp() : environ;
+}
+
+// Translate a waitpid status into a shell exit status
+static int exitStatusOf(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return EXIT_FAILURE;
+}
+
 void cleanupZombieProcesses() {
     int status;
     pid_t pid;
@@ -87,153 +108,762 @@ void cleanupZombieProcesses() {
     }
 }
 
-void executeExternal(const ParsedCommand& cmd, JobManager* jobManager) {
-    // If there's more than one command in the pipeline, use the pipeline executor
-    if (cmd.pipeline.size() > 1) {
-        executePipeline(cmd, jobManager);
-        return;
+namespace {
+
+LaunchBackend configuredBackend = LaunchBackend::PosixSpawn;
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// What a stage gets as stdin/stdout; -1 means it inherits the shell's
+struct StageIo {
+    int in = -1;
+    int out = -1;
+};
+
+// Redirections are opened by the shell, close-on-exec, so a failure is
+// reported before anything starts and both backends only need a dup2
+int openRedirection(std::string_view path, bool forOutput) {
+    int fd = forOutput ? open(path.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+                       : open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::perror(forOutput ? "ninxsh: output redirection" : "ninxsh: input redirection");
     }
+    return fd;
+}
 
-    // Otherwise execute a single command (the first/only one in the pipeline)
-    const Command& command = cmd.pipeline[0];
-    pid_t pid = fork();
+// A close-on-exec pipe: exec'd children keep only the ends dup2'd onto
+// their stdin/stdout, without anyone closing descriptors one by one
+bool openPipe(int fds[2]) {
+#ifdef __APPLE__
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#else
+    return pipe2(fds, O_CLOEXEC) == 0;
+#endif
+}
+
+// A read-only descriptor positioned at the start of text, for a here-doc or
+// here-string. Bodies up to PIPE_BUF go through a pipe: one write that always
+// fits, so nothing has to drain it concurrently. Larger ones are written once
+// into a sealed memfd (an anonymous unlinked temp file without memfd), which
+// the reader can't block on or modify and which nothing has to clean up.
+int openInputText(std::string_view text) {
+    if (text.size() <= PIPE_BUF) {
+        int fds[2];
+        if (!openPipe(fds)) {
+            std::perror("ninxsh: here-document");
+            return -1;
+        }
+        bool ok = writeAll(fds[1], text);
+        close(fds[1]);
+        if (!ok) {
+            std::perror("ninxsh: here-document");
+            close(fds[0]);
+            return -1;
+        }
+        return fds[0];
+    }
+
+    int fd = -1;
+#ifdef MFD_ALLOW_SEALING
+    fd = memfd_create("ninxsh-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+    if (fd < 0) {
+        char path[] = "/tmp/ninxsh-heredoc-XXXXXX";
+        fd = mkstemp(path);
+        if (fd >= 0) {
+            unlink(path);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    if (fd < 0 || !writeAll(fd, text) || lseek(fd, 0, SEEK_SET) != 0) {
+        std::perror("ninxsh: here-document");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+#ifdef F_SEAL_SEAL
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+    return fd;
+}
+
+// The stage's own stdin redirection (here-doc, here-string or < file), or -1
+// with ok left true if it has none
+int openStageInput(const Command& command, bool& ok) {
+    int fd = -1;
+    if (command.hasInputText) {
+        fd = openInputText(command.inputText);
+    } else if (!command.inputFile.empty()) {
+        fd = openRedirection(command.inputFile, false);
+    } else {
+        return -1;
+    }
+    ok = fd >= 0;
+    return fd;
+}
 
+// The fork path: needed to run a builtin as a pipeline stage, and for
+// scripts without a #! line, which execvp hands to /bin/sh. path is the
+// resolved executable (unused for builtins). spareFd is the read end of the
+// stage's own output pipe: close-on-exec covers exec'd commands, but a
+// builtin holding it would never see EPIPE. With a cgroup (limit builtin)
+// the child moves itself into the job's group and sets its rlimits first.
+pid_t forkStage(const Command& command, const std::string& path, StageIo io, int spareFd,
+                char** envp, const Builtin* builtin, const BuiltinContext* builtins,
+                const JobCgroup* cgroup) {
+    // A builtin writes through std::cout in the child, which would print
+    // anything still buffered in the shell's copy a second time
+    if (builtin) {
+        std::cout.flush();
+    }
+    pid_t pid = fork();
     if (pid < 0) {
         std::cerr << "ninxsh: fork failed\n";
-        return;
+    }
+    if (pid != 0) {
+        return pid;
     }
 
-    if (pid == 0) {
-        if (!command.inputFile.empty()) {
-            int fd = open(command.inputFile.c_str(), O_RDONLY);
-            if (fd < 0) {
-                std::perror("ninxsh: input redirection");
-                exit(EXIT_FAILURE);
-            }
-            dup2(fd, STDIN_FILENO);
-            close(fd);
+    // The shell blocks SIGCHLD (see ChildWatcher); commands start with nothing blocked
+    sigset_t noSignals;
+    sigemptyset(&noSignals);
+    sigprocmask(SIG_SETMASK, &noSignals, nullptr);
+
+    if (cgroup) {
+        if (!cgroup->path().empty()) {
+            enterCgroup(cgroup->procsPath());
+        }
+        applyRlimits(cgroup->processLimits());
+    }
+
+    if (io.in > STDERR_FILENO) {
+        dup2(io.in, STDIN_FILENO);
+        close(io.in);
+    }
+    if (io.out > STDERR_FILENO) {
+        dup2(io.out, STDOUT_FILENO);
+        close(io.out);
+    }
+    if (spareFd >= 0) {
+        close(spareFd);
+    }
+
+    // Builtins use the same dispatch table as the shell
+    if (builtin) {
+        int status =
+            builtin->handler(command.args, builtins ? *builtins : BuiltinContext(), std::cout);
+        std::cout.flush();
+        exit(status);
+    }
+
+    // execvp searches PATH via getenv, so it must see the shell's table too.
+    // It is only the fallback, for a #!-less script or a path that vanished.
+    environ = envp;
+    execv(path.c_str(), command.args.data());
+    execvp(command.args[0], command.args.data());
+    std::cerr << "ninxsh: command not found: " << command.args[0] << "\n";
+    exit(STATUS_COMMAND_NOT_FOUND);
+}
+
+#if defined(SYS_clone3) && defined(CLONE_INTO_CGROUP)
+// Start path already inside the job's cgroup: clone3 with CLONE_INTO_CGROUP
+// places the child atomically, so none of it runs outside the limits and
+// nothing has to write to cgroup.procs. Like fork, the child is a copy of
+// the shell, so it makes only async-signal-safe calls before exec; a script
+// without a #! line is run with scriptArgv (/bin/sh path args...). Returns
+// -1 if clone3 can't be used (older kernel, a group that refuses processes),
+// for the caller to fall back on fork.
+pid_t cloneIntoCgroup(const JobCgroup& cgroup, const std::string& path, char* const* argv,
+                      char* const* scriptArgv, StageIo io, char** envp) {
+    struct clone_args args = {};
+    args.flags = CLONE_INTO_CGROUP;
+    args.exit_signal = SIGCHLD;
+    args.cgroup = static_cast<uint64_t>(cgroup.fd());
+    std::string failure = "ninxsh: " + std::string(argv[0]) + ": cannot execute\n";
+
+    long pid = syscall(SYS_clone3, &args, sizeof(args));
+    if (pid != 0) {
+        return static_cast<pid_t>(pid);
+    }
+
+    sigset_t noSignals;
+    sigemptyset(&noSignals);
+    sigprocmask(SIG_SETMASK, &noSignals, nullptr);
+    applyRlimits(cgroup.processLimits());
+    if (io.in > STDERR_FILENO) {
+        dup2(io.in, STDIN_FILENO);
+    }
+    if (io.out > STDERR_FILENO) {
+        dup2(io.out, STDOUT_FILENO);
+    }
+
+    execve(path.c_str(), argv, envp);
+    if (errno == ENOEXEC) {
+        execve(scriptArgv[0], scriptArgv, envp);
+    }
+    int code = errno == ENOENT ? STATUS_COMMAND_NOT_FOUND : STATUS_NOT_EXECUTABLE;
+    ssize_t written = write(STDERR_FILENO, failure.data(), failure.size());
+    (void)written;
+    _exit(code);
+}
+#endif
+
+// Start one stage with io as its stdin/stdout (see forkStage for spareFd),
+// under cgroup's limits if it is given. Returns the child's pid, or -1 with
+// status set when nothing could be started.
+pid_t launchStage(const Command& command, StageIo io, int spareFd, char** envp,
+                  const Builtin* builtin, const BuiltinContext* builtins,
+                  const JobCgroup* cgroup, int& status) {
+    status = EXIT_FAILURE;
+    if (builtin) {
+        return forkStage(command, std::string(), io, spareFd, envp, builtin, builtins, cgroup);
+    }
+
+    // Resolved by the shell (through the command hash when there is one), so
+    // only execv/posix_spawn of an absolute path is left for the child
+    CommandHash* commandHash = builtins ? builtins->commandHash : nullptr;
+    const char* name = command.args[0];
+    std::string path = commandHash ? commandHash->find(name) : searchPath(name);
+    if (path.empty()) {
+        std::cerr << "ninxsh: command not found: " << name << "\n";
+        status = STATUS_COMMAND_NOT_FOUND;
+        return -1;
+    }
+
+    // A forked or cloned child can't tell the shell that exec failed, so a
+    // hashed path that has since disappeared is dropped and searched for
+    // again here (posix_spawn reports it, and is retried below)
+    bool forks = cgroup || configuredBackend == LaunchBackend::Fork;
+    if (forks && commandHash && access(path.c_str(), X_OK) != 0 && commandHash->forget(name)) {
+        path = commandHash->find(name);
+        if (path.empty()) {
+            std::cerr << "ninxsh: command not found: " << name << "\n";
+            status = STATUS_COMMAND_NOT_FOUND;
+            return -1;
         }
+    }
 
-        if (!command.outputFile.empty()) {
-            int fd = open(command.outputFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd < 0) {
-                std::perror("ninxsh: output redirection");
-                exit(EXIT_FAILURE);
+    // posix_spawn can set neither rlimits nor a cgroup for the child, so
+    // limited jobs are cloned straight into their group, or forked
+    if (cgroup) {
+#if defined(SYS_clone3) && defined(CLONE_INTO_CGROUP)
+        if (cgroup->fd() >= 0) {
+            std::vector<char*> scriptArgv = {const_cast<char*>("/bin/sh"), &path[0]};
+            scriptArgv.insert(scriptArgv.end(), command.args.begin() + 1, command.args.end());
+            pid_t pid = cloneIntoCgroup(*cgroup, path, command.args.data(), scriptArgv.data(),
+                                        io, envp);
+            if (pid > 0) {
+                return pid;
             }
-            dup2(fd, STDOUT_FILENO);
-            close(fd);
         }
+#endif
+        return forkStage(command, path, io, spareFd, envp, nullptr, builtins, cgroup);
+    }
 
-        execvp(command.args[0], command.args.data());
-        std::cerr << "ninxsh: command not found: " << command.args[0] << "\n";
-        exit(EXIT_FAILURE);
-    } else {
-        if (command.isBackground) {
-            // Add job to job manager if provided
-            if (jobManager) {
-                std::string jobCommand = command.args[0];
-                for (size_t i = 1; i < command.args.size() - 1;
-                     ++i) {  // -1 because last element is nullptr
-                    jobCommand += " " + std::string(command.args[i]);
+    if (configuredBackend == LaunchBackend::Fork) {
+        return forkStage(command, path, io, spareFd, envp, nullptr, builtins, nullptr);
+    }
+
+    // glibc's posix_spawn runs the child on a CLONE_VM|CLONE_VFORK clone, so
+    // no page tables are copied and the cost stays flat as the shell grows
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (io.in >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, io.in, STDIN_FILENO);
+    }
+    if (io.out >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, io.out, STDOUT_FILENO);
+    }
+
+    // The shell blocks SIGCHLD (see ChildWatcher); commands start with nothing blocked
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t noSignals;
+    sigemptyset(&noSignals);
+    posix_spawnattr_setsigmask(&attributes, &noSignals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
+
+    pid_t pid = -1;
+    int error =
+        posix_spawn(&pid, path.c_str(), &actions, &attributes, command.args.data(), envp);
+
+    // A hashed path that has since disappeared: drop it and search PATH again
+    if (error == ENOENT && commandHash && commandHash->forget(name)) {
+        path = commandHash->find(name);
+        if (!path.empty()) {
+            error = posix_spawn(&pid, path.c_str(), &actions, &attributes, command.args.data(),
+                                envp);
+        }
+    }
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (error == ENOEXEC) {
+        return forkStage(command, path, io, spareFd, envp, nullptr, builtins, nullptr);
+    }
+    if (error != 0) {
+        std::cerr << "ninxsh: " << name << ": " << std::strerror(error) << "\n";
+        status = error == ENOENT ? STATUS_COMMAND_NOT_FOUND : STATUS_NOT_EXECUTABLE;
+        return -1;
+    }
+    return pid;
+}
+
+// Body of the helper thread that runs a read-only builtin as a pipeline
+// stage, writing into fd (which it closes). SIGPIPE is blocked on this thread
+// alone, so a reader that quits early ends the builtin with EPIPE, reported
+// like an external command killed by SIGPIPE, instead of killing the shell.
+// The stage's usage is the thread's own, where the system can tell (Linux).
+void runBuiltinStage(const Builtin* builtin, const Command& command, BuiltinContext context,
+                     int fd, StageReport* report) {
+    Clock::time_point start = Clock::now();
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, nullptr);
+
+    {
+        FdOutputStream out(fd);
+        report->status = builtin->handler(command.args, context, out);
+        out.flush();
+        if (!out && report->status == 0) {
+            report->status = 128 + SIGPIPE;
+        }
+    }
+    close(fd);
+
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &report->usage);
+#endif
+    report->realSeconds = secondsSince(start);
+}
+
+// Starts the stages of a pipeline, and the commands of any process
+// substitutions in it, without waiting for them. All of them go into
+// cgroup, if given.
+class PipelineLauncher {
+public:
+    PipelineLauncher(const BuiltinContext* builtins, bool inProcessBuiltins,
+                     const JobCgroup* cgroup)
+        : builtins(builtins), inProcessBuiltins(inProcessBuiltins), cgroup(cgroup),
+          envp(environmentForExec()), pipeBuffers(pipeBufferPolicy()) {}
+
+    // Start every stage of cmd. Unless they have redirections of their own,
+    // the first stage reads input and the last writes output (-1 for the
+    // shell's own); both are closed here either way. pids, stages and
+    // launchedAt get an entry per stage; one that did not start has pid -1
+    // and its status set.
+    void start(const ParsedCommand& cmd, int input, int output, std::vector<pid_t>& pids,
+               std::vector<StageReport>& stages, std::vector<Clock::time_point>& launchedAt);
+
+    std::vector<std::thread> builtinThreads;  // In-process builtin stages, to be joined
+    std::vector<pid_t> helpers;               // Process substitution commands, to be reaped
+
+private:
+    bool startSubstitutions(const ParsedCommand& cmd, size_t stage, std::vector<char*>& argv,
+                            std::vector<std::string>& paths, std::vector<int>& ends);
+
+    const BuiltinContext* builtins;
+    bool inProcessBuiltins;
+    const JobCgroup* cgroup;
+    char** envp;
+    const PipeBufferPolicy& pipeBuffers;
+};
+
+void PipelineLauncher::start(const ParsedCommand& cmd, int input, int output,
+                             std::vector<pid_t>& pids, std::vector<StageReport>& stages,
+                             std::vector<Clock::time_point>& launchedAt) {
+    size_t numCommands = cmd.pipeline.size();
+    pids.assign(numCommands, -1);
+    stages.assign(numCommands, StageReport());
+    launchedAt.assign(numCommands, Clock::now());
+
+    // Each pipe is made just before the stage that writes to it, and the
+    // shell lets go of both ends once their stages have started. So the
+    // shell holds at most three descriptors at a time however long the
+    // pipeline is, and each child only ever sees its own two ends.
+    int previousRead = input;  // What stage i reads unless redirected
+
+    // In-process builtin stages, started once every process stage has been:
+    // type and which read the command hash that launching those fills in
+    struct PendingBuiltin {
+        const Builtin* builtin;
+        const Command* command;
+        int out;
+        size_t stage;
+    };
+    std::vector<PendingBuiltin> pendingBuiltins;
+
+    // A stage that can't start (bad redirection, unknown command) is skipped
+    // with its status recorded; its pipe ends are still closed, so its
+    // neighbours see EOF/EPIPE.
+    for (size_t i = 0; i < numCommands; i++) {
+        const Command& command = cmd.pipeline[i];
+        bool isLast = i == numCommands - 1;
+        StageIo io;
+        int nextPipe[2] = {-1, -1};
+        bool failed = false;
+
+        // The first stage may redirect its input; a here-doc or here-string
+        // replaces the pipe on any stage, and the stage before sees EPIPE
+        if (command.hasInputText || (i == 0 && !command.inputFile.empty())) {
+            bool inputOk = true;
+            io.in = openStageInput(command, inputOk);
+            failed = !inputOk;
+            if (previousRead >= 0) {
+                close(previousRead);
+            }
+        } else {
+            io.in = previousRead;
+        }
+        previousRead = -1;
+
+        // Last command writes to its output redirection, the rest the next pipe
+        if (!isLast) {
+            if (!openPipe(nextPipe)) {
+                std::perror("ninxsh: pipe");
+                if (io.in >= 0) {
+                    close(io.in);
+                }
+                if (output >= 0) {
+                    close(output);
                 }
-                int jobId = jobManager->addJob(pid, jobCommand);
-                std::cout << "[" << jobId << "] " << pid << std::endl;
-            } else {
-                std::cout << "[1] " << pid << "\n";
+                // Stages already running see EOF/EPIPE and are waited for below
+                for (size_t j = i; j < numCommands; j++) {
+                    stages[j].status = EXIT_FAILURE;
+                }
+                break;
+            }
+            io.out = nextPipe[1];
+            sizePipe(io.out, pipeBuffers);
+        } else if (!command.outputFile.empty()) {
+            io.out = openRedirection(command.outputFile, true);
+            failed = failed || io.out < 0;
+            if (output >= 0) {
+                close(output);
             }
-            isShellForeground = true;
         } else {
-            isShellForeground = false;
-            int status;
-            waitpid(pid, &status, 0);
-            isShellForeground = true;
+            io.out = output;
         }
-        cleanupZombieProcesses();
-    }
-}
 
-void executePipeline(const ParsedCommand& cmd, JobManager* jobManager) {
-    int numCommands = cmd.pipeline.size();
-    std::vector<int> pipeFds((numCommands - 1) * 2);  // Each pipe has 2 file descriptors
+        // Process substitutions start first; the stage gets their /dev/fd paths
+        Command launched = command;
+        std::vector<char*> argv;
+        std::vector<std::string> paths;
+        std::vector<int> passedEnds;
+        if (!failed && !cmd.substitutions.empty()) {
+            argv.assign(command.args.begin(), command.args.end());
+            failed = !startSubstitutions(cmd, i, argv, paths, passedEnds);
+            launched.args = ArgList(argv.data(), argv.size() - 1);
+        }
 
-    // Create all the pipes needed
-    for (int i = 0; i < numCommands - 1; i++) {
-        if (pipe(&pipeFds[i * 2]) < 0) {
-            std::cerr << "ninxsh: failed to create pipe\n";
-            return;
+        // Read-only builtins in a foreground pipeline run on a helper thread
+        // in the shell instead of a forked copy of it. They don't read
+        // stdin; closing it below lets the previous stage see EPIPE.
+        const Builtin* builtin = findBuiltin(command.args[0]);
+        launchedAt[i] = Clock::now();
+        if (failed) {
+            stages[i].status = EXIT_FAILURE;
+        } else if (builtin && builtin->readOnly && inProcessBuiltins && passedEnds.empty()) {
+            int out = io.out;
+            if (out < 0) {
+                std::cout.flush();
+                out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+            }
+            io.out = -1;  // Now owned by the thread
+            pendingBuiltins.push_back({builtin, &command, out, i});
+        } else {
+            pids[i] = launchStage(launched, io, nextPipe[0], envp, builtin, builtins, cgroup,
+                                  stages[i].status);
         }
+
+        for (int end : passedEnds) {
+            close(end);
+        }
+        if (io.in >= 0) {
+            close(io.in);
+        }
+        if (io.out >= 0) {
+            close(io.out);
+        }
+        previousRead = nextPipe[0];
     }
 
-    std::vector<pid_t> pids(numCommands);
+    for (const PendingBuiltin& pending : pendingBuiltins) {
+        builtinThreads.emplace_back(runBuiltinStage, pending.builtin, std::cref(*pending.command),
+                                    builtins ? *builtins : BuiltinContext(), pending.out,
+                                    &stages[pending.stage]);
+    }
+}
 
-    // Fork and execute each command in the pipeline
-    for (int i = 0; i < numCommands; i++) {
-        pids[i] = fork();
+// Start the process substitutions of one stage, each on its own pipe, and
+// point their arguments in argv at /dev/fd/N for the stage's ends. The ends
+// are returned in ends, inheritable, for the caller to close once the stage
+// has started. Returns false if a pipe could not be made.
+bool PipelineLauncher::startSubstitutions(const ParsedCommand& cmd, size_t stage,
+                                          std::vector<char*>& argv,
+                                          std::vector<std::string>& paths,
+                                          std::vector<int>& ends) {
+    std::vector<size_t> args;
+    bool ok = true;
+    for (const ParsedCommand::Substitution& substitution : cmd.substitutions) {
+        if (substitution.stage != stage) {
+            continue;
+        }
+        int fds[2];
+        if (!openPipe(fds)) {
+            std::perror("ninxsh: process substitution");
+            ok = false;
+            break;
+        }
+        int stageEnd = substitution.isOutput ? fds[1] : fds[0];
+        int commandEnd = substitution.isOutput ? fds[0] : fds[1];
+        ends.push_back(stageEnd);
+        args.push_back(substitution.arg);
+        paths.push_back("/dev/fd/" + std::to_string(stageEnd));
+
+        // Its builtins are forked: nothing waits on a thread's report here
+        std::vector<pid_t> pids;
+        std::vector<StageReport> stages;
+        std::vector<Clock::time_point> launchedAt;
+        bool savedInProcess = inProcessBuiltins;
+        inProcessBuiltins = false;
+        start(*substitution.command, substitution.isOutput ? commandEnd : -1,
+              substitution.isOutput ? -1 : commandEnd, pids, stages, launchedAt);
+        inProcessBuiltins = savedInProcess;
+        for (pid_t pid : pids) {
+            if (pid > 0) {
+                helpers.push_back(pid);
+            }
+        }
+    }
 
-        if (pids[i] < 0) {
-            std::cerr << "ninxsh: fork failed\n";
-            return;
+    // Made inheritable only now, so no substitution command started above
+    // holds another's end open
+    for (size_t k = 0; k < ends.size(); ++k) {
+        fcntl(ends[k], F_SETFD, 0);
+        argv[args[k]] = &paths[k][0];
+    }
+    return ok;
+}
+
+// Reap every started stage (pids of -1 are skipped). With a pidfd per stage
+// each one is collected as soon as it exits, so a fast stage isn't billed
+// the wall time of a slower one before it; without pidfds (old kernels, out
+// of descriptors, other systems) the remaining stages are reaped in order.
+void waitForStages(const std::vector<pid_t>& pids, const StageReaped& reaped) {
+    std::vector<bool> done(pids.size(), false);
+    int waitStatus;
+    struct rusage usage;
+
+#ifdef SYS_pidfd_open
+    std::vector<struct pollfd> watched;
+    std::vector<size_t> watchedStages;
+    for (size_t i = 0; i < pids.size(); ++i) {
+        int fd = pids[i] > 0 ? static_cast<int>(syscall(SYS_pidfd_open, pids[i], 0)) : -1;
+        if (fd >= 0) {
+            watched.push_back({fd, POLLIN, 0});
+            watchedStages.push_back(i);
+        } else if (pids[i] > 0) {
+            break;
         }
+    }
 
-        if (pids[i] == 0) {
-            // Child process
-            //
-            // Setup input
-            if (i == 0) {
-                // First command: handle input redirection
-                if (!cmd.pipeline[i].inputFile.empty()) {
-                    int fd = open(cmd.pipeline[i].inputFile.c_str(), O_RDONLY);
-                    if (fd < 0) {
-                        std::perror("ninxsh: input redirection");
-                        exit(EXIT_FAILURE);
-                    }
-                    dup2(fd, STDIN_FILENO);
-                    close(fd);
-                }
-            } else {
-                // Not first command: read from previous pipe
-                dup2(pipeFds[(i - 1) * 2], STDIN_FILENO);
+    while (!watched.empty()) {
+        if (poll(watched.data(), watched.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-
-            // Setup output
-            if (i == numCommands - 1) {
-                // Last command: handle output redirection
-                if (!cmd.pipeline[i].outputFile.empty()) {
-                    int fd = open(cmd.pipeline[i].outputFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
-                                  0644);
-                    if (fd < 0) {
-                        std::perror("ninxsh: output redirection");
-                        exit(EXIT_FAILURE);
-                    }
-                    dup2(fd, STDOUT_FILENO);
-                    close(fd);
-                }
-            } else {
-                // Not last command: write to next pipe
-                dup2(pipeFds[i * 2 + 1], STDOUT_FILENO);
+            break;
+        }
+        for (size_t j = watched.size(); j-- > 0;) {
+            if (watched[j].revents == 0) {
+                continue;
             }
-            // Close all pipe file descriptors
-            for (int j = 0; j < (numCommands - 1) * 2; j++) {
-                close(pipeFds[j]);
+            size_t stage = watchedStages[j];
+            if (wait4(pids[stage], &waitStatus, 0, &usage) == pids[stage]) {
+                reaped(stage, waitStatus, usage);
             }
+            done[stage] = true;
+            close(watched[j].fd);
+            watched.erase(watched.begin() + j);
+            watchedStages.erase(watchedStages.begin() + j);
+        }
+    }
+    for (const struct pollfd& entry : watched) {
+        close(entry.fd);
+    }
+#endif
 
-            // Execute the command
-            execvp(cmd.pipeline[i].args[0], cmd.pipeline[i].args.data());
-            std::cerr << "ninxsh: command not found: " << cmd.pipeline[0].args[0] << "\n";
-            exit(EXIT_FAILURE);
+    for (size_t i = 0; i < pids.size(); ++i) {
+        if (pids[i] > 0 && !done[i] && wait4(pids[i], &waitStatus, 0, &usage) == pids[i]) {
+            reaped(i, waitStatus, usage);
         }
     }
+}
+
+// "name arg..." as typed, for job listings and reports
+std::string commandText(const Command& command) {
+    std::string text = command.args[0];
+    for (size_t i = 1; i < command.args.size() - 1; ++i) {  // Last element is nullptr
+        text += " ";
+        text += command.args[i];
+    }
+    return text;
+}
 
-    // Parent process
-    //
-    // Close all pipe file descriptors in the present
-    for (int i = 0; i < (numCommands - 1) * 2; i++) {
-        close(pipeFds[i]);
+double seconds(const struct timeval& time) {
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_usec) / 1e6;
+}
+
+// ru_maxrss as "812K", "3.4M" or "1.2G" (kilobytes on Linux, bytes on macOS)
+std::string formatRss(long maxRss) {
+#ifdef __APPLE__
+    double kilobytes = static_cast<double>(maxRss) / 1024;
+#else
+    double kilobytes = static_cast<double>(maxRss);
+#endif
+    char text[32];
+    if (kilobytes < 1024) {
+        std::snprintf(text, sizeof(text), "%.0fK", kilobytes);
+    } else if (kilobytes < 1024 * 1024) {
+        std::snprintf(text, sizeof(text), "%.1fM", kilobytes / 1024);
+    } else {
+        std::snprintf(text, sizeof(text), "%.1fG", kilobytes / (1024 * 1024));
     }
+    return text;
+}
+
+void printReportRow(std::ostream& out, double real, const struct rusage& usage, int status,
+                    const std::string& label) {
+    char row[128];
+    std::string switches = std::to_string(usage.ru_nvcsw) + "/" + std::to_string(usage.ru_nivcsw);
+    std::snprintf(row, sizeof(row), "%9.3fs %8.3fs %8.3fs %8s %11s %7d  ", real,
+                  seconds(usage.ru_utime), seconds(usage.ru_stime),
+                  formatRss(usage.ru_maxrss).c_str(), switches.c_str(), status);
+    out << row << label << '\n';
+}
+
+}  // namespace
+
+void setLaunchBackend(LaunchBackend backend) {
+    configuredBackend = backend;
+}
 
+LaunchBackend launchBackend() {
+    return configuredBackend;
+}
+
+int executeExternal(const ParsedCommand& cmd, JobManager* jobManager,
+                    const BuiltinContext* builtins, PipelineReport* report) {
+    // If there's more than one command in the pipeline, or anything to run
+    // alongside it, use the pipeline executor
+    if (cmd.pipeline.size() > 1 || !cmd.substitutions.empty()) {
+        return executePipeline(cmd, jobManager, builtins, report);
+    }
+
+    // Otherwise execute a single command (the first/only one in the pipeline)
+    const Command& command = cmd.pipeline[0];
+    PipelineReport localReport;
+    PipelineReport& result = report ? *report : localReport;
+    result = PipelineReport();
+    result.stages.resize(1);
+    StageReport& stage = result.stages[0];
+
+    StageIo io;
+    bool inputOk = true;
+    io.in = openStageInput(command, inputOk);
+    if (!inputOk) {
+        return stage.status = EXIT_FAILURE;
+    }
+    if (!command.outputFile.empty() && (io.out = openRedirection(command.outputFile, true)) < 0) {
+        if (io.in >= 0) {
+            close(io.in);
+        }
+        return stage.status = EXIT_FAILURE;
+    }
+
+    // A job with limits gets a cgroup of its own before it starts
+    const ResourceLimits& limits = resourceLimits();
+    JobCgroup cgroup;
+    cgroup.create(limits);
+
+    Clock::time_point start = Clock::now();
+    pid_t pid = launchStage(command, io, -1, environmentForExec(), nullptr, builtins,
+                            limits.empty() ? nullptr : &cgroup, stage.status);
+    if (io.in >= 0) {
+        close(io.in);
+    }
+    if (io.out >= 0) {
+        close(io.out);
+    }
+    if (pid < 0) {
+        return stage.status;
+    }
+
+    if (command.isBackground) {
+        // Add job to job manager if provided
+        if (jobManager) {
+            int jobId = jobManager->addJob(pid, commandText(command), limits, cgroup.detach());
+            std::cout << "[" << jobId << "] " << pid << std::endl;
+        } else {
+            std::cout << "[1] " << pid << "\n";
+        }
+        isShellForeground = true;
+    } else {
+        isShellForeground = false;
+        int status;
+        if (wait4(pid, &status, 0, &stage.usage) == pid) {
+            stage.status = exitStatusOf(status);
+        }
+        stage.realSeconds = result.realSeconds = secondsSince(start);
+        isShellForeground = true;
+    }
+    return stage.status;
+}
+
+int executePipeline(const ParsedCommand& cmd, JobManager* jobManager,
+                    const BuiltinContext* builtins, PipelineReport* report) {
+    int numCommands = cmd.pipeline.size();
     bool isBackground = cmd.pipeline[numCommands - 1].isBackground;
+    const PipeBufferPolicy& pipeBuffers = pipeBufferPolicy();
+
+    PipelineReport localReport;
+    PipelineReport& result = report ? *report : localReport;
+    result = PipelineReport();
+    std::vector<StageReport>& stages = result.stages;
+    std::vector<pid_t> pids;
+    std::vector<Clock::time_point> launchedAt;
+    Clock::time_point start = Clock::now();
+
+    const ResourceLimits& limits = resourceLimits();
+    JobCgroup cgroup;
+    cgroup.create(limits);
+
+    // Read-only builtins run in the shell only if it is going to wait for them
+    PipelineLauncher launcher(builtins, !isBackground, limits.empty() ? nullptr : &cgroup);
+    launcher.start(cmd, -1, -1, pids, stages, launchedAt);
 
     if (isBackground) {
+        // The job is tracked by its last stage that actually started
+        pid_t jobPid = -1;
+        for (int i = numCommands - 1; i >= 0 && jobPid < 0; --i) {
+            jobPid = pids[i];
+        }
+        if (jobPid < 0) {
+            return stages[numCommands - 1].status;
+        }
+
         // Add pipeline job to job manager if provided
         if (jobManager) {
             // Build command string for the entire pipeline
@@ -241,32 +871,64 @@ void executePipeline(const ParsedCommand& cmd, JobManager* jobManager) {
             for (int i = 0; i < numCommands; ++i) {
                 if (i > 0)
                     pipelineCommand += " | ";
-
-                pipelineCommand += cmd.pipeline[i].args[0];
-                for (size_t j = 1; j < cmd.pipeline[i].args.size() - 1;
-                     ++j) {  // -1 because last element is nullptr
-                    pipelineCommand += " " + std::string(cmd.pipeline[i].args[j]);
-                }
+                pipelineCommand += commandText(cmd.pipeline[i]);
             }
-            int jobId = jobManager->addJob(pids[numCommands - 1], pipelineCommand);
-            std::cout << "[" << jobId << "] " << pids[numCommands - 1] << std::endl;
+            int jobId = jobManager->addJob(jobPid, pipelineCommand, limits, cgroup.detach());
+            std::cout << "[" << jobId << "] " << jobPid << std::endl;
         } else {
-            std::cout << "[1] " << pids[numCommands - 1] << "\n";
+            std::cout << "[1] " << jobPid << "\n";
         }
         isShellForeground = true;
-    } else {
-        isShellForeground = false;
-        // Wait for all the child processes to complete
-        for (int i = 0; i < numCommands; i++) {
-            int status;
-            waitpid(pids[i], &status, 0);
+        return 0;
+    }
+
+    isShellForeground = false;
+    for (std::thread& thread : launcher.builtinThreads) {
+        thread.join();
+    }
+
+    // Wait for all the child processes to complete; the last one decides $?.
+    // Process substitutions are reaped along with the stages but have no
+    // status of their own.
+    pids.insert(pids.end(), launcher.helpers.begin(), launcher.helpers.end());
+    StageReaped reaped = [&](size_t i, int waitStatus, const struct rusage& usage) {
+        if (i >= stages.size()) {
+            return;
         }
-        isShellForeground = true;
+        stages[i].status = exitStatusOf(waitStatus);
+        stages[i].usage = usage;
+        stages[i].realSeconds = secondsSince(launchedAt[i]);
+    };
+    if (pipeBuffers.mode == PipeBufferPolicy::Mode::Auto) {
+        std::vector<int> waitStatuses;
+        waitAdaptively(pids, waitStatuses, reaped);
+    } else {
+        waitForStages(pids, reaped);
     }
+    result.realSeconds = secondsSince(start);
+    isShellForeground = true;
 
-    cleanupZombieProcesses();
+    return stages[numCommands - 1].status;
 }
 
-void setGlobalJobManager(JobManager* jobManager) {
-    globalJobManager = jobManager;
+void printPipelineReport(const ParsedCommand& cmd, const PipelineReport& report,
+                         std::ostream& out) {
+    out << "      real      user       sys   maxrss     vcs/ivcs  status  command\n";
+
+    struct rusage total = {};
+    for (size_t i = 0; i < report.stages.size() && i < cmd.pipeline.size(); ++i) {
+        const StageReport& stage = report.stages[i];
+        printReportRow(out, stage.realSeconds, stage.usage, stage.status,
+                       commandText(cmd.pipeline[i]));
+
+        timeradd(&total.ru_utime, &stage.usage.ru_utime, &total.ru_utime);
+        timeradd(&total.ru_stime, &stage.usage.ru_stime, &total.ru_stime);
+        total.ru_maxrss = std::max(total.ru_maxrss, stage.usage.ru_maxrss);
+        total.ru_nvcsw += stage.usage.ru_nvcsw;
+        total.ru_nivcsw += stage.usage.ru_nivcsw;
+    }
+
+    if (report.stages.size() > 1) {
+        printReportRow(out, report.realSeconds, total, report.stages.back().status, "total");
+    }
 }
@@ -0,0 +1,50 @@
+#include "fd_stream.hpp"
+
+#include <cerrno>
+#include <unistd.h>
+
+FdStreamBuf::FdStreamBuf(int fd) : fd(fd) {
+    setp(buffer, buffer + BUFFER_SIZE);
+}
+
+FdStreamBuf::~FdStreamBuf() {
+    flushBuffer();
+}
+
+bool FdStreamBuf::flushBuffer() {
+    const char* data = pbase();
+    size_t remaining = static_cast<size_t>(pptr() - pbase());
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            setp(buffer, buffer + BUFFER_SIZE);
+            return false;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    setp(buffer, buffer + BUFFER_SIZE);
+    return true;
+}
+
+FdStreamBuf::int_type FdStreamBuf::overflow(int_type c) {
+    if (!flushBuffer()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int FdStreamBuf::sync() {
+    return flushBuffer() ? 0 : -1;
+}
+
+FdOutputStream::FdOutputStream(int fd) : std::ostream(nullptr), streamBuf(fd) {
+    rdbuf(&streamBuf);
+}
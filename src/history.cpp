@@ -1,13 +1,103 @@
 #include "history.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "environment.hpp"
+#include "utils.hpp"
+
+namespace {
+
+// How the history file is kept open: appends always land at the end
+const int APPEND_FLAGS = O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC;
+
+// Everything in the file behind fd
+std::string readFile(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return "";
+    }
+    std::string text(static_cast<size_t>(info.st_size), '\0');
+    size_t length = 0;
+    while (length < text.size()) {
+        ssize_t count = pread(fd, &text[length], text.size() - length, static_cast<off_t>(length));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        length += static_cast<size_t>(count);
+    }
+    text.resize(length);
+    return text;
+}
+
+// The non-empty lines of text, pointing into it
+std::vector<std::string_view> splitLines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        if (end > start) {
+            lines.push_back(text.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return lines;
+}
+
+// A command as one line of the file: a multi-line command (open quote,
+// trailing backslash) has its newlines written as \n, and backslashes are
+// doubled so that stays unambiguous
+std::string escapeCommand(std::string_view command) {
+    std::string line;
+    line.reserve(command.size() + 1);
+    for (char c : command) {
+        if (c == '\\') {
+            line += "\\\\";
+        } else if (c == '\n') {
+            line += "\\n";
+        } else {
+            line += c;
+        }
+    }
+    line += '\n';
+    return line;
+}
+
+// The command a line of the file holds. A backslash before anything but n or
+// another backslash is kept as it is.
+std::string unescapeCommand(std::string_view line) {
+    std::string command;
+    command.reserve(line.size());
+    for (size_t i = 0; i < line.size(); ++i) {
+        bool escaped = line[i] == '\\' && i + 1 < line.size() &&
+                       (line[i + 1] == 'n' || line[i + 1] == '\\');
+        if (escaped) {
+            command += line[++i] == 'n' ? '\n' : '\\';
+        } else {
+            command += line[i];
+        }
+    }
+    return command;
+}
+
+}  // namespace
+
 History::History(size_t size) : maxSize(size) {
     // By default, set the history file path to ~/.ninxsh_history
-    const char* homeDir = getenv("HOME");
+    const char* homeDir = lookupEnv("HOME");
     if (homeDir) {
         historyFilePath = std::string(homeDir) + "/.ninxsh_history";
     }
@@ -16,69 +106,239 @@ History::History(size_t size) : maxSize(size) {
 History::History(const std::string& filePath, size_t size)
     : historyFilePath(filePath), maxSize(size) {}
 
+History::~History() {
+    if (fileFd >= 0) {
+        close(fileFd);
+    }
+}
+
 void History::addCommand(const std::string& command) {
     // Don't add empty commands or duplicates of the last command
-    if (command.empty() || (!commands.empty() && commands.back() == command)) {
+    if (command.empty() || (count > 0 && at(count - 1) == command)) {
         return;
     }
+    append(command);
 
-    commands.push_back(command);
-    truncateIfNeeded();
+    // One O_APPEND write per command, so exit has nothing left to save
+    if (lockFile()) {
+        writeAll(fileFd, escapeCommand(command));
+        unlockFile();
+        if (++fileLines > 2 * maxSize) {
+            compact();
+        }
+    }
 }
 
-const std::vector<std::string>& History::getCommands() const {
-    return commands;
+HistoryView History::getCommands() const {
+    return HistoryView(*this);
 }
 
 std::string History::getCommand(size_t index) const {
-    if (index < commands.size()) {
-        return commands[index];
+    if (index < count) {
+        return std::string(at(index));
     }
     return "";
 }
 
+std::string_view History::at(size_t index) const {
+    size_t slot = head + index;
+    if (slot >= ring.size()) {
+        slot -= ring.size();
+    }
+    const Entry& entry = ring[slot];
+    return std::string_view(chunks[entry.chunk - firstChunk].data.get() + entry.offset,
+                            entry.length);
+}
+
 size_t History::size() const {
-    return commands.size();
+    return count;
+}
+
+size_t History::chunkCount() const {
+    return chunks.size();
+}
+
+void History::append(std::string_view command) {
+    if (maxSize == 0) {
+        return;
+    }
+    if (count == maxSize) {
+        expireOldest();
+    }
+
+    if (chunks.empty() || chunks.back().capacity - chunks.back().used < command.size()) {
+        Chunk chunk;
+        chunk.capacity = std::max(CHUNK_SIZE, command.size());
+        chunk.data.reset(new char[chunk.capacity]);
+        chunks.push_back(std::move(chunk));
+    }
+    Chunk& chunk = chunks.back();
+    std::memcpy(chunk.data.get() + chunk.used, command.data(), command.size());
+    Entry entry = {static_cast<uint32_t>(firstChunk + chunks.size() - 1),
+                   static_cast<uint32_t>(chunk.used), static_cast<uint32_t>(command.size())};
+    chunk.used += command.size();
+    ++chunk.live;
+
+    // Until the ring first fills, the oldest command is in slot 0
+    if (ring.size() < maxSize) {
+        ring.push_back(entry);
+    } else {
+        size_t slot = head + count;
+        ring[slot >= ring.size() ? slot - ring.size() : slot] = entry;
+    }
+    ++count;
+}
+
+void History::expireOldest() {
+    --chunks[ring[head].chunk - firstChunk].live;
+    head = head + 1 == ring.size() ? 0 : head + 1;
+    --count;
+
+    // Chunks drain front to back; the one still being filled is kept
+    while (chunks.size() > 1 && chunks.front().live == 0) {
+        chunks.pop_front();
+        ++firstChunk;
+    }
+    if (chunks.size() == 1 && chunks.front().live == 0) {
+        chunks.front().used = 0;
+    }
+}
+
+void History::clear() {
+    chunks.clear();
+    ring.clear();
+    head = 0;
+    count = 0;
 }
 
 bool History::loadFromFile() {
     if (historyFilePath.empty()) {
         return false;
     }
-
-    std::ifstream file(historyFilePath);
-    if (!file.is_open()) {
-        return false;
+    if (fileFd < 0) {
+        fileFd = open(historyFilePath.c_str(), APPEND_FLAGS, 0600);
     }
 
-    commands.clear();
-    std::string line;
-    while (std::getline(file, line)) {
-        if (!line.empty()) {
-            commands.push_back(line);
+    std::string text;
+    if (fileFd >= 0) {
+        if (!lockFile()) {
+            return false;
         }
+        text = readFile(fileFd);
+        unlockFile();
+    } else {
+        // A file we can read but not write (or a read-only $HOME) still
+        // loads; this session's commands just stay in memory
+        int readOnly = open(historyFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (readOnly < 0) {
+            return false;
+        }
+        flock(readOnly, LOCK_SH);
+        text = readFile(readOnly);
+        close(readOnly);
     }
 
-    file.close();
-    truncateIfNeeded();
+    clear();
+    fileLines = 0;
+    for (std::string_view line : splitLines(text)) {
+        append(unescapeCommand(line));
+        ++fileLines;
+    }
+    if (fileFd >= 0 && fileLines > 2 * maxSize) {
+        compact();
+    }
     return true;
 }
 
-bool History::saveToFile() const {
+bool History::saveToFile() {
     if (historyFilePath.empty()) {
         return false;
     }
+    if (fileFd < 0) {
+        fileFd = open(historyFilePath.c_str(), APPEND_FLAGS, 0600);
+    }
+    if (!lockFile()) {
+        return false;
+    }
+    std::string text;
+    for (std::string_view command : getCommands()) {
+        text += escapeCommand(command);
+    }
+    bool saved = replaceFile(text, count);
+    unlockFile();
+    return saved;
+}
 
-    std::ofstream file(historyFilePath);
-    if (!file.is_open()) {
+bool History::compact() {
+    if (!lockFile()) {
         return false;
     }
+    std::string text = readFile(fileFd);
+    std::vector<std::string_view> lines = splitLines(text);
+    size_t first = lines.size() > maxSize ? lines.size() - maxSize : 0;
+    std::string kept;
+    for (size_t i = first; i < lines.size(); ++i) {
+        kept.append(lines[i].data(), lines[i].size());
+        kept += '\n';
+    }
+    bool compacted = replaceFile(kept, lines.size() - first);
+    unlockFile();
+    return compacted;
+}
+
+bool History::lockFile() {
+    while (fileFd >= 0) {
+        if (flock(fileFd, LOCK_EX) != 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        // Still the file at the path, unless another shell compacted it
+        // (renamed a new one over it) while we waited for the lock
+        struct stat opened;
+        struct stat current;
+        if (fstat(fileFd, &opened) == 0 && stat(historyFilePath.c_str(), &current) == 0 &&
+            opened.st_dev == current.st_dev && opened.st_ino == current.st_ino) {
+            return true;
+        }
+        close(fileFd);
+        fileFd = open(historyFilePath.c_str(), APPEND_FLAGS, 0600);
+        fileLines = maxSize;  // What a compaction leaves, at most
+    }
+    return false;
+}
 
-    for (const auto& cmd : commands) {
-        file << cmd << '\n';
+void History::unlockFile() {
+    flock(fileFd, LOCK_UN);
+}
+
+bool History::replaceFile(std::string_view text, size_t lines) {
+    // Written and synced beside the file, then renamed over it, so readers
+    // and a crash see either the old file or the whole new one
+    std::string tempPath = historyFilePath + ".XXXXXX";
+    int fd = mkstemp(&tempPath[0]);
+    if (fd < 0) {
+        return false;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    bool written = fchmod(fd, 0600) == 0 && writeAll(fd, text) && fsync(fd) == 0;
+    close(fd);
+    if (!written || rename(tempPath.c_str(), historyFilePath.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
     }
 
-    file.close();
+    // Carry on with the new file. Closing the old one drops our lock on it,
+    // and shells waiting for that lock will find the file replaced.
+    int newFd = open(historyFilePath.c_str(), APPEND_FLAGS, 0600);
+    if (newFd >= 0) {
+        flock(newFd, LOCK_EX);
+    }
+    close(fileFd);
+    fileFd = newFd;
+    fileLines = lines;
     return true;
 }
 
@@ -90,9 +350,30 @@ std::string History::getHistoryFilePath() const {
     return historyFilePath;
 }
 
-void History::truncateIfNeeded() {
-    if (commands.size() > maxSize) {
-        // Remove oldest commands to maintain the max size
-        commands.erase(commands.begin(), commands.begin() + (commands.size() - maxSize));
-    }
+size_t HistoryView::size() const {
+    return history->size();
+}
+
+bool HistoryView::empty() const {
+    return history->size() == 0;
+}
+
+std::string_view HistoryView::operator[](size_t index) const {
+    return history->at(index);
+}
+
+std::string_view HistoryView::back() const {
+    return history->at(history->size() - 1);
+}
+
+HistoryView::iterator HistoryView::begin() const {
+    return iterator(history, 0);
+}
+
+HistoryView::iterator HistoryView::end() const {
+    return iterator(history, history->size());
+}
+
+std::string_view HistoryView::iterator::operator*() const {
+    return history->at(index);
 }
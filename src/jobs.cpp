@@ -1,19 +1,27 @@
 #include "jobs.hpp"
 
-#include <algorithm>
 #include <iostream>
-#include <sys/wait.h>
+#include <iterator>
 
-int JobManager::addJob(pid_t pid, const std::string& command) {
+int JobManager::addJob(pid_t pid, const std::string& command, const ResourceLimits& limits,
+                       const std::string& cgroup) {
     int jobId = nextJobId++;
     jobs.emplace_back(jobId, pid, command);
+    jobs.back().limits = limits;
+    jobs.back().cgroup = cgroup;
+    pidIndex[pid] = std::prev(jobs.end());
     return jobId;
 }
 
 void JobManager::removeJob(pid_t pid) {
-    jobs.erase(
-        std::remove_if(jobs.begin(), jobs.end(), [pid](const Job& job) { return job.pid == pid; }),
-        jobs.end());
+    auto it = pidIndex.find(pid);
+    if (it == pidIndex.end()) {
+        return;
+    }
+
+    releaseCgroup(it->second->cgroup);
+    jobs.erase(it->second);
+    pidIndex.erase(it);
 }
 
 void JobManager::updateJobStatus(pid_t pid, bool isRunning, bool isStopped) {
@@ -25,12 +33,8 @@ void JobManager::updateJobStatus(pid_t pid, bool isRunning, bool isStopped) {
 }
 
 Job* JobManager::findJobByPid(pid_t pid) {
-    for (auto& job : jobs) {
-        if (job.pid == pid) {
-            return &job;
-        }
-    }
-    return nullptr;
+    auto it = pidIndex.find(pid);
+    return it == pidIndex.end() ? nullptr : &*it->second;
 }
 
 Job* JobManager::findJobById(int jobId) {
@@ -42,23 +46,19 @@ Job* JobManager::findJobById(int jobId) {
     return nullptr;
 }
 
-void JobManager::cleanupJobs() {
-    int status;
-    pid_t pid;
-
-    // Check for finished jobs without blocking
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        Job* job = findJobByPid(pid);
-        if (job) {
-            if (WIFEXITED(status) || WIFSIGNALED(status)) {
-                // Job finished, remove it
-                removeJob(pid);
-            }
-        }
+bool JobManager::completeJob(pid_t pid, Job& finished) {
+    Job* job = findJobByPid(pid);
+    if (!job) {
+        return false;
     }
+    finished = *job;
+    finished.isRunning = false;
+    finished.isStopped = false;
+    removeJob(pid);
+    return true;
 }
 
-void JobManager::printJobs() const {
+void JobManager::printJobs(std::ostream& out) const {
     if (jobs.empty()) {
         return;
     }
@@ -73,7 +73,13 @@ void JobManager::printJobs() const {
             status = "Done";
         }
 
-        std::cout << "[" << job.jobId << "]  " << status << "                 " << job.command
-                  << std::endl;
+        out << "[" << job.jobId << "]  " << status << "                 " << job.command
+            << '\n';
+        if (!job.limits.empty()) {
+            out << "      ";
+            printCgroupUsage(job.cgroup, job.limits, out);
+            out << '\n';
+        }
     }
+    out.flush();  // One write for the whole list when out is a pipe
 }
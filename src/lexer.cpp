@@ -0,0 +1,380 @@
+#include "lexer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define NINXSH_LEXER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Bytes that end a run of plain word characters. Everything else is copied
+// (or spanned) in bulk without looking at it twice.
+constexpr char kSpecialBytes[] = {' ', '\t', '"', '\'', '\\', '|', '<', '>'};
+
+constexpr std::array<bool, 256> makeSpecialTable() {
+    std::array<bool, 256> table{};
+    for (char c : kSpecialBytes) {
+        table[static_cast<unsigned char>(c)] = true;
+    }
+    return table;
+}
+
+constexpr std::array<bool, 256> kSpecial = makeSpecialTable();
+
+size_t scanScalar(const char* data, size_t pos, size_t size) {
+    while (pos < size && !kSpecial[static_cast<unsigned char>(data[pos])]) {
+        ++pos;
+    }
+    return pos;
+}
+
+#ifdef NINXSH_LEXER_X86
+
+// Classify 16 bytes per step: one compare per special byte, OR-ed together,
+// then the first set bit of the movemask is the next interesting byte
+__attribute__((target("sse2"))) size_t scanSse2(const char* data, size_t pos, size_t size) {
+    while (pos + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i hits = _mm_setzero_si128();
+        for (char c : kSpecialBytes) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)));
+        }
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return scanScalar(data, pos, size);
+}
+
+__attribute__((target("avx2"))) size_t scanAvx2(const char* data, size_t pos, size_t size) {
+    while (pos + 32 <= size) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i hits = _mm256_setzero_si256();
+        for (char c : kSpecialBytes) {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(c)));
+        }
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    return scanSse2(data, pos, size);
+}
+
+#endif  // NINXSH_LEXER_X86
+
+struct Scanner {
+    size_t (*scan)(const char*, size_t, size_t);
+    const char* name;
+};
+
+Scanner selectScanner() {
+#ifdef NINXSH_LEXER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {scanAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {scanSse2, "sse2"};
+    }
+#endif
+    return {scanScalar, "scalar"};
+}
+
+// Chosen once on first use; function-local statics are thread-safe to initialize
+const Scanner& scanner() {
+    static const Scanner selected = selectScanner();
+    return selected;
+}
+
+size_t scanPlain(std::string_view input, size_t pos) {
+    return scanner().scan(input.data(), pos, input.size());
+}
+
+class Lexer {
+public:
+    Lexer(TokenStream& out, LexerState& state) : out(out), state(state), word(state.word) {}
+
+    // Lex from state.position to the end of the source. Stops early, with
+    // pendingEscape set, if the source ends in a backslash that the next
+    // line may turn into a line continuation.
+    void run() {
+        const std::string_view input = out.source;
+        size_t i = state.position;
+
+        state.pendingEscape = false;  // Resuming at that backslash: it is looked at again
+
+        while (i < input.size()) {
+            size_t plainEnd = scanPlain(input, i);
+            if (plainEnd > i) {
+                startWord();
+                appendContent(i, plainEnd);
+                i = plainEnd;
+                continue;
+            }
+
+            char c = input[i];
+
+            if (state.inSingleQuotes) {
+                // Only the closing quote is special inside single quotes
+                if (c == '\'') {
+                    state.inSingleQuotes = false;
+                } else {
+                    appendContent(i, i + 1);
+                }
+                ++i;
+                continue;
+            }
+
+            if (c == '\\') {
+                if (i + 1 >= input.size()) {
+                    // Can't tell yet whether this escapes a newline; wait for more
+                    state.pendingEscape = true;
+                    break;
+                }
+                if (input[i + 1] == '\n') {
+                    // Line continuation: both bytes vanish, the word (if any) goes on
+                    i += 2;
+                    continue;
+                }
+                // Escape next character
+                startWord();
+                state.literal = true;
+                appendContent(i + 1, i + 2);
+                i += 2;
+                continue;
+            }
+
+            if (state.inDoubleQuotes) {
+                if (c == '"') {
+                    state.inDoubleQuotes = false;
+                } else {
+                    appendContent(i, i + 1);
+                }
+                ++i;
+                continue;
+            }
+
+            switch (c) {
+                case '"':
+                    startWord();
+                    word.fromDoubleQuotes = true;
+                    state.literal = true;
+                    state.inDoubleQuotes = true;
+                    break;
+                case '\'':
+                    startWord();
+                    word.fromSingleQuotes = true;
+                    state.literal = true;
+                    state.inSingleQuotes = true;
+                    break;
+                case '|':
+                    endWord();
+                    emitOperator(TokenKind::Pipe, i);
+                    break;
+                case '<':
+                    endWord();
+                    if (input.compare(i, 2, "<(") == 0) {
+                        i = emitSubstitution(TokenKind::ProcessSubIn, i);
+                    } else if (input.compare(i, 3, "<<<") == 0) {
+                        emitOperator(TokenKind::HereString, i, 3);
+                        i += 2;
+                    } else if (input.compare(i, 3, "<<-") == 0) {
+                        emitOperator(TokenKind::HereDoc, i, 3);
+                        i += 2;
+                    } else if (input.compare(i, 2, "<<") == 0) {
+                        emitOperator(TokenKind::HereDoc, i, 2);
+                        ++i;
+                    } else {
+                        emitOperator(TokenKind::RedirectIn, i);
+                    }
+                    break;
+                case '>':
+                    endWord();
+                    if (input.compare(i, 2, ">(") == 0) {
+                        i = emitSubstitution(TokenKind::ProcessSubOut, i);
+                    } else {
+                        emitOperator(TokenKind::RedirectOut, i);
+                    }
+                    break;
+                default:
+                    // Whitespace outside quotes
+                    endWord();
+                    break;
+            }
+            ++i;
+        }
+
+        state.position = std::min(i, input.size());
+    }
+
+    // No more input is coming: close the last word. An open quote ends the
+    // word as if closed; a trailing backslash is dropped.
+    void finish() {
+        out.isIncomplete = state.needsMore();
+        if (state.pendingEscape) {
+            state.pendingEscape = false;
+            state.position = out.source.size();
+        }
+        endWord();
+        state.inSingleQuotes = false;
+        state.inDoubleQuotes = false;
+    }
+
+private:
+    void startWord() {
+        if (!state.inWord) {
+            state.inWord = true;
+            state.literal = false;
+            word = Token();
+        }
+    }
+
+    // Add source bytes [begin, end) to the current word, extending the span in
+    // place when they follow on directly and rewriting into scratch otherwise
+    void appendContent(size_t begin, size_t end) {
+        if (!word.rewritten) {
+            if (word.length == 0) {
+                word.offset = begin;
+                word.length = end - begin;
+                return;
+            }
+            if (begin == word.offset + word.length) {
+                word.length += end - begin;
+                return;
+            }
+
+            // A quote or escape left a gap: move the word into scratch
+            if (out.scratch.capacity() < out.source.size()) {
+                out.scratch.reserve(out.source.size());
+            }
+            size_t scratchOffset = out.scratch.size();
+            out.scratch.append(out.source.data() + word.offset, word.length);
+            word.offset = scratchOffset;
+            word.rewritten = true;
+        }
+
+        out.scratch.append(out.source.data() + begin, end - begin);
+        word.length += end - begin;
+    }
+
+    void endWord() {
+        if (!state.inWord) {
+            return;
+        }
+        if (!state.literal && word.length == 1 && !word.rewritten &&
+            out.source[word.offset] == '&') {
+            word.kind = TokenKind::Background;
+        }
+        out.tokens.push_back(word);
+        state.inWord = false;
+    }
+
+    void emitOperator(TokenKind kind, size_t pos, size_t length = 1) {
+        Token token;
+        token.kind = kind;
+        token.offset = pos;
+        token.length = length;
+        out.tokens.push_back(token);
+    }
+
+    // Emit a <( or >( substitution starting at pos, spanning the command up
+    // to the matching ')' (quotes and nested parentheses skipped), and return
+    // the position of that ')'. Unmatched, the span runs to the end of the
+    // source and no ')' follows it, which the parser reports.
+    size_t emitSubstitution(TokenKind kind, size_t pos) {
+        const std::string_view input = out.source;
+        size_t begin = pos + 2;
+        size_t depth = 1;
+        char quote = 0;
+        size_t i = begin;
+        for (; i < input.size(); ++i) {
+            char c = input[i];
+            if (quote) {
+                if (c == '\\' && quote == '"' && i + 1 < input.size()) {
+                    ++i;
+                } else if (c == quote) {
+                    quote = 0;
+                }
+            } else if (c == '\\' && i + 1 < input.size()) {
+                ++i;
+            } else if (c == '\'' || c == '"') {
+                quote = c;
+            } else if (c == '(') {
+                ++depth;
+            } else if (c == ')' && --depth == 0) {
+                break;
+            }
+        }
+        emitOperator(kind, begin, std::min(i, input.size()) - begin);
+        return i;
+    }
+
+    TokenStream& out;
+    LexerState& state;
+    Token& word;  // The word being built lives in the state so it survives a pause
+};
+
+}  // namespace
+
+TokenStream lexCommandLine(std::string_view input) {
+    TokenStream stream;
+    stream.source = input;
+    LexerState state;
+    Lexer lexer(stream, state);
+    lexer.run();
+    lexer.finish();
+    return stream;
+}
+
+void IncrementalLexer::feedLine(std::string_view line) {
+    if (started) {
+        buffer += '\n';
+    }
+    started = true;
+    buffer.append(line.data(), line.size());
+
+    // The buffer may have moved; tokens are offsets, so only the view changes
+    stream.source = buffer;
+    Lexer(stream, state).run();
+}
+
+bool IncrementalLexer::needsMore() const {
+    return state.needsMore();
+}
+
+const LexerState& IncrementalLexer::currentState() const {
+    return state;
+}
+
+const std::string& IncrementalLexer::text() const {
+    return buffer;
+}
+
+TokenStream IncrementalLexer::finish() {
+    stream.source = buffer;
+    Lexer(stream, state).finish();
+    return std::move(stream);
+}
+
+size_t findWordBreak(std::string_view input, size_t pos) {
+    return scanPlain(input, pos);
+}
+
+size_t findWordBreakScalar(std::string_view input, size_t pos) {
+    return scanScalar(input.data(), pos, input.size());
+}
+
+const char* wordBreakScannerName() {
+    return scanner().name;
+}
@@ -0,0 +1,51 @@
+#include "line_reader.hpp"
+
+#include <istream>
+#include <string>
+
+LineReader::LineReader(std::istream& in, size_t budget, size_t chunkSize)
+    : in(in), maxBytes(budget), chunkSize(chunkSize < 2 ? 2 : chunkSize) {}
+
+LineReader::Status LineReader::read(std::string& line) {
+    line.clear();
+    bool tooLong = false;
+    bool readAnything = false;
+
+    while (true) {
+        // Read straight into the line's own buffer; no intermediate copy
+        size_t used = line.size();
+        line.resize(used + chunkSize);
+        in.getline(&line[used], static_cast<std::streamsize>(chunkSize));
+
+        size_t extracted = static_cast<size_t>(in.gcount());
+        bool chunkFull = in.fail() && !in.eof() && extracted == chunkSize - 1;
+        bool sawNewline = !in.fail() && !in.eof();
+        size_t stored = sawNewline ? extracted - 1 : extracted;
+
+        line.resize(used + stored);
+        readAnything = readAnything || extracted > 0;
+
+        if (line.size() > maxBytes) {
+            // Keep draining the line but stop holding on to it
+            tooLong = true;
+            line.clear();
+        }
+
+        if (chunkFull) {
+            in.clear();  // getline sets failbit when the chunk fills up; carry on
+            continue;
+        }
+        break;
+    }
+
+    if (tooLong) {
+        line.clear();
+        line.shrink_to_fit();  // Don't keep a budget-sized buffer around after a rejected line
+        return Status::TooLong;
+    }
+    return readAnything ? Status::Ok : Status::Eof;
+}
+
+size_t LineReader::budget() const {
+    return maxBytes;
+}
@@ -0,0 +1,91 @@
+#include "lint.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "script.hpp"
+
+namespace {
+
+struct FileReport {
+    std::vector<LintError> errors;
+    std::string readError;  // Set if the file could not be opened or mapped
+};
+
+FileReport lintFile(const std::string& path) {
+    FileReport report;
+    MappedFile file(path);
+    if (!file.error.empty()) {
+        report.readError = file.error;
+        return report;
+    }
+    report.errors = lintBuffer(file.text());
+    return report;
+}
+
+}  // namespace
+
+std::vector<LintError> lintBuffer(std::string_view text) {
+    // Commands are split out as the shell reads them (continuation lines and
+    // here-document bodies belong to the command that opens them); errors
+    // refer to the command's first line
+    std::vector<LintError> errors;
+    ScriptSplitter splitter(text, false);
+    ScriptCommand command;
+    while (splitter.next(command)) {
+        if (!command.error.empty()) {
+            errors.push_back({command.line, command.error});
+        } else if (!command.unterminatedHereDoc.empty()) {
+            errors.push_back({command.line, "here-document delimited by end of file (wanted '" +
+                                                command.unterminatedHereDoc + "')"});
+        }
+    }
+    return errors;
+}
+
+int lintFiles(const std::vector<std::string>& files, std::ostream& out, unsigned workers) {
+    std::vector<FileReport> reports(files.size());
+
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers = static_cast<unsigned>(std::min<size_t>(workers, files.size()));
+
+    // Workers pull the next unclaimed file, so one huge script doesn't hold
+    // up a whole pre-assigned batch; each report slot has a single writer
+    std::atomic<size_t> nextFile(0);
+    auto work = [&]() {
+        for (size_t i = nextFile++; i < files.size(); i = nextFile++) {
+            reports[i] = lintFile(files[i]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    for (unsigned i = 0; i < workers; ++i) {
+        pool.emplace_back(work);
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const FileReport& report = reports[i];
+        if (!report.readError.empty()) {
+            out << "ninxsh: " << files[i] << ": " << report.readError << '\n';
+            status = 2;
+            continue;
+        }
+        for (const LintError& error : report.errors) {
+            out << files[i] << ":" << error.line << ": " << error.message << '\n';
+            status = std::max(status, 1);
+        }
+    }
+    return status;
+}
@@ -1,6 +1,60 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "lint.hpp"
+#include "mapped_file.hpp"
 #include "shell.hpp"
+#include "startup_stats.hpp"
+
+int main(int argc, char* argv[]) {
+    // ninxsh --startup-stats [args]: report where startup time goes on stderr
+    if (argc > 1 && std::strcmp(argv[1], "--startup-stats") == 0) {
+        enableStartupStats();
+        argv[1] = argv[0];
+        ++argv;
+        --argc;
+    }
+
+    // ninxsh -n file... / --check file...: syntax-check scripts, run nothing
+    if (argc > 1 && (std::strcmp(argv[1], "-n") == 0 || std::strcmp(argv[1], "--check") == 0)) {
+        if (argc < 3) {
+            std::cerr << "Usage: ninxsh " << argv[1] << " file...\n";
+            return 2;
+        }
+        std::vector<std::string> files(argv + 2, argv + argc);
+        return lintFiles(files, std::cerr);
+    }
+
+    // ninxsh -c 'commands': run them and exit with the last one's status.
+    // Positional parameters ($1, $@) are not supported, so arguments after
+    // the commands or script are refused rather than silently dropped.
+    if (argc > 1 && std::strcmp(argv[1], "-c") == 0) {
+        if (argc != 3) {
+            std::cerr << "Usage: ninxsh -c commands (script arguments are not supported)\n";
+            return 2;
+        }
+        Shell shell;
+        return shell.runScript(argv[2], "-c");
+    }
+
+    // ninxsh script: the file is mapped, not read line by line
+    if (argc > 2) {
+        std::cerr << "Usage: ninxsh script (script arguments are not supported)\n";
+        return 2;
+    }
+    if (argc > 1) {
+        MappedFile script(argv[1]);
+        if (!script.error.empty()) {
+            std::cerr << "ninxsh: " << argv[1] << ": " << script.error << '\n';
+            return 127;
+        }
+        startupPhase("map script");
+        Shell shell;
+        return shell.runScript(script.text(), argv[1]);
+    }
 
-int main() {
     Shell shell;
     shell.run();
     return 0;
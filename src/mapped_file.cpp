@@ -0,0 +1,40 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = std::strerror(errno);
+    } else if (!S_ISREG(info.st_mode)) {
+        error = "not a regular file";
+    } else if (info.st_size > 0) {
+        size = static_cast<size_t>(info.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            error = std::strerror(errno);
+            size = 0;
+        } else {
+            data = static_cast<const char*>(mapped);
+            madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);  // The mapping stays valid without the descriptor
+}
+
+MappedFile::~MappedFile() {
+    if (data) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
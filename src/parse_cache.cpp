@@ -0,0 +1,58 @@
+#include "parse_cache.hpp"
+
+#include "limits.hpp"
+
+ParseCache::ParseCache(size_t size) : maxEntries(size) {}
+
+ParsedCommand ParseCache::parse(const std::string& line, const ExpansionContext& context) {
+    auto it = index.find(line);
+    if (it != index.end()) {
+        ++hitCount;
+        // Move to the front; list splicing keeps the entry (and its line) in place
+        entries.splice(entries.begin(), entries, it->second);
+        return expandTemplate(it->second->tmpl, context);
+    }
+
+    ++missCount;
+
+    // Long generated lines are rarely repeated and would dominate memory
+    if (maxEntries == 0 || line.length() > ninxsh::limits::MAX_CACHED_LINE_LENGTH) {
+        return expandTemplate(parseTemplate(line), context);
+    }
+
+    if (entries.size() >= maxEntries) {
+        index.erase(entries.back().line);
+        entries.pop_back();
+    }
+
+    entries.emplace_front();
+    Entry& entry = entries.front();
+    entry.line = line;
+    entry.tmpl = parseTemplate(entry.line);
+    index.emplace(entry.line, entries.begin());
+
+    return expandTemplate(entry.tmpl, context);
+}
+
+void ParseCache::clear() {
+    index.clear();
+    entries.clear();
+    hitCount = 0;
+    missCount = 0;
+}
+
+size_t ParseCache::size() const {
+    return entries.size();
+}
+
+size_t ParseCache::capacity() const {
+    return maxEntries;
+}
+
+size_t ParseCache::hits() const {
+    return hitCount;
+}
+
+size_t ParseCache::misses() const {
+    return missCount;
+}
@@ -0,0 +1,193 @@
+#include "pipe_tuning.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+PipeBufferPolicy configuredPolicy;
+
+const size_t DEFAULT_PIPE_SIZE = 64 * 1024;
+const size_t FALLBACK_PIPE_MAX_SIZE = 1024 * 1024;  // Linux's default pipe-max-size
+const int FIRST_SAMPLE_MS = 1;
+const int MAX_SAMPLE_MS = 50;
+
+#ifdef F_SETPIPE_SZ
+// A stage sleeping in the kernel's pipe write path ("pipe_write", or
+// "anon_pipe_write" on newer kernels) is waiting for room in its pipe
+bool isBlockedOnPipeWrite(pid_t pid) {
+    std::ifstream wchan("/proc/" + std::to_string(pid) + "/wchan");
+    std::string where;
+    std::getline(wchan, where);
+    const std::string suffix = "pipe_write";
+    return where.size() >= suffix.size() &&
+           where.compare(where.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Double the pipe on pid's stdout, reached through /proc since the shell no
+// longer holds either end. Returns false if it is already at the cap.
+bool growStdoutPipe(pid_t pid) {
+    std::string path = "/proc/" + std::to_string(pid) + "/fd/1";
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool grown = false;
+    int current = fcntl(fd, F_GETPIPE_SZ);
+    if (current > 0 && static_cast<size_t>(current) < pipeMaxSize()) {
+        size_t wanted = std::min(static_cast<size_t>(current) * 2, pipeMaxSize());
+        grown = fcntl(fd, F_SETPIPE_SZ, static_cast<int>(wanted)) > current;
+    }
+    close(fd);
+    return grown;
+}
+#endif
+
+}  // namespace
+
+void setPipeBufferPolicy(const PipeBufferPolicy& policy) {
+    configuredPolicy = policy;
+}
+
+const PipeBufferPolicy& pipeBufferPolicy() {
+    return configuredPolicy;
+}
+
+bool parsePipeBufferPolicy(std::string_view text, PipeBufferPolicy& policy) {
+    if (text == "default") {
+        policy = PipeBufferPolicy();
+        return true;
+    }
+    if (text == "auto") {
+        policy = PipeBufferPolicy();
+        policy.mode = PipeBufferPolicy::Mode::Auto;
+        return true;
+    }
+
+    size_t multiplier = 1;
+    if (!text.empty() && (text.back() == 'K' || text.back() == 'k')) {
+        multiplier = 1024;
+        text.remove_suffix(1);
+    } else if (!text.empty() && (text.back() == 'M' || text.back() == 'm')) {
+        multiplier = 1024 * 1024;
+        text.remove_suffix(1);
+    }
+    if (text.empty() || text.size() > 9) {
+        return false;
+    }
+
+    size_t value = 0;
+    for (char c : text) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+        value = value * 10 + static_cast<size_t>(c - '0');
+    }
+    if (value == 0) {
+        return false;
+    }
+
+    policy.mode = PipeBufferPolicy::Mode::Fixed;
+    policy.bytes = std::min(value * multiplier, pipeMaxSize());
+    return true;
+}
+
+std::string describePipeBufferPolicy(const PipeBufferPolicy& policy) {
+    switch (policy.mode) {
+    case PipeBufferPolicy::Mode::Fixed:
+        return std::to_string(policy.bytes) + " bytes";
+    case PipeBufferPolicy::Mode::Auto:
+        return "auto (" + std::to_string(DEFAULT_PIPE_SIZE) + " up to " +
+               std::to_string(pipeMaxSize()) + " bytes)";
+    default:
+        return "default (" + std::to_string(DEFAULT_PIPE_SIZE) + " bytes)";
+    }
+}
+
+size_t pipeMaxSize() {
+    static const size_t maxSize = []() {
+        std::ifstream file("/proc/sys/fs/pipe-max-size");
+        size_t value = 0;
+        return (file >> value) && value > 0 ? value : FALLBACK_PIPE_MAX_SIZE;
+    }();
+    return maxSize;
+}
+
+void sizePipe(int fd, const PipeBufferPolicy& policy) {
+#ifdef F_SETPIPE_SZ
+    if (policy.mode == PipeBufferPolicy::Mode::Fixed) {
+        // Can fail once the user's pipe memory quota is used up; the pipe
+        // then just keeps its default size
+        fcntl(fd, F_SETPIPE_SZ, static_cast<int>(policy.bytes));
+    }
+#else
+    (void)fd;
+    (void)policy;
+#endif
+}
+
+size_t waitAdaptively(const std::vector<pid_t>& pids, std::vector<int>& waitStatuses,
+                      const StageReaped& reaped) {
+    waitStatuses.assign(pids.size(), 0);
+    std::vector<size_t> running;
+    for (size_t i = 0; i < pids.size(); ++i) {
+        if (pids[i] > 0) {
+            running.push_back(i);
+        }
+    }
+
+    size_t resizes = 0;
+    int interval = FIRST_SAMPLE_MS;
+    while (!running.empty()) {
+        for (size_t i = 0; i < running.size();) {
+            size_t stage = running[i];
+            struct rusage usage;
+            pid_t result = wait4(pids[stage], &waitStatuses[stage], WNOHANG, &usage);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0) {
+                // Lost track of the stage (ECHILD): report it failed, not 0
+                std::perror("ninxsh: wait");
+                waitStatuses[stage] = W_EXITCODE(EXIT_FAILURE, 0);
+                usage = {};
+            }
+            if (result != 0) {
+                if (reaped) {
+                    reaped(stage, waitStatuses[stage], usage);
+                }
+                running.erase(running.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+        if (running.empty()) {
+            break;
+        }
+
+#ifdef F_SETPIPE_SZ
+        // The last stage writes wherever the pipeline's output goes, not to
+        // one of its pipes
+        for (size_t stage : running) {
+            if (stage + 1 < pids.size() && isBlockedOnPipeWrite(pids[stage]) &&
+                growStdoutPipe(pids[stage])) {
+                ++resizes;
+            }
+        }
+#endif
+
+        poll(nullptr, 0, interval);
+        interval = std::min(interval * 2, MAX_SAMPLE_MS);
+    }
+    return resizes;
+}
@@ -0,0 +1,48 @@
+#include "prompt.hpp"
+
+#include <string_view>
+
+#include "environment.hpp"
+#include "utils.hpp"
+
+void Prompt::compose() {
+    std::string username = getCurrentUsername();
+    std::string hostname = getCurrentHostname();
+
+    // Only use colors if output is to a terminal (not piped). Colored:
+    // username in green, @ in white, hostname in blue, : in white,
+    // path in yellow, $ in bright white
+    if (isOutputToTerminal()) {
+        head.append(Colors::BOLD).append(Colors::GREEN).append(username);
+        head.append(Colors::WHITE).append("@").append(Colors::BLUE).append(hostname);
+        head.append(Colors::WHITE).append(":").append(Colors::YELLOW);
+        tail.append(Colors::BRIGHT_WHITE).append("$ ").append(Colors::RESET);
+    } else {
+        head = username + "@" + hostname + ":";
+        tail = "$ ";
+    }
+    composed = true;
+}
+
+const std::string& Prompt::text() {
+    if (!composed) {
+        compose();
+    }
+
+    const char* currentPwd = lookupEnv("PWD");
+    const char* currentHome = lookupEnv("HOME");
+    std::string_view newPwd = currentPwd ? currentPwd : "";
+    std::string_view newHome = currentHome ? currentHome : "";
+    if (buffer.empty() || newPwd != pwd || newHome != home) {
+        pwd.assign(newPwd);
+        home.assign(newHome);
+        buffer.assign(head);
+        buffer += pwd.empty() ? getCurrentWorkingDir() : displayPath(pwd, home);
+        buffer += tail;
+    }
+    return buffer;
+}
+
+bool Prompt::write(int fd) {
+    return writeAll(fd, text());
+}
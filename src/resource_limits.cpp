@@ -0,0 +1,524 @@
+#include "resource_limits.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+ResourceLimits configuredLimits;
+
+enum class Target { CpuWeight, MemoryMax, PidsMax, Rlimit };
+
+struct Setting {
+    std::string_view name;
+    Target target;
+    int resource;  // RLIMIT_* for Target::Rlimit
+    bool isSize;   // Takes a K/M/G suffix
+};
+
+// In the order describeResourceLimits lists them
+const Setting SETTINGS[] = {
+    {"cpu", Target::CpuWeight, 0, false},
+    {"mem", Target::MemoryMax, 0, true},
+    {"pids", Target::PidsMax, 0, false},
+    {"cputime", Target::Rlimit, RLIMIT_CPU, false},
+    {"as", Target::Rlimit, RLIMIT_AS, true},
+    {"data", Target::Rlimit, RLIMIT_DATA, true},
+    {"stack", Target::Rlimit, RLIMIT_STACK, true},
+    {"fsize", Target::Rlimit, RLIMIT_FSIZE, true},
+    {"core", Target::Rlimit, RLIMIT_CORE, true},
+    {"nofile", Target::Rlimit, RLIMIT_NOFILE, false},
+    {"nproc", Target::Rlimit, RLIMIT_NPROC, false},
+};
+
+const uint64_t MAX_CPU_WEIGHT = 10000;
+
+// Decimal digits with an optional K, M or G suffix; false on overflow
+bool parseAmount(std::string_view text, bool isSize, uint64_t& value) {
+    uint64_t multiplier = 1;
+    if (isSize && !text.empty()) {
+        switch (std::toupper(static_cast<unsigned char>(text.back()))) {
+        case 'K':
+            multiplier = 1024;
+            break;
+        case 'M':
+            multiplier = 1024 * 1024;
+            break;
+        case 'G':
+            multiplier = 1024 * 1024 * 1024;
+            break;
+        }
+        if (multiplier > 1) {
+            text.remove_suffix(1);
+        }
+    }
+    if (text.empty() || text.size() > 15) {
+        return false;
+    }
+
+    value = 0;
+    for (char c : text) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    if (value > UINT64_MAX / multiplier) {
+        return false;
+    }
+    value *= multiplier;
+    return true;
+}
+
+// Sizes as they were most likely typed: "512M" rather than "536870912"
+std::string formatAmount(uint64_t value, bool isSize) {
+    if (value == ResourceLimits::UNLIMITED) {
+        return "unlimited";
+    }
+    const char* suffixes = "KMG";
+    std::string suffix;
+    for (int i = 0; isSize && i < 3 && value >= 1024 && value % 1024 == 0; ++i) {
+        value /= 1024;
+        suffix = suffixes[i];
+    }
+    return std::to_string(value) + suffix;
+}
+
+// Usage for jobs: "812K", "3.4M" or "1.2G"
+std::string formatBytes(uint64_t bytes) {
+    double kilobytes = static_cast<double>(bytes) / 1024;
+    char text[32];
+    if (kilobytes < 1024) {
+        std::snprintf(text, sizeof(text), "%.0fK", kilobytes);
+    } else if (kilobytes < 1024 * 1024) {
+        std::snprintf(text, sizeof(text), "%.1fM", kilobytes / 1024);
+    } else {
+        std::snprintf(text, sizeof(text), "%.1fG", kilobytes / (1024 * 1024));
+    }
+    return text;
+}
+
+rlim_t toRlimit(uint64_t value) {
+    return value == ResourceLimits::UNLIMITED ? RLIM_INFINITY : static_cast<rlim_t>(value);
+}
+
+bool writeFile(const std::string& path, std::string_view text) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size());
+    close(fd);
+    return ok;
+}
+
+// First value of a cgroup file ("123" or "max"), or of the "key value" line
+// starting with key (cpu.stat); false if the file or line is missing
+bool readCgroupValue(const std::string& path, std::string_view key, std::string& value) {
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string first;
+        fields >> first;
+        if (key.empty()) {
+            value = first;
+            return !value.empty();
+        }
+        if (first == key) {
+            return static_cast<bool>(fields >> value);
+        }
+    }
+    return false;
+}
+
+// Where groups for this shell's jobs go, made on first use and removed again
+// when its last group is
+struct CgroupTree {
+    bool probed = false;
+    std::string shellGroup;  // The shell's own cgroup; empty without cgroup v2
+    std::string root;        // shellGroup/ninxsh-<pid>, while it exists
+    size_t liveGroups = 0;
+    size_t nextGroup = 1;
+    std::vector<std::string> idle;  // Released but still had processes
+    bool warned[3] = {};            // Per controller, as in CONTROLLERS
+};
+
+CgroupTree tree;
+
+// Each cgroup limit, the controller that enforces it and its file
+struct Controller {
+    const char* name;
+    const char* file;
+};
+const Controller CONTROLLERS[] = {{"cpu", "cpu.weight"},
+                                  {"memory", "memory.max"},
+                                  {"pids", "pids.max"}};
+
+// The shell's cgroup in the cgroup v2 hierarchy: the mount point from
+// mountinfo plus the "0::" path from /proc/self/cgroup
+std::string findShellGroup() {
+    std::ifstream mounts("/proc/self/mountinfo");
+    std::string line;
+    std::string mountPoint;
+    std::string mountRoot;
+    while (std::getline(mounts, line)) {
+        size_t separator = line.find(" - ");
+        if (separator == std::string::npos || line.compare(separator + 3, 8, "cgroup2 ") != 0) {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string id, parent, device;
+        fields >> id >> parent >> device >> mountRoot >> mountPoint;
+        break;
+    }
+
+    std::ifstream cgroups("/proc/self/cgroup");
+    std::string path;
+    while (std::getline(cgroups, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            path = line.substr(3);
+        }
+    }
+    if (mountPoint.empty() || path.empty()) {
+        return std::string();
+    }
+
+    // Inside a cgroup namespace the mount's root is already our path
+    if (mountRoot != "/" && path.compare(0, mountRoot.size(), mountRoot) == 0) {
+        path.erase(0, mountRoot.size());
+    }
+    return mountPoint + (path == "/" ? "" : path);
+}
+
+// Whether a space-separated cgroup file (cgroup.controllers,
+// cgroup.subtree_control) lists name
+bool listsController(const std::string& path, std::string_view name) {
+    std::ifstream file(path);
+    std::string listed;
+    while (file >> listed) {
+        if (listed == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Make the shell's subtree and enable the controllers in it that can be.
+// A non-root cgroup holding the shell can't enable them for its children
+// ("no internal processes"), so this only gets them if they are already
+// enabled there or the shell is at the root of a delegated hierarchy. The
+// shell's group is only written to for a controller it offers and doesn't
+// already enable, since that changes it for all of its other children too.
+bool makeRoot() {
+    if (!tree.probed) {
+        tree.probed = true;
+        tree.shellGroup = findShellGroup();
+    }
+    if (tree.shellGroup.empty()) {
+        return false;
+    }
+    if (!tree.root.empty()) {
+        return true;
+    }
+
+    std::string root = tree.shellGroup + "/ninxsh-" + std::to_string(getpid());
+    if (mkdir(root.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    std::string shellControl = tree.shellGroup + "/cgroup.subtree_control";
+    for (const Controller& controller : CONTROLLERS) {
+        std::string enable = std::string("+") + controller.name;
+        if (!listsController(shellControl, controller.name) &&
+            listsController(tree.shellGroup + "/cgroup.controllers", controller.name)) {
+            writeFile(shellControl, enable);
+        }
+        if (listsController(root + "/cgroup.controllers", controller.name)) {
+            writeFile(root + "/cgroup.subtree_control", enable);
+        }
+    }
+    tree.root = root;
+    return true;
+}
+
+void removeRootIfUnused() {
+    if (tree.liveGroups == 0 && tree.idle.empty() && !tree.root.empty()) {
+        rmdir(tree.root.c_str());
+        tree.root.clear();
+    }
+}
+
+// A removed group is gone; one still holding processes is kept for later
+bool removeGroup(const std::string& path) {
+    if (rmdir(path.c_str()) == 0 || errno == ENOENT) {
+        --tree.liveGroups;
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+void ResourceLimits::merge(const ResourceLimits& overrides) {
+    if (overrides.cpuWeight != UNSET) {
+        cpuWeight = overrides.cpuWeight;
+    }
+    if (overrides.memoryMax != UNSET) {
+        memoryMax = overrides.memoryMax;
+    }
+    if (overrides.pidsMax != UNSET) {
+        pidsMax = overrides.pidsMax;
+    }
+    for (const auto& limit : overrides.rlimits) {
+        auto it = std::find_if(rlimits.begin(), rlimits.end(),
+                               [&](const auto& own) { return own.first == limit.first; });
+        if (it != rlimits.end()) {
+            it->second = limit.second;
+        } else {
+            rlimits.push_back(limit);
+        }
+    }
+}
+
+void setResourceLimits(const ResourceLimits& limits) {
+    configuredLimits = limits;
+}
+
+const ResourceLimits& resourceLimits() {
+    return configuredLimits;
+}
+
+bool parseLimitSetting(std::string_view text, ResourceLimits& limits) {
+    size_t equals = text.find('=');
+    if (equals == std::string_view::npos) {
+        return false;
+    }
+    std::string_view name = text.substr(0, equals);
+    std::string_view valueText = text.substr(equals + 1);
+
+    for (const Setting& setting : SETTINGS) {
+        if (setting.name != name) {
+            continue;
+        }
+
+        uint64_t value = ResourceLimits::UNLIMITED;
+        if (valueText != "unlimited" && !parseAmount(valueText, setting.isSize, value)) {
+            return false;
+        }
+
+        switch (setting.target) {
+        case Target::CpuWeight:
+            if (value == 0 || value > MAX_CPU_WEIGHT) {
+                return false;
+            }
+            limits.cpuWeight = value;
+            return true;
+        case Target::MemoryMax:
+        case Target::PidsMax:
+            if (value == 0) {
+                return false;  // Nothing could run at all
+            }
+            (setting.target == Target::MemoryMax ? limits.memoryMax : limits.pidsMax) = value;
+            return true;
+        case Target::Rlimit: {
+            ResourceLimits one;
+            one.rlimits.emplace_back(setting.resource, toRlimit(value));
+            limits.merge(one);
+            return true;
+        }
+        }
+    }
+    return false;
+}
+
+std::string describeResourceLimits(const ResourceLimits& limits) {
+    std::string text;
+    for (const Setting& setting : SETTINGS) {
+        uint64_t value = ResourceLimits::UNSET;
+        if (setting.target == Target::CpuWeight) {
+            value = limits.cpuWeight;
+        } else if (setting.target == Target::MemoryMax) {
+            value = limits.memoryMax;
+        } else if (setting.target == Target::PidsMax) {
+            value = limits.pidsMax;
+        } else {
+            // An rlimit of 0 (core=0) is a limit, so these go by presence
+            auto it = std::find_if(
+                limits.rlimits.begin(), limits.rlimits.end(),
+                [&](const auto& limit) { return limit.first == setting.resource; });
+            if (it == limits.rlimits.end()) {
+                continue;
+            }
+            value = it->second == RLIM_INFINITY ? ResourceLimits::UNLIMITED
+                                                : static_cast<uint64_t>(it->second);
+        }
+        if (setting.target != Target::Rlimit && value == ResourceLimits::UNSET) {
+            continue;
+        }
+
+        if (!text.empty()) {
+            text += ' ';
+        }
+        text.append(setting.name);
+        text += '=';
+        text += formatAmount(value, setting.isSize);
+    }
+    return text.empty() ? "none" : text;
+}
+
+bool applyRlimits(const ResourceLimits& limits) {
+    bool ok = true;
+    for (const auto& [resource, value] : limits.rlimits) {
+        struct rlimit limit = {value, value};
+        if (setrlimit(resource, &limit) == 0) {
+            continue;
+        }
+        // Raising the hard limit needs privilege; the soft one still applies
+        struct rlimit current;
+        if (getrlimit(resource, &current) != 0) {
+            ok = false;
+            continue;
+        }
+        limit.rlim_cur = std::min(value, current.rlim_max);
+        limit.rlim_max = current.rlim_max;
+        ok = setrlimit(resource, &limit) == 0 && ok;
+    }
+    return ok;
+}
+
+JobCgroup::~JobCgroup() {
+    releaseCgroup(detach());
+}
+
+bool JobCgroup::create(const ResourceLimits& limits) {
+    perProcess = ResourceLimits();
+    perProcess.rlimits = limits.rlimits;
+    if (!limits.usesCgroup()) {
+        return false;
+    }
+
+    if (makeRoot()) {
+        std::string path = tree.root + "/job-" + std::to_string(tree.nextGroup++);
+        if (mkdir(path.c_str(), 0755) == 0) {
+            dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            groupPath = path;
+            procsFile = path + "/cgroup.procs";
+            ++tree.liveGroups;
+        }
+    }
+
+    // Each limit goes to its controller's file if the group has one; the
+    // rest get the process-level fallback
+    const uint64_t values[] = {limits.cpuWeight, limits.memoryMax, limits.pidsMax};
+    for (size_t i = 0; i < 3; ++i) {
+        if (values[i] == ResourceLimits::UNSET) {
+            continue;
+        }
+        std::string value =
+            values[i] == ResourceLimits::UNLIMITED ? "max" : std::to_string(values[i]);
+        if (!groupPath.empty() &&
+            writeFile(groupPath + "/" + CONTROLLERS[i].file, value)) {
+            continue;
+        }
+
+        bool asFallback = i == 1 && values[i] != ResourceLimits::UNLIMITED;
+        if (asFallback) {
+            ResourceLimits addressSpace;
+            addressSpace.rlimits.emplace_back(RLIMIT_AS, toRlimit(values[i]));
+            addressSpace.merge(perProcess);  // An explicit as= wins
+            perProcess = addressSpace;
+        }
+        if (!tree.warned[i]) {
+            tree.warned[i] = true;
+            std::cerr << "ninxsh: limit: cgroup " << CONTROLLERS[i].name
+                      << " controller not delegated to the shell; " << SETTINGS[i].name
+                      << (asFallback ? "= applied as RLIMIT_AS instead\n" : "= not enforced\n");
+        }
+    }
+    return !groupPath.empty();
+}
+
+std::string JobCgroup::detach() {
+    if (dirFd >= 0) {
+        close(dirFd);
+        dirFd = -1;
+    }
+    procsFile.clear();
+    std::string path;
+    path.swap(groupPath);
+    return path;
+}
+
+bool enterCgroup(const char* procsPath) {
+    int fd = open(procsPath, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, "0", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+void releaseCgroup(const std::string& path) {
+    if (path.empty()) {
+        return;
+    }
+    if (!removeGroup(path)) {
+        tree.idle.push_back(path);
+    }
+    removeRootIfUnused();
+}
+
+void releaseIdleCgroups() {
+    if (tree.idle.empty()) {
+        return;
+    }
+    tree.idle.erase(std::remove_if(tree.idle.begin(), tree.idle.end(), removeGroup),
+                    tree.idle.end());
+    removeRootIfUnused();
+}
+
+void printCgroupUsage(const std::string& path, const ResourceLimits& limits, std::ostream& out) {
+    std::string cpu, memory, pids;
+    bool hasGroup = !path.empty();
+    if (hasGroup && readCgroupValue(path + "/cpu.stat", "usage_usec", cpu)) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2fs", std::strtod(cpu.c_str(), nullptr) / 1e6);
+        cpu = text;
+    }
+    if (hasGroup && readCgroupValue(path + "/memory.current", "", memory)) {
+        memory = formatBytes(std::strtoull(memory.c_str(), nullptr, 10));
+    }
+    if (hasGroup) {
+        readCgroupValue(path + "/pids.current", "", pids);
+    }
+
+    auto orDash = [](const std::string& value) { return value.empty() ? "-" : value; };
+    out << "cpu " << orDash(cpu);
+    if (limits.cpuWeight != ResourceLimits::UNSET) {
+        out << " (weight " << limits.cpuWeight << ")";
+    }
+    out << "  mem " << orDash(memory);
+    if (limits.memoryMax != ResourceLimits::UNSET) {
+        out << "/" << formatAmount(limits.memoryMax, true);
+    }
+    out << "  pids " << orDash(pids);
+    if (limits.pidsMax != ResourceLimits::UNSET) {
+        out << "/" << formatAmount(limits.pidsMax, false);
+    }
+
+    ResourceLimits processOnly;
+    processOnly.rlimits = limits.rlimits;
+    if (!processOnly.rlimits.empty()) {
+        out << "  " << describeResourceLimits(processOnly);
+    }
+}
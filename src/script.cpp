@@ -0,0 +1,181 @@
+#include "script.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "limits.hpp"
+
+ScriptSplitter::ScriptSplitter(std::string_view text, bool collectHereDocs)
+    : text(text), collectHereDocs(collectHereDocs) {}
+
+bool ScriptSplitter::nextLine(std::string_view& line) {
+    if (pos >= text.size()) {
+        return false;
+    }
+    size_t end = text.find('\n', pos);
+    if (end == std::string_view::npos) {
+        end = text.size();
+    }
+    line = text.substr(pos, end - pos);
+    pos = end + 1;
+    ++lineNumber;
+    return true;
+}
+
+bool ScriptSplitter::next(ScriptCommand& command) {
+    command = ScriptCommand();
+    std::string_view line;
+
+    while (nextLine(line)) {
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string_view::npos || line[first] == '#') {
+            continue;
+        }
+
+        command.line = lineNumber;
+        command.text = line;
+        command.tmpl = parseTemplate(line);
+
+        // A command continued over several lines (open quote, trailing
+        // backslash) is carried in a lexer until it is complete
+        if (!command.tmpl.hasError && command.tmpl.tokens.isIncomplete) {
+            command.continued.reset(new IncrementalLexer());
+            command.continued->feedLine(line);
+            while (command.continued->needsMore() && nextLine(line)) {
+                command.continued->feedLine(line);
+            }
+            if (command.continued->needsMore()) {
+                command.error = std::string("unexpected end of file: ") +
+                                command.continued->currentState().pendingConstruct();
+                return true;
+            }
+            command.tmpl = buildTemplate(command.continued->finish());
+            command.text = command.continued->text();
+        }
+
+        if (command.tmpl.hasError) {
+            command.error = command.tmpl.errorMessage;
+        } else {
+            readHereDocs(command);
+        }
+        return true;
+    }
+    return false;
+}
+
+void ScriptSplitter::readHereDocs(ScriptCommand& command) {
+    // Lines after a command with here-documents are their bodies, up to each
+    // delimiter in turn. All of a command's bodies together are held to
+    // MAX_HEREDOC_SIZE, as at the prompt.
+    size_t total = 0;
+    std::string_view line;
+    for (const auto& [delimiter, stripsTabs] : hereDocDelimiters(command.tmpl)) {
+        std::string body;
+        bool ended = false;
+        while (!ended && nextLine(line)) {
+            std::string_view text = stripsTabs ? stripLeadingTabs(line) : line;
+            if (text == delimiter) {
+                ended = true;
+            } else if (collectHereDocs) {
+                total += text.size() + 1;
+                if (total <= ninxsh::limits::MAX_HEREDOC_SIZE) {
+                    body.append(text.data(), text.size());
+                    body += '\n';
+                }
+            }
+        }
+
+        if (!ended && command.unterminatedHereDoc.empty()) {
+            command.unterminatedHereDoc.assign(delimiter);
+        }
+        if (collectHereDocs) {
+            command.hereDocs.push_back(std::move(body));
+        }
+    }
+
+    if (total > ninxsh::limits::MAX_HEREDOC_SIZE) {
+        command.error = "here-document too long (maximum " +
+                        std::to_string(ninxsh::limits::MAX_HEREDOC_SIZE) + " bytes)";
+        command.hereDocs.clear();
+    }
+}
+
+ParseAhead::ParseAhead(std::string_view text) : splitter(text) {
+    if (text.size() >= MIN_WORKER_SIZE) {
+        worker = std::thread(&ParseAhead::work, this);
+    }
+}
+
+ParseAhead::~ParseAhead() {
+    if (!worker.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    worker.join();
+}
+
+bool ParseAhead::next(ScriptCommand& command) {
+    if (!worker.joinable()) {
+        return splitter.next(command);
+    }
+
+    // Everything parsed so far is taken in one go, so the lock is only
+    // touched once per batch
+    if (taken.empty()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        // The last batch has all been run, so the worker may fill its place
+        inHand = 0;
+        changed.notify_all();
+        changed.wait(lock, [this]() { return !ready.empty() || finished; });
+        taken.swap(ready);
+        inHand = taken.size();
+        lock.unlock();
+        changed.notify_all();
+    }
+    if (taken.empty()) {
+        return false;
+    }
+    command = std::move(taken.front());
+    taken.pop_front();
+    return true;
+}
+
+void ParseAhead::work() {
+    std::vector<ScriptCommand> batch;
+    size_t batchSize = 1;
+    bool more = true;
+
+    while (more) {
+        ScriptCommand command;
+        more = splitter.next(command);
+        if (more) {
+            batch.push_back(std::move(command));
+            if (batch.size() < batchSize) {
+                continue;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        // What the shell took last counts until it comes back for more, so
+        // parsed but unrun commands never exceed MAX_AHEAD
+        changed.wait(lock, [this, &batch]() {
+            return stopping || ready.size() + inHand + batch.size() <= MAX_AHEAD;
+        });
+        if (stopping) {
+            return;
+        }
+        for (ScriptCommand& parsed : batch) {
+            ready.push_back(std::move(parsed));
+        }
+        finished = !more;
+        lock.unlock();
+        changed.notify_all();
+
+        batch.clear();
+        batchSize = std::min(batchSize * 2, MAX_BATCH);
+    }
+}
@@ -1,66 +1,153 @@
 #include "shell.hpp"
 
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
 #include <signal.h>
 #include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <utility>
 
 #include "builtin.hpp"
 #include "command.hpp"
 #include "executor.hpp"
+#include "lexer.hpp"
+#include "limits.hpp"
+#include "line_reader.hpp"
+#include "pipe_tuning.hpp"
+#include "resource_limits.hpp"
+#include "script.hpp"
+#include "startup_stats.hpp"
 #include "utils.hpp"
 
-Shell::Shell() {
-    // Load history from file if available
-    history.loadFromFile();
+Shell::Shell() : childWatcher(jobManager) {
+    startupPhase("shell members");
+
+    // Take over the environment before anything else reads it
+    environment.load(environ);
+    setActiveEnvironment(&environment);
+    startupPhase("environment");
+
+    // $PWD is the logical working directory that cd maintains and the prompt
+    // shows. An inherited one is kept only if it is a clean absolute path to
+    // the directory we are actually in.
+    const char* pwd = environment.get("PWD");
+    struct stat logical;
+    struct stat physical;
+    if (!pwd || logicalPath("", pwd) != pwd || stat(pwd, &logical) != 0 ||
+        stat(".", &physical) != 0 || logical.st_dev != physical.st_dev ||
+        logical.st_ino != physical.st_ino) {
+        char* cwd = getcwd(nullptr, 0);
+        if (cwd) {
+            environment.set("PWD", cwd);
+            free(cwd);
+        }
+    }
+    startupPhase("working directory");
+
+    // Everything builtins may touch, handed to them through one struct
+    builtinContext.history = &history;
+    builtinContext.jobManager = &jobManager;
+    builtinContext.parseCache = &parseCache;
+    builtinContext.environment = &environment;
+    builtinContext.commandHash = &commandHash;
 }
 
 Shell::~Shell() {
-    // Save history to file when shell exits
-    history.saveToFile();
+    // History is already on disk: each command was appended as it was added
+    setActiveEnvironment(nullptr);
+    releaseIdleCgroups();
 }
 
 void Shell::run() {
     setupSignalHandlers();
-    setGlobalJobManager(&jobManager);  // Set global job manager for signal handlers
+    startupPhase("signal handlers");
     std::string input;
 
+    // At a terminal the prompt waits on input and child exits together, so a
+    // finished job is reported the moment it exits
+    bool interactive = isatty(STDIN_FILENO);
+
+    // Lines are read in chunks against the input budget, so an oversized line
+    // is rejected without ever being buffered whole
+    LineReader reader(std::cin, inputBudget());
+
     while (true) {
-        cleanupZombieProcesses();
-        jobManager.cleanupJobs();  // Clean up finished background jobs
+        // Jobs that finished while the last command ran
+        childWatcher.reap(std::cout);
         printPrompt();
-        std::getline(std::cin, input);
+
+        // History is first needed for the line being typed, so the file is
+        // read once the prompt is up rather than before it
+        if (!historyLoaded) {
+            startupPhase("first prompt");
+            history.loadFromFile();
+            historyLoaded = true;
+            startupPhase("history (after prompt)");
+            reportStartupStats(std::cerr);
+        }
+        if (interactive) {
+            childWatcher.waitForInput(STDIN_FILENO, std::cout, [this]() { printPrompt(); });
+        }
+        LineReader::Status status = reader.read(input);
 
         // Handle EOF (Ctrl+D)
-        if (std::cin.eof()) {
+        if (status == LineReader::Status::Eof) {
             std::cout << '\n';
             break;
         }
 
+        if (status == LineReader::Status::TooLong) {
+            std::cout << "ninxsh: Input too long (maximum " << reader.budget() << " bytes)\n";
+            setStatus(2);
+            continue;
+        }
+
         // Skip empty input
         if (input.empty())
             continue;
 
-        // Check for history expansion (!n or !!)
-        std::string expandedInput = expandHistoryCommand(input);
-        if (expandedInput.empty()) {
-            // History expansion failed
-            continue;
-        }
+        // Check for history expansion (!n or !!); only ! lines can change, so
+        // long generated lines are not copied
+        if (input[0] == '!') {
+            std::string expandedInput = expandHistoryCommand(input);
+            if (expandedInput.empty()) {
+                // History expansion failed
+                continue;
+            }
 
-        // If the input was changed by history expansion, echo the command
-        if (expandedInput != input) {
-            std::cout << expandedInput << std::endl;
-            input = expandedInput;
+            // If the input was changed by history expansion, echo the command
+            if (expandedInput != input) {
+                std::cout << expandedInput << std::endl;
+                input = std::move(expandedInput);
+            }
         }
 
-        ParsedCommand parsed = parseCommand(input);
+        // Repeated lines (monitoring loops, !! and !n) skip lexing on a cache hit
+        ParsedCommand parsed = parseCache.parse(input, expansionContext);
+
+        // An open quote or trailing backslash continues on the next line
+        if (parsed.isIncomplete && !parsed.hasError &&
+            !readContinuation(reader, input, parsed)) {
+            setStatus(2);
+            continue;
+        }
 
         // Check for parsing errors
         if (parsed.hasError) {
             std::cout << "ninxsh: " << parsed.errorMessage << "\n";
+            setStatus(2);  // Syntax error, as in POSIX shells
+            continue;
+        }
+
+        // Here-document bodies follow the command line
+        if (parsed.needsHereDocs() && !readHereDocs(reader, parsed)) {
+            setStatus(2);
             continue;
         }
 
@@ -72,147 +159,274 @@ void Shell::run() {
         // Add valid command to history (after validation)
         history.addCommand(input);
 
-        // Get the first command to check if it's a builtin
-        std::string cmd = parsed.pipeline[0].args[0];
+        execute(parsed);
+    }
+}
 
-        // Check for history command
-        if (cmd == "history" && parsed.pipeline.size() == 1) {
-            std::vector<std::string> histArgs;
-            for (auto arg : parsed.pipeline[0].args) {
-                if (arg) {
-                    histArgs.push_back(std::string(arg));
-                }
-            }
-            displayHistory(histArgs);
-            continue;
+void Shell::execute(ParsedCommand& parsed) {
+    // Builtins below succeed unless they say otherwise
+    setStatus(0);
+
+    // "time command..." reports what each stage of this line cost
+    Command& first = parsed.pipeline[0];
+    bool timed = std::string_view(first.args[0]) == "time" && first.args.size() > 2;
+    if (timed) {
+        first.args = ArgList(first.args.data() + 1, first.args.size() - 2);
+    }
+
+    // "pipesize SIZE command..." gives just this line its own pipe size
+    bool hasLinePolicy = std::string_view(first.args[0]) == "pipesize" && first.args.size() > 3;
+    PipeBufferPolicy linePolicy;
+    if (hasLinePolicy) {
+        if (!parsePipeBufferPolicy(first.args[1], linePolicy)) {
+            std::cout << "ninxsh: pipesize: invalid size '" << first.args[1] << "'\n";
+            setStatus(1);
+            return;
         }
+        first.args = ArgList(first.args.data() + 2, first.args.size() - 3);
+    }
 
-        // Check for jobs command
-        if (cmd == "jobs" && parsed.pipeline.size() == 1) {
-            jobManager.printJobs();
-            continue;
+    // "limit name=value... command..." runs just this line under further limits
+    bool hasLineLimits = false;
+    ResourceLimits lineLimits;
+    if (std::string_view(first.args[0]) == "limit") {
+        lineLimits = resourceLimits();
+        size_t end = 1;
+        while (end + 1 < first.args.size() && parseLimitSetting(first.args[end], lineLimits)) {
+            ++end;
         }
+        hasLineLimits = end > 1 && end + 1 < first.args.size();
+        if (hasLineLimits && std::string_view(first.args[end]).find('=') != std::string::npos) {
+            std::cout << "ninxsh: limit: invalid setting '" << first.args[end] << "'\n";
+            setStatus(1);
+            return;
+        }
+        if (hasLineLimits) {
+            first.args = ArgList(first.args.data() + end, first.args.size() - 1 - end);
+        }
+    }
 
-        // Check for kill command
-        if (cmd == "kill" && parsed.pipeline.size() == 1) {
-            if (parsed.pipeline[0].args.size() > 1 && parsed.pipeline[0].args[1]) {
-                try {
-                    pid_t pid = std::stoi(parsed.pipeline[0].args[1]);
-                    if (kill(pid, SIGTERM) == 0) {
-                        std::cout << "Process " << pid << " terminated\n";
-                    } else {
-                        std::perror("kill");
-                    }
-                } catch (const std::exception& e) {
-                    std::cout << "kill: invalid PID '" << parsed.pipeline[0].args[1] << "'\n";
-                }
-            } else {
-                std::cout << "Usage: kill <pid>\n";
+    // Builtins run in the shell itself unless they are part of a pipeline or
+    // have process substitutions, which only the pipeline executor starts
+    PipelineReport report;
+    if (parsed.pipeline.size() == 1 && parsed.substitutions.empty()) {
+        const Builtin* builtin = findBuiltin(parsed.pipeline[0].args[0]);
+        if (builtin) {
+            report = runBuiltin(*builtin, parsed.pipeline[0].args);
+            setStatus(report.stages[0].status);
+            if (timed) {
+                printPipelineReport(parsed, report, std::cerr);
             }
-            continue;
+            return;
         }
+    }
 
-        // Check for fg command (foreground)
-        if (cmd == "fg" && parsed.pipeline.size() == 1) {
-            if (parsed.pipeline[0].args.size() > 1 && parsed.pipeline[0].args[1]) {
-                try {
-                    int jobId = std::stoi(parsed.pipeline[0].args[1]);
-                    Job* job = jobManager.findJobById(jobId);
-                    if (job) {
-                        std::cout << job->command << std::endl;
-                        if (job->isStopped) {
-                            // Resume the job
-                            kill(job->pid, SIGCONT);
-                            job->isStopped = false;
-                            job->isRunning = true;
-                        }
-                        // Wait for the job to complete
-                        int status;
-                        waitpid(job->pid, &status, 0);
-                        jobManager.removeJob(job->pid);
-                    } else {
-                        std::cout << "fg: job " << jobId << " not found\n";
-                    }
-                } catch (const std::exception& e) {
-                    std::cout << "fg: invalid job ID '" << parsed.pipeline[0].args[1] << "'\n";
-                }
-            } else {
-                // No job ID specified, use most recent job
-                const auto& jobs = jobManager.getJobs();
-                if (!jobs.empty()) {
-                    Job* job = const_cast<Job*>(&jobs.back());
-                    std::cout << job->command << std::endl;
-                    if (job->isStopped) {
-                        kill(job->pid, SIGCONT);
-                        job->isStopped = false;
-                        job->isRunning = true;
-                    }
-                    int status;
-                    waitpid(job->pid, &status, 0);
-                    jobManager.removeJob(job->pid);
-                } else {
-                    std::cout << "fg: no current job\n";
-                }
-            }
+    PipeBufferPolicy globalPolicy = pipeBufferPolicy();
+    if (hasLinePolicy) {
+        setPipeBufferPolicy(linePolicy);
+    }
+    ResourceLimits globalLimits;
+    if (hasLineLimits) {
+        globalLimits = resourceLimits();
+        setResourceLimits(lineLimits);
+    }
+    expansionContext.lastStatus =
+        executeExternal(parsed, &jobManager, &builtinContext, &report);
+    setPipeBufferPolicy(globalPolicy);
+    if (hasLineLimits) {
+        setResourceLimits(globalLimits);
+    }
+
+    expansionContext.pipeStatus.clear();
+    for (const StageReport& stage : report.stages) {
+        expansionContext.pipeStatus.push_back(stage.status);
+    }
+    if (timed && !parsed.pipeline.back().isBackground) {
+        printPipelineReport(parsed, report, std::cerr);
+    }
+
+    // Remember the background job for $!
+    if (parsed.pipeline.back().isBackground && !jobManager.getJobs().empty()) {
+        expansionContext.lastBackgroundPid = jobManager.getJobs().back().pid;
+    }
+}
+
+bool Shell::readContinuation(LineReader& reader, std::string& input, ParsedCommand& parsed) {
+    // Lexer state is carried from line to line, so each continuation line is
+    // lexed exactly once however long the block grows
+    IncrementalLexer lexer;
+    lexer.feedLine(input);
+    std::string line;
+
+    while (lexer.needsMore()) {
+        std::cout << "> " << std::flush;
+        LineReader::Status status = reader.read(line);
+
+        if (status == LineReader::Status::Eof) {
+            std::cout << "\nninxsh: unexpected end of file: "
+                      << lexer.currentState().pendingConstruct() << "\n";
+            return false;
+        }
+        if (status == LineReader::Status::TooLong ||
+            lexer.text().size() + 1 + line.size() > inputBudget()) {
+            std::cout << "ninxsh: Input too long (maximum " << inputBudget() << " bytes)\n";
+            return false;
+        }
+        lexer.feedLine(line);
+    }
+
+    input = lexer.text();
+    parsed = expandTemplate(buildTemplate(lexer.finish()), expansionContext);
+    return true;
+}
+
+bool Shell::readHereDocs(LineReader& reader, ParsedCommand& parsed) {
+    // Bodies are read in the order their << appear on the line. All of them
+    // together are held to MAX_HEREDOC_SIZE; an oversized one is still read
+    // to its delimiter, so its lines aren't run as commands.
+    size_t total = 0;
+    bool tooLong = false;
+    std::string line;
+    std::string body;
+
+    for (Command& command : parsed.pipeline) {
+        if (command.hereDocDelimiter.empty()) {
             continue;
         }
+        body.clear();
+        bool ended = false;
+
+        while (!ended) {
+            std::cout << "> " << std::flush;
+            LineReader::Status status = reader.read(line);
+            if (status == LineReader::Status::Eof) {
+                std::cout << "\nninxsh: here-document delimited by end-of-file (wanted '"
+                          << command.hereDocDelimiter << "')\n" << std::flush;
+                break;
+            }
+            if (status == LineReader::Status::TooLong) {
+                tooLong = true;
+                continue;
+            }
 
-        // Check for bg command (background)
-        if (cmd == "bg" && parsed.pipeline.size() == 1) {
-            if (parsed.pipeline[0].args.size() > 1 && parsed.pipeline[0].args[1]) {
-                try {
-                    int jobId = std::stoi(parsed.pipeline[0].args[1]);
-                    Job* job = jobManager.findJobById(jobId);
-                    if (job) {
-                        if (job->isStopped) {
-                            // Resume the job in background
-                            kill(job->pid, SIGCONT);
-                            job->isStopped = false;
-                            job->isRunning = true;
-                            std::cout << "[" << job->jobId << "] " << job->command << " &\n";
-                        } else {
-                            std::cout << "bg: job " << jobId << " already running\n";
-                        }
-                    } else {
-                        std::cout << "bg: job " << jobId << " not found\n";
-                    }
-                } catch (const std::exception& e) {
-                    std::cout << "bg: invalid job ID '" << parsed.pipeline[0].args[1] << "'\n";
-                }
-            } else {
-                // No job ID specified, use most recent stopped job
-                const auto& jobs = jobManager.getJobs();
-                Job* stoppedJob = nullptr;
-                for (auto& job : jobs) {
-                    if (job.isStopped) {
-                        stoppedJob = const_cast<Job*>(&job);
-                        break;
-                    }
-                }
-                if (stoppedJob) {
-                    kill(stoppedJob->pid, SIGCONT);
-                    stoppedJob->isStopped = false;
-                    stoppedJob->isRunning = true;
-                    std::cout << "[" << stoppedJob->jobId << "] " << stoppedJob->command << " &\n";
-                } else {
-                    std::cout << "bg: no stopped jobs\n";
-                }
+            std::string_view text = command.hereDocStripsTabs ? stripLeadingTabs(line) : line;
+            if (text == command.hereDocDelimiter) {
+                ended = true;
+            } else if (!tooLong) {
+                total += text.size() + 1;
+                tooLong = total > ninxsh::limits::MAX_HEREDOC_SIZE;
+                body.append(text.data(), text.size());
+                body += '\n';
             }
-            continue;
         }
 
-        // Only run builtins if it's a single command (not a pipeline)
-        if (parsed.pipeline.size() == 1 && isBuiltin(cmd)) {
-            executeBuiltin(parsed.pipeline[0].args);
+        if (!tooLong) {
+            setHereDoc(parsed, command, body);
+        }
+    }
+
+    if (tooLong) {
+        std::cout << "ninxsh: here-document too long (maximum "
+                  << ninxsh::limits::MAX_HEREDOC_SIZE << " bytes)\n";
+        return false;
+    }
+    return true;
+}
+
+void Shell::setHereDoc(ParsedCommand& parsed, Command& command, const std::string& body) {
+    if (!command.hereDocExpands) {
+        parsed.setInputText(command, body);
+        return;
+    }
+    std::string expanded;
+    expandEnvVarsInto(body, expansionContext, expanded);
+    parsed.setInputText(command, expanded);
+}
+
+int Shell::runScript(std::string_view script, const std::string& name) {
+    // The next commands are lexed and parsed on a worker thread while this
+    // one runs; here they are only expanded and executed. No prompt is
+    // built, nothing goes into history, and job notices are dropped.
+    ParseAhead commands(script);
+    ScriptCommand command;
+    std::ostream discard(nullptr);
+
+    while (commands.next(command)) {
+        // A syntax error ends the script, as in other shells
+        if (!command.error.empty()) {
+            std::cerr << "ninxsh: " << name << ": line " << command.line << ": " << command.error
+                      << '\n';
+            return 2;
+        }
+        if (command.text.size() > inputBudget()) {
+            std::cerr << "ninxsh: " << name << ": line " << command.line
+                      << ": Input too long (maximum " << inputBudget() << " bytes)\n";
+            return 2;
+        }
+        if (!command.unterminatedHereDoc.empty()) {
+            std::cerr << "ninxsh: " << name << ": line " << command.line
+                      << ": here-document delimited by end-of-file (wanted '"
+                      << command.unterminatedHereDoc << "')\n";
+        }
+
+        ParsedCommand parsed = expandTemplate(command.tmpl, expansionContext);
+        if (parsed.hasError) {
+            std::cerr << "ninxsh: " << name << ": line " << command.line << ": "
+                      << parsed.errorMessage << '\n';
+            setStatus(2);
             continue;
         }
+        size_t body = 0;
+        for (Command& stage : parsed.pipeline) {
+            if (!stage.hereDocDelimiter.empty() && body < command.hereDocs.size()) {
+                setHereDoc(parsed, stage, command.hereDocs[body++]);
+            }
+        }
+        if (parsed.pipeline.empty() || parsed.pipeline[0].args.empty()) {
+            continue;
+        }
+
+        execute(parsed);
 
-        executeExternal(parsed, &jobManager);
+        // Builtin output is buffered; it must reach stdout before the next
+        // command's own output does
+        std::cout.flush();
+        childWatcher.reap(discard);
     }
+    return expansionContext.lastStatus;
 }
 
-void Shell::printPrompt() const {
-    std::cout << getColoredPrompt() << std::flush;
+void Shell::setStatus(int status) {
+    expansionContext.lastStatus = status;
+    expansionContext.pipeStatus.clear();
+}
+
+PipelineReport Shell::runBuiltin(const Builtin& builtin, const ArgList& args) {
+    // The builtin runs on the shell's own thread, so its cost is the change in
+    // the shell's usage (ru_maxrss is the shell's peak, not a difference)
+    PipelineReport report;
+    report.stages.resize(1);
+    StageReport& stage = report.stages[0];
+    struct rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    auto start = std::chrono::steady_clock::now();
+
+    stage.status = builtin.handler(args, builtinContext, std::cout);
+
+    report.realSeconds = stage.realSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    getrusage(RUSAGE_SELF, &stage.usage);
+    timersub(&stage.usage.ru_utime, &before.ru_utime, &stage.usage.ru_utime);
+    timersub(&stage.usage.ru_stime, &before.ru_stime, &stage.usage.ru_stime);
+    stage.usage.ru_nvcsw -= before.ru_nvcsw;
+    stage.usage.ru_nivcsw -= before.ru_nivcsw;
+    return report;
+}
+
+void Shell::printPrompt() {
+    // Job notices already written through std::cout go out first
+    std::cout.flush();
+    prompt.write(STDOUT_FILENO);
 }
 
 std::string Shell::expandHistoryCommand(const std::string& input) const {
@@ -231,7 +445,7 @@ std::string Shell::expandHistoryCommand(const std::string& input) const {
             std::cout << "ninxsh: !!: event not found\n";
             return "";
         }
-        return commands.back();
+        return std::string(commands.back());
     } else if (input[0] == '!') {
         // Check for !n format (execute command number n)
         std::string numberStr = input.substr(1);
@@ -245,7 +459,7 @@ std::string Shell::expandHistoryCommand(const std::string& input) const {
                 return "";
             }
 
-            return commands[index];
+            return std::string(commands[index]);
         } catch (const std::exception& e) {
             // If not a valid number, treat as a regular command
             return input;
@@ -255,28 +469,3 @@ std::string Shell::expandHistoryCommand(const std::string& input) const {
     // No expansion needed
     return input;
 }
-
-void Shell::displayHistory(const std::vector<std::string>& args) const {
-    // Get the commands from history
-    const auto& commands = history.getCommands();
-
-    // Determine how many commands to display
-    size_t numToDisplay = commands.size();
-
-    // If an argument is provided, use it to limit the number of commands displayed
-    if (args.size() > 1) {
-        try {
-            numToDisplay = std::min(numToDisplay, static_cast<size_t>(std::stoi(args[1])));
-        } catch (const std::exception& e) {
-            // If argument isn't a valid number, show all
-        }
-    }
-
-    // Calculate the starting index
-    size_t startIdx = (numToDisplay < commands.size()) ? commands.size() - numToDisplay : 0;
-
-    // Display the commands with their indices
-    for (size_t i = startIdx; i < commands.size(); ++i) {
-        std::cout << (i + 1) << "  " << commands[i] << '\n';
-    }
-}
@@ -0,0 +1,83 @@
+#include "startup_stats.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <time.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t MAX_PHASES = 16;
+
+struct Phase {
+    const char* name = nullptr;
+    double ms = 0;
+};
+
+// No constructors to run: this is set up at compile time, not before main
+struct StartupStats {
+    bool enabled = false;
+    bool reported = false;
+    double beforeMainMs = 0;
+    Clock::time_point start;
+    Clock::time_point last;
+    Phase phases[MAX_PHASES];
+    size_t phaseCount = 0;
+};
+
+StartupStats stats;
+
+// Scripts and -c report when they exit, however they exit
+void reportAtExit() {
+    startupPhase("run until exit");
+    reportStartupStats(std::cerr);
+}
+
+}  // namespace
+
+void enableStartupStats() {
+    stats.enabled = true;
+    stats.start = stats.last = Clock::now();
+    std::atexit(reportAtExit);
+
+    timespec used;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &used) == 0) {
+        stats.beforeMainMs = used.tv_sec * 1e3 + used.tv_nsec / 1e6;
+    }
+}
+
+void startupPhase(const char* name) {
+    if (!stats.enabled || stats.phaseCount == MAX_PHASES) {
+        return;
+    }
+    Clock::time_point now = Clock::now();
+    Phase& phase = stats.phases[stats.phaseCount++];
+    phase.name = name;
+    phase.ms = std::chrono::duration<double, std::milli>(now - stats.last).count();
+    stats.last = now;
+}
+
+void reportStartupStats(std::ostream& out) {
+    if (!stats.enabled || stats.reported) {
+        return;
+    }
+    stats.reported = true;
+
+    auto row = [&out](const char* name, double ms) {
+        out << "  " << std::left << std::setw(24) << name << std::right << std::setw(9) << ms
+            << " ms\n";
+    };
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3) << "ninxsh startup:\n";
+    row("before main (cpu)", stats.beforeMainMs);
+    for (size_t i = 0; i < stats.phaseCount; ++i) {
+        row(stats.phases[i].name, stats.phases[i].ms);
+    }
+    row("total since main",
+        std::chrono::duration<double, std::milli>(stats.last - stats.start).count());
+    out.flags(flags);
+}
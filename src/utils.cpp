@@ -1,11 +1,13 @@
 #include "utils.hpp"
 
+#include <cctype>
+#include <cerrno>
 #include <climits>
 #include <cstdlib>
 #include <pwd.h>
-#include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <sys/types.h>
 #include <unistd.h>
 #include <vector>
@@ -14,7 +16,9 @@
 #include <sys/syslimits.h>
 #endif
 
+#include "environment.hpp"
 #include "limits.hpp"
+#include "prompt.hpp"
 
 // Define HOST_NAME_MAX if not available
 #ifndef HOST_NAME_MAX
@@ -25,9 +29,6 @@
 #endif
 #endif
 
-// Static regex pattern for environment variable matching (compiled once)
-static const std::regex envPattern(R"(\$([A-Za-z_][A-Za-z0-9_]*))");
-
 std::string expandPath(const std::string& path) {
     // Early validation: reject excessively long paths to prevent DoS
     if (path.length() > ninxsh::limits::MAX_PATH_LENGTH) {
@@ -38,7 +39,7 @@ std::string expandPath(const std::string& path) {
 
     // Handle tilde expansion only
     if (!result.empty() && result[0] == '~') {
-        const char* home = getenv("HOME");
+        const char* home = lookupEnv("HOME");
         if (home) {
             result.replace(0, 1, home);
         }
@@ -47,25 +48,199 @@ std::string expandPath(const std::string& path) {
     return result;
 }
 
-std::string expandEnvVars(const std::string& str) {
-    // Early validation: reject excessively long strings to prevent DoS
-    if (str.length() > ninxsh::limits::MAX_STRING_LENGTH) {
-        return str;  // Return unchanged if too long
+namespace {
+
+// Deepest ${VAR:-${OTHER:-...}} nesting expanded; anything deeper stays literal
+const int MAX_EXPANSION_DEPTH = 32;
+
+bool isNameStart(char c) {
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isNameChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Look up a variable or special parameter; returns false if it is unset
+bool lookupParameter(std::string_view name, const ExpansionContext& context, std::string& value) {
+    if (name == "?") {
+        value = std::to_string(context.lastStatus);
+        return true;
+    }
+    if (name == "$") {
+        value = std::to_string(getpid());
+        return true;
+    }
+    if (name == "!") {
+        if (context.lastBackgroundPid <= 0) {
+            return false;
+        }
+        value = std::to_string(context.lastBackgroundPid);
+        return true;
     }
 
-    // Quick check: if there's no '$' character, skip expensive regex processing
-    if (str.find('$') == std::string::npos) {
-        return str;
+    if (name == "PIPESTATUS") {
+        if (context.pipeStatus.empty()) {
+            value = std::to_string(context.lastStatus);
+            return true;
+        }
+        value.clear();
+        for (int status : context.pipeStatus) {
+            if (!value.empty()) {
+                value += ' ';
+            }
+            value += std::to_string(status);
+        }
+        return true;
+    }
+
+    const char* env = lookupEnv(name);
+    if (!env) {
+        return false;
+    }
+    value = env;
+    return true;
+}
+
+// Find the '}' closing a ${ whose body starts at pos, honouring nested ${...}
+size_t findClosingBrace(std::string_view str, size_t pos) {
+    int depth = 1;
+    for (size_t i = pos; i < str.size(); ++i) {
+        if (str[i] == '$' && i + 1 < str.size() && str[i + 1] == '{') {
+            ++depth;
+            ++i;
+        } else if (str[i] == '}' && --depth == 0) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+void expandInto(std::string_view str, const ExpansionContext& context, std::string& out,
+                int depth);
+
+// Expand the body of ${...}: NAME, NAME:-default or NAME-default
+void expandBraced(std::string_view body, const ExpansionContext& context, std::string& out,
+                  int depth) {
+    size_t nameEnd = 0;
+    if (!body.empty() && (body[0] == '?' || body[0] == '$' || body[0] == '!')) {
+        nameEnd = 1;
+    } else if (!body.empty() && isNameStart(body[0])) {
+        while (nameEnd < body.size() && isNameChar(body[nameEnd])) {
+            ++nameEnd;
+        }
+    }
+
+    std::string_view name = body.substr(0, nameEnd);
+    std::string_view rest = body.substr(nameEnd);
+
+    // ${PIPESTATUS[n]}, ${PIPESTATUS[@]} and ${PIPESTATUS[*]}: the only array
+    size_t subscriptEnd = rest.find(']');
+    if (name == "PIPESTATUS" && !rest.empty() && rest[0] == '[' &&
+        subscriptEnd == rest.size() - 1) {
+        std::string_view subscript = rest.substr(1, subscriptEnd - 1);
+        std::string value;
+        if (subscript == "@" || subscript == "*") {
+            lookupParameter(name, context, value);
+        } else if (!subscript.empty() &&
+                   subscript.find_first_not_of("0123456789") == std::string_view::npos &&
+                   subscript.size() < 10) {
+            size_t index = std::stoul(std::string(subscript));
+            if (context.pipeStatus.empty() && index == 0) {
+                value = std::to_string(context.lastStatus);
+            } else if (index < context.pipeStatus.size()) {
+                value = std::to_string(context.pipeStatus[index]);
+            }
+        }
+        out += value;
+        return;
+    }
+    bool colonForm = rest.size() >= 2 && rest[0] == ':' && rest[1] == '-';
+    bool plainForm = !rest.empty() && rest[0] == '-';
+
+    if (name.empty() || (!rest.empty() && !colonForm && !plainForm)) {
+        // Not a form we understand: keep it as written
+        out += "${";
+        out.append(body.data(), body.size());
+        out += '}';
+        return;
+    }
+
+    std::string value;
+    bool isSet = lookupParameter(name, context, value);
+    if (rest.empty() || (isSet && (plainForm || !value.empty()))) {
+        out += value;
+        return;
+    }
+
+    // Default word is itself subject to expansion
+    expandInto(rest.substr(colonForm ? 2 : 1), context, out, depth + 1);
+}
+
+void expandInto(std::string_view str, const ExpansionContext& context, std::string& out,
+                int depth) {
+    std::string value;
+    size_t i = 0;
+
+    while (i < str.size()) {
+        size_t dollar = str.find('$', i);
+        if (dollar == std::string_view::npos) {
+            out.append(str.data() + i, str.size() - i);
+            return;
+        }
+        out.append(str.data() + i, dollar - i);
+        i = dollar + 1;
+
+        if (i >= str.size()) {
+            out += '$';
+            return;
+        }
+
+        char c = str[i];
+        if (c == '?' || c == '$' || c == '!') {
+            if (lookupParameter(str.substr(i, 1), context, value)) {
+                out += value;
+            }
+            ++i;
+        } else if (c == '{') {
+            size_t close = findClosingBrace(str, i + 1);
+            if (close == std::string_view::npos || depth >= MAX_EXPANSION_DEPTH) {
+                out += '$';  // Unterminated or too deep: the rest is copied literally
+                continue;
+            }
+            expandBraced(str.substr(i + 1, close - i - 1), context, out, depth);
+            i = close + 1;
+        } else if (isNameStart(c)) {
+            size_t end = i + 1;
+            while (end < str.size() && isNameChar(str[end])) {
+                ++end;
+            }
+            if (lookupParameter(str.substr(i, end - i), context, value)) {
+                out += value;
+            }
+            i = end;
+        } else {
+            out += '$';
+        }
     }
+}
 
-    std::string result = str;
-    std::smatch match;
+}  // namespace
 
-    while (std::regex_search(result, match, envPattern)) {
-        const char* value = getenv(match[1].str().c_str());
-        result.replace(match.position(0), match.length(0), value ? value : "");
+void expandEnvVarsInto(std::string_view str, const ExpansionContext& context, std::string& out) {
+    // Single left-to-right pass; substituted values are never rescanned
+    out.reserve(out.size() + str.size() + 32);
+    expandInto(str, context, out, 0);
+}
+
+std::string expandEnvVars(const std::string& str, const ExpansionContext& context) {
+    // Quick check: if there's no '$' character there is nothing to expand
+    if (str.find('$') == std::string::npos) {
+        return str;
     }
 
+    std::string result;
+    expandEnvVarsInto(str, context, result);
     return result;
 }
 
@@ -93,36 +268,72 @@ std::string trim(const std::string& str) {
     return str.substr(start, end - start + 1);
 }
 
-// ANSI Color codes definitions
-namespace Colors {
-const std::string RESET = "\033[0m";
-const std::string BOLD = "\033[1m";
-const std::string DIM = "\033[2m";
-
-// Foreground colors
-const std::string BLACK = "\033[30m";
-const std::string RED = "\033[31m";
-const std::string GREEN = "\033[32m";
-const std::string YELLOW = "\033[33m";
-const std::string BLUE = "\033[34m";
-const std::string MAGENTA = "\033[35m";
-const std::string CYAN = "\033[36m";
-const std::string WHITE = "\033[37m";
-
-// Bright foreground colors
-const std::string BRIGHT_BLACK = "\033[90m";
-const std::string BRIGHT_RED = "\033[91m";
-const std::string BRIGHT_GREEN = "\033[92m";
-const std::string BRIGHT_YELLOW = "\033[93m";
-const std::string BRIGHT_BLUE = "\033[94m";
-const std::string BRIGHT_MAGENTA = "\033[95m";
-const std::string BRIGHT_CYAN = "\033[96m";
-const std::string BRIGHT_WHITE = "\033[97m";
-}  // namespace Colors
+bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
+
+std::string logicalPath(std::string_view cwd, std::string_view path) {
+    bool absolute = !path.empty() && path[0] == '/';
+    if (!absolute && (cwd.empty() || cwd[0] != '/')) {
+        return "";
+    }
+
+    std::string result;
+    auto append = [&result](std::string_view components) {
+        while (!components.empty()) {
+            size_t slash = components.find('/');
+            std::string_view component = components.substr(0, slash);
+            components.remove_prefix(slash == std::string_view::npos ? components.size()
+                                                                      : slash + 1);
+            if (component.empty() || component == ".") {
+                continue;
+            }
+            if (component == "..") {
+                size_t parent = result.rfind('/');
+                result.resize(parent == std::string::npos ? 0 : parent);
+                continue;
+            }
+            result += '/';
+            result.append(component.data(), component.size());
+        }
+    };
+    if (!absolute) {
+        append(cwd);
+    }
+    append(path);
+    return result.empty() ? "/" : result;
+}
+
+std::string displayPath(std::string_view path, std::string_view home) {
+    std::string result;
+    if (!home.empty() && path.compare(0, home.size(), home) == 0 &&
+        (path.size() == home.size() || path[home.size()] == '/')) {
+        result = "~";
+        path.remove_prefix(home.size());
+    }
+    result.append(path.data(), path.size());
+
+    // Truncate very long paths for better display
+    const size_t MAX_PATH_DISPLAY = 50;
+    if (result.length() > MAX_PATH_DISPLAY) {
+        result = "..." + result.substr(result.length() - MAX_PATH_DISPLAY + 3);
+    }
+    return result;
+}
 
 std::string getCurrentUsername() {
     // Try to get username from environment variable first
-    const char* user = getenv("USER");
+    const char* user = lookupEnv("USER");
     if (user) {
         return std::string(user);
     }
@@ -146,7 +357,7 @@ std::string getCurrentHostname() {
     }
 
     // Fall back to environment variable
-    const char* host = getenv("HOSTNAME");
+    const char* host = lookupEnv("HOSTNAME");
     if (host) {
         return std::string(host);
     }
@@ -156,52 +367,18 @@ std::string getCurrentHostname() {
 }
 
 std::string getCurrentWorkingDir() {
+    const char* home = lookupEnv("HOME");
     char* cwd = getcwd(nullptr, 0);
     if (cwd) {
-        std::string result(cwd);
+        std::string result = displayPath(cwd, home ? home : "");
         free(cwd);
-
-        // Replace home directory with ~ for shorter display
-        const char* home = getenv("HOME");
-        if (home) {
-            std::string homeStr(home);
-            if (result.compare(0, homeStr.length(), homeStr) == 0) {
-                if (result.length() == homeStr.length()) {
-                    result = "~";
-                } else if (result[homeStr.length()] == '/') {
-                    result = "~" + result.substr(homeStr.length());
-                }
-            }
-        }
-
-        // Truncate very long paths for better display
-        const size_t MAX_PATH_DISPLAY = 50;
-        if (result.length() > MAX_PATH_DISPLAY) {
-            result = "..." + result.substr(result.length() - MAX_PATH_DISPLAY + 3);
-        }
-
         return result;
     }
 
     // Fall back to PWD environment variable
-    const char* pwd = getenv("PWD");
+    const char* pwd = lookupEnv("PWD");
     if (pwd) {
-        std::string result(pwd);
-
-        // Apply same home directory replacement
-        const char* home = getenv("HOME");
-        if (home) {
-            std::string homeStr(home);
-            if (result.compare(0, homeStr.length(), homeStr) == 0) {
-                if (result.length() == homeStr.length()) {
-                    result = "~";
-                } else if (result[homeStr.length()] == '/') {
-                    result = "~" + result.substr(homeStr.length());
-                }
-            }
-        }
-
-        return result;
+        return displayPath(pwd, home ? home : "");
     }
 
     // Last resort
@@ -213,21 +390,6 @@ bool isOutputToTerminal() {
 }
 
 std::string getColoredPrompt() {
-    // Only use colors if output is to a terminal (not piped)
-    if (!isOutputToTerminal()) {
-        std::string username = getCurrentUsername();
-        std::string hostname = getCurrentHostname();
-        std::string cwd = getCurrentWorkingDir();
-        return username + "@" + hostname + ":" + cwd + "$ ";
-    }
-
-    std::string username = getCurrentUsername();
-    std::string hostname = getCurrentHostname();
-    std::string cwd = getCurrentWorkingDir();
-
-    // Create a colorful prompt: username@hostname:path$
-    // username in green, @ in white, hostname in blue, : in white,
-    // path in yellow, $ in bright white
-    return Colors::BOLD + Colors::GREEN + username + Colors::WHITE + "@" + Colors::BLUE + hostname +
-           Colors::WHITE + ":" + Colors::YELLOW + cwd + Colors::BRIGHT_WHITE + "$ " + Colors::RESET;
-}
\ No newline at end of file
+    Prompt prompt;
+    return prompt.text();
+}
@@ -1,12 +1,18 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <unistd.h>
 #include <vector>
 
 #include "builtin.hpp"
+#include "command.hpp"
+#include "environment.hpp"
+#include "executor.hpp"
+#include "history.hpp"
 
 bool test_builtin_commands() {
     bool allTestsPassed = true;
@@ -150,5 +156,114 @@ bool test_builtin_commands() {
         }
     }
 
+    // Test for the builtin dispatch table
+    {
+        const char* names[] = {"exit", "cd", "clear",      "history", "jobs", "kill",
+                               "fg",   "bg", "parsecache", "export",  "unset"};
+        for (const char* name : names) {
+            const Builtin* builtin = findBuiltin(name);
+            if (!builtin || builtin->name != name || !builtin->handler) {
+                std::cerr << "Builtin table is missing '" << name << "'" << std::endl;
+                allTestsPassed = false;
+            }
+        }
+
+        const char* notBuiltins[] = {"", "c", "cdd", "expor", "exports", "History", "ls"};
+        for (const char* name : notBuiltins) {
+            if (findBuiltin(name)) {
+                std::cerr << "Builtin table wrongly matched '" << name << "'" << std::endl;
+                allTestsPassed = false;
+            }
+        }
+    }
+
+    // Test for handlers writing to the given stream with the given state
+    {
+        History history("/tmp/ninxsh_test_builtin_history");
+        history.addCommand("ls -l");
+        history.addCommand("pwd");
+        Environment environment;
+
+        BuiltinContext context;
+        context.history = &history;
+        context.environment = &environment;
+
+        std::vector<std::string> storage = {"export", "GREETING=hello", "1BAD=x"};
+        std::vector<char*> argv;
+        for (std::string& arg : storage) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+
+        std::ostringstream out;
+        int exportStatus = findBuiltin("export")->handler(ArgList(argv.data(), 3), context, out);
+
+        std::string historyName = "history";
+        char* historyArgv[] = {&historyName[0], nullptr};
+        std::ostringstream historyOut;
+        int historyStatus =
+            findBuiltin("history")->handler(ArgList(historyArgv, 1), context, historyOut);
+
+        const char* greeting = environment.get("GREETING");
+        if (exportStatus != 1 || !greeting || std::string(greeting) != "hello" ||
+            out.str().find("not a valid identifier") == std::string::npos || historyStatus != 0 ||
+            historyOut.str() != "1  ls -l\n2  pwd\n") {
+            std::cerr << "Builtin handlers did not use the given context and stream" << std::endl;
+            allTestsPassed = false;
+        }
+
+        // Without shell state, stateful builtins fail instead of crashing
+        std::ostringstream noStateOut;
+        if (findBuiltin("jobs")->handler(ArgList(historyArgv, 1), BuiltinContext(), noStateOut) ==
+            0) {
+            std::cerr << "Builtin without job manager should fail" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test for read-only builtins running as in-process pipeline stages
+    {
+        History history(10000);
+        for (int i = 0; i < 5000; ++i) {
+            history.addCommand("echo " + std::to_string(i));
+        }
+        BuiltinContext context;
+        context.history = &history;
+
+        std::string outputFile = "/tmp/ninxsh_builtin_stage_out.txt";
+        ParsedCommand counted;
+        counted.addCommand({"history"});
+        counted.addCommand({"wc", "-l"}, "", outputFile);
+        int countedStatus = executeExternal(counted, nullptr, &context);
+
+        std::ifstream file(outputFile);
+        long lines = 0;
+        file >> lines;
+
+        // The reader exits early; the builtin thread sees EPIPE instead of a
+        // SIGPIPE that would kill the shell
+        ParsedCommand truncated;
+        truncated.addCommand({"history"});
+        truncated.addCommand({"head", "-1"}, "", "/dev/null");
+        int truncatedStatus = executeExternal(truncated, nullptr, &context);
+
+        char before[4096];
+        char after[4096];
+        ParsedCommand mutating;  // Still forks, so the shell's cwd is unchanged
+        mutating.addCommand({"cd", "/"});
+        mutating.addCommand({"true"});
+        bool cwdKept = getcwd(before, sizeof(before)) &&
+                       executeExternal(mutating, nullptr, &context) == 0 &&
+                       getcwd(after, sizeof(after)) && std::strcmp(before, after) == 0;
+
+        if (countedStatus != 0 || lines != 5000 || truncatedStatus != 0 || !cwdKept ||
+            !findBuiltin("history")->readOnly || findBuiltin("cd")->readOnly ||
+            findBuiltin("export")->readOnly) {
+            std::cerr << "Failed in-process builtin stage test" << std::endl;
+            allTestsPassed = false;
+        }
+        unlink(outputFile.c_str());
+    }
+
     return allTestsPassed;
 }
@@ -1,7 +1,7 @@
 #include <cassert>
-#include <cstring>
 #include <iostream>
 #include <string>
+#include <utility>
 
 #include "command.hpp"
 
@@ -32,15 +32,11 @@ bool test_command_parsing() {
         std::string input = "ls -l";
         ParsedCommand result = parseCommand(input);
 
-        Command expected;
-        expected.args.push_back(strdup("ls"));
-        expected.args.push_back(strdup("-l"));
-        expected.args.push_back(nullptr);
-        expected.inputFile = "";
-        expected.outputFile = "";
-        expected.isBackground = false;
+        ParsedCommand expected;
+        expected.addCommand({"ls", "-l"});
 
-        if (result.pipeline.size() != 1 || !compareCommands(result.pipeline[0], expected)) {
+        if (result.pipeline.size() != 1 ||
+            !compareCommands(result.pipeline[0], expected.pipeline[0])) {
             std::cerr << "Failed basic command parsing test" << std::endl;
             allTestsPassed = false;
         }
@@ -51,14 +47,11 @@ bool test_command_parsing() {
         std::string input = "sort < input.txt";
         ParsedCommand result = parseCommand(input);
 
-        Command expected;
-        expected.args.push_back(strdup("sort"));
-        expected.args.push_back(nullptr);
-        expected.inputFile = "input.txt";
-        expected.outputFile = "";
-        expected.isBackground = false;
+        ParsedCommand expected;
+        expected.addCommand({"sort"}, "input.txt");
 
-        if (result.pipeline.size() != 1 || !compareCommands(result.pipeline[0], expected)) {
+        if (result.pipeline.size() != 1 ||
+            !compareCommands(result.pipeline[0], expected.pipeline[0])) {
             std::cerr << "Failed input redirection test" << std::endl;
             allTestsPassed = false;
         }
@@ -69,15 +62,11 @@ bool test_command_parsing() {
         std::string input = "echo hello > output.txt";
         ParsedCommand result = parseCommand(input);
 
-        Command expected;
-        expected.args.push_back(strdup("echo"));
-        expected.args.push_back(strdup("hello"));
-        expected.args.push_back(nullptr);
-        expected.inputFile = "";
-        expected.outputFile = "output.txt";
-        expected.isBackground = false;
+        ParsedCommand expected;
+        expected.addCommand({"echo", "hello"}, "", "output.txt");
 
-        if (result.pipeline.size() != 1 || !compareCommands(result.pipeline[0], expected)) {
+        if (result.pipeline.size() != 1 ||
+            !compareCommands(result.pipeline[0], expected.pipeline[0])) {
             std::cerr << "Failed output redirection test" << std::endl;
             allTestsPassed = false;
         }
@@ -88,15 +77,11 @@ bool test_command_parsing() {
         std::string input = "sleep 10 &";
         ParsedCommand result = parseCommand(input);
 
-        Command expected;
-        expected.args.push_back(strdup("sleep"));
-        expected.args.push_back(strdup("10"));
-        expected.args.push_back(nullptr);
-        expected.inputFile = "";
-        expected.outputFile = "";
-        expected.isBackground = true;
+        ParsedCommand expected;
+        expected.addCommand({"sleep", "10"}, "", "", true);
 
-        if (result.pipeline.size() != 1 || !compareCommands(result.pipeline[0], expected)) {
+        if (result.pipeline.size() != 1 ||
+            !compareCommands(result.pipeline[0], expected.pipeline[0])) {
             std::cerr << "Failed background process test" << std::endl;
             allTestsPassed = false;
         }
@@ -111,31 +96,14 @@ bool test_command_parsing() {
             std::cerr << "Failed pipeline test: wrong number of commands" << std::endl;
             allTestsPassed = false;
         } else {
-            Command expected1, expected2, expected3;
-
-            expected1.args.push_back(strdup("ls"));
-            expected1.args.push_back(strdup("-l"));
-            expected1.args.push_back(nullptr);
-            expected1.inputFile = "";
-            expected1.outputFile = "";
-            expected1.isBackground = false;
-
-            expected2.args.push_back(strdup("grep"));
-            expected2.args.push_back(strdup("txt"));
-            expected2.args.push_back(nullptr);
-            expected2.inputFile = "";
-            expected2.outputFile = "";
-            expected2.isBackground = false;
-
-            expected3.args.push_back(strdup("sort"));
-            expected3.args.push_back(nullptr);
-            expected3.inputFile = "";
-            expected3.outputFile = "";
-            expected3.isBackground = false;
-
-            if (!compareCommands(result.pipeline[0], expected1) ||
-                !compareCommands(result.pipeline[1], expected2) ||
-                !compareCommands(result.pipeline[2], expected3)) {
+            ParsedCommand expected;
+            expected.addCommand({"ls", "-l"});
+            expected.addCommand({"grep", "txt"});
+            expected.addCommand({"sort"});
+
+            if (!compareCommands(result.pipeline[0], expected.pipeline[0]) ||
+                !compareCommands(result.pipeline[1], expected.pipeline[1]) ||
+                !compareCommands(result.pipeline[2], expected.pipeline[2])) {
                 std::cerr << "Failed pipeline test: command parsing incorrect" << std::endl;
                 allTestsPassed = false;
             }
@@ -151,35 +119,38 @@ bool test_command_parsing() {
             std::cerr << "Failed complex command test: wrong number of commands" << std::endl;
             allTestsPassed = false;
         } else {
-            Command expected1, expected2, expected3;
-
-            expected1.args.push_back(strdup("grep"));
-            expected1.args.push_back(strdup("error"));
-            expected1.args.push_back(nullptr);
-            expected1.inputFile = "log.txt";
-            expected1.outputFile = "";
-            expected1.isBackground = false;
-
-            expected2.args.push_back(strdup("sort"));
-            expected2.args.push_back(nullptr);
-            expected2.inputFile = "";
-            expected2.outputFile = "";
-            expected2.isBackground = false;
-
-            expected3.args.push_back(strdup("uniq"));
-            expected3.args.push_back(nullptr);
-            expected3.inputFile = "";
-            expected3.outputFile = "errors.txt";
-            expected3.isBackground = true;
-
-            if (!compareCommands(result.pipeline[0], expected1) ||
-                !compareCommands(result.pipeline[1], expected2) ||
-                !compareCommands(result.pipeline[2], expected3)) {
+            ParsedCommand expected;
+            expected.addCommand({"grep", "error"}, "log.txt");
+            expected.addCommand({"sort"});
+            expected.addCommand({"uniq"}, "", "errors.txt", true);
+
+            if (!compareCommands(result.pipeline[0], expected.pipeline[0]) ||
+                !compareCommands(result.pipeline[1], expected.pipeline[1]) ||
+                !compareCommands(result.pipeline[2], expected.pipeline[2])) {
                 std::cerr << "Failed complex command test: command parsing incorrect" << std::endl;
                 allTestsPassed = false;
             }
         }
     }
 
+    // Test 7: Arguments, file names and argv tables share one arena block
+    {
+        std::string input = "cat a b c d e f g h < in.txt | sort -r | uniq -c > out.txt";
+        ParsedCommand result = parseCommand(input);
+
+        if (result.hasError || result.pipeline.size() != 3 || result.arena.blockCount() != 1) {
+            std::cerr << "Failed arena test: expected a single arena block" << std::endl;
+            allTestsPassed = false;
+        }
+
+        // Moving must keep the argv tables valid (they point into the arena)
+        ParsedCommand moved = std::move(result);
+        if (moved.pipeline.size() != 3 || std::string(moved.pipeline[2].args[1]) != "-c" ||
+            moved.pipeline[2].outputFile != "out.txt" || moved.pipeline[0].args[9] != nullptr) {
+            std::cerr << "Failed arena test: argv invalid after move" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
     return allTestsPassed;
 }
@@ -0,0 +1,173 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtin.hpp"
+#include "command.hpp"
+#include "command_hash.hpp"
+#include "environment.hpp"
+#include "executor.hpp"
+
+namespace {
+
+// Write an executable shell script that prints its own label
+void writeScript(const std::string& path, const std::string& label) {
+    std::ofstream file(path);
+    file << "#!/bin/sh\necho " << label << "\n";
+    file.close();
+    chmod(path.c_str(), 0755);
+}
+
+}  // namespace
+
+bool test_command_hash() {
+    bool allTestsPassed = true;
+
+    std::string first = "/tmp/ninxsh_hash_a";
+    std::string second = "/tmp/ninxsh_hash_b";
+    mkdir(first.c_str(), 0755);
+    mkdir(second.c_str(), 0755);
+    writeScript(first + "/hashtool", "first");
+    writeScript(second + "/hashtool", "second");
+
+    Environment environment;
+    environment.set("PATH", first + ":" + second);
+    setActiveEnvironment(&environment);
+
+    // Test 1: Found commands are remembered and counted, misses are remembered
+    {
+        CommandHash commandHash;
+        std::string found = commandHash.find("hashtool");
+        commandHash.find("hashtool");
+        bool missing = commandHash.find("ninxsh-no-such-tool").empty();
+        auto entries = commandHash.entries();
+
+        if (found != first + "/hashtool" || !missing || entries.size() != 1 ||
+            entries[0].first != "hashtool" || entries[0].second.hits != 2 ||
+            commandHash.find("./relative/tool") != "./relative/tool") {
+            std::cerr << "Failed command hash lookup test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 2: A PATH change empties the table; forget and clear drop entries
+    {
+        CommandHash commandHash;
+        commandHash.find("hashtool");
+        environment.set("PATH", second + ":" + first);
+        std::string afterChange = commandHash.find("hashtool");
+        bool forgotten = commandHash.forget("hashtool") && !commandHash.forget("hashtool");
+        commandHash.add("hashtool");
+        bool added = commandHash.peek("hashtool") != nullptr;
+        commandHash.clear();
+
+        if (afterChange != second + "/hashtool" || !forgotten || !added ||
+            !commandHash.entries().empty()) {
+            std::cerr << "Failed command hash invalidation test" << std::endl;
+            allTestsPassed = false;
+        }
+        environment.set("PATH", first + ":" + second);
+    }
+
+    // Test 3: A hashed path that disappears is searched for again, and the
+    // table forgets it, with either launch backend
+    const LaunchBackend backends[] = {LaunchBackend::PosixSpawn, LaunchBackend::Fork};
+    for (LaunchBackend backend : backends) {
+        setLaunchBackend(backend);
+        writeScript(first + "/hashtool", "first");
+        CommandHash commandHash;
+        BuiltinContext context;
+        context.commandHash = &commandHash;
+        commandHash.find("hashtool");
+        unlink((first + "/hashtool").c_str());
+
+        std::string outputFile = "/tmp/ninxsh_hash_out.txt";
+        ParsedCommand parsed;
+        parsed.addCommand({"hashtool"}, "", outputFile);
+        int status = executeExternal(parsed, nullptr, &context);
+
+        std::ifstream file(outputFile);
+        std::string content;
+        std::getline(file, content);
+        unlink(outputFile.c_str());
+
+        const std::string* rehashed = commandHash.peek("hashtool");
+        if (status != 0 || content != "second" || !rehashed ||
+            *rehashed != second + "/hashtool") {
+            std::cerr << "Failed stale command hash test ("
+                      << (backend == LaunchBackend::Fork ? "fork" : "posix_spawn") << ")"
+                      << std::endl;
+            allTestsPassed = false;
+        }
+    }
+    setLaunchBackend(LaunchBackend::PosixSpawn);
+
+    // Test 4: hash, type and which builtins
+    {
+        CommandHash commandHash;
+        BuiltinContext context;
+        context.commandHash = &commandHash;
+        const Builtin* hash = findBuiltin("hash");
+        const Builtin* type = findBuiltin("type");
+        const Builtin* which = findBuiltin("which");
+
+        std::ostringstream empty;
+        std::ostringstream listed;
+        std::ostringstream typed;
+        std::ostringstream found;
+        char hashName[] = "hash";
+        char typeName[] = "type";
+        char whichName[] = "which";
+        char tool[] = "hashtool";
+        char cd[] = "cd";
+        char missing[] = "ninxsh-no-such-tool";
+        char* bare[] = {hashName, nullptr};
+        char* hashArgs[] = {hashName, tool, nullptr};
+        char* typeArgs[] = {typeName, cd, tool, missing, nullptr};
+        char* whichArgs[] = {whichName, tool, nullptr};
+
+        int emptyStatus = hash->handler(ArgList(bare, 1), context, empty);
+        int hashStatus = hash->handler(ArgList(hashArgs, 2), context, listed);
+        hash->handler(ArgList(bare, 1), context, listed);
+        int typeStatus = type->handler(ArgList(typeArgs, 4), context, typed);
+        int whichStatus = which->handler(ArgList(whichArgs, 2), context, found);
+
+        std::string path = second + "/hashtool";
+        if (emptyStatus != 0 || empty.str() != "hash: hash table empty\n" || hashStatus != 0 ||
+            listed.str() != "hits\tcommand\n   0\t" + path + "\n" || typeStatus != 1 ||
+            typed.str() != "cd is a shell builtin\nhashtool is hashed (" + path +
+                               ")\ntype: ninxsh-no-such-tool: not found\n" ||
+            whichStatus != 0 || found.str() != path + "\n") {
+            std::cerr << "Failed hash/type/which builtin test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 5: peek is const: after a PATH change it answers nothing but
+    // leaves the table for find to clear
+    {
+        CommandHash commandHash;
+        commandHash.find("hashtool");
+        const CommandHash& readOnly = commandHash;
+        bool before = readOnly.peek("hashtool") != nullptr;
+        environment.set("PATH", first);
+        bool stale = readOnly.peek("hashtool") == nullptr;
+        environment.set("PATH", first + ":" + second);
+        bool kept = readOnly.peek("hashtool") != nullptr;
+
+        if (!before || !stale || !kept) {
+            std::cerr << "Failed const command hash peek test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    setActiveEnvironment(nullptr);
+    unlink((second + "/hashtool").c_str());
+    rmdir(first.c_str());
+    rmdir(second.c_str());
+
+    return allTestsPassed;
+}
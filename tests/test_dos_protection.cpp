@@ -1,18 +1,22 @@
 #include <cassert>
 #include <iostream>
+#include <sstream>
 #include <string>
 
 #include "command.hpp"
 #include "limits.hpp"
+#include "line_reader.hpp"
 #include "utils.hpp"
 
 bool test_dos_protection() {
     bool allTestsPassed = true;
 
-    // Test 1: Very long input should be rejected by parseCommand
+    // Test 1: Input longer than the budget should be rejected by parseCommand
     {
+        setInputBudget(ninxsh::limits::TEST_INPUT_BUDGET);
         std::string longInput(ninxsh::limits::TEST_LONG_INPUT, 'A');  // 8000 character string
         ParsedCommand result = parseCommand(longInput);
+        setInputBudget(0);
 
         if (!result.hasError || result.errorMessage.find("too long") == std::string::npos) {
             std::cerr << "Failed DoS protection test: parseCommand should reject very long input "
@@ -74,10 +78,16 @@ bool test_dos_protection() {
         }
     }
 
-    // Test 6: Edge case - input at exactly the limit should be accepted
+    // Test 6: Edge case - arguments exactly filling the budget should be accepted
     {
-        std::string limitInput(ninxsh::limits::MAX_INPUT_LENGTH, 'A');  // Exactly at limit
+        // execve charges each string, its NUL and its argv pointer, plus the nullptr
+        size_t budget = ninxsh::limits::TEST_INPUT_BUDGET;
+        size_t wordLength = budget - (5 + 3 * sizeof(char*)) - 1;
+        std::string limitInput = "echo " + std::string(wordLength, 'A');
+
+        setInputBudget(budget);
         ParsedCommand result = parseCommand(limitInput);
+        setInputBudget(0);
 
         if (result.hasError) {
             std::cerr << "Failed DoS protection test: input at limit should be accepted"
@@ -86,10 +96,15 @@ bool test_dos_protection() {
         }
     }
 
-    // Test 7: Edge case - input just over limit should be rejected
+    // Test 7: Edge case - one byte over the budget should be rejected
     {
-        std::string overLimitInput(ninxsh::limits::TEST_OVER_LIMIT, 'A');  // Just over limit
+        size_t budget = ninxsh::limits::TEST_INPUT_BUDGET;
+        size_t wordLength = budget - (5 + 3 * sizeof(char*));
+        std::string overLimitInput = "echo " + std::string(wordLength, 'A');
+
+        setInputBudget(budget);
         ParsedCommand result = parseCommand(overLimitInput);
+        setInputBudget(0);
 
         if (!result.hasError || result.errorMessage.find("too long") == std::string::npos) {
             std::cerr << "Failed DoS protection test: input over limit should be rejected"
@@ -98,5 +113,77 @@ bool test_dos_protection() {
         }
     }
 
+    // Test 8: Generated command lines of 64 KB and 1 MB parse into one arena copy
+    for (size_t size : {ninxsh::limits::TEST_INPUT_64K, ninxsh::limits::TEST_INPUT_1M}) {
+        std::string input = "rm";
+        size_t files = 0;
+        while (input.size() + 16 < size) {
+            input += " file" + std::to_string(files++) + ".o";
+        }
+
+        ParsedCommand result = parseCommand(input);
+        std::string lastFile = "file" + std::to_string(files - 1) + ".o";
+        if (result.hasError || result.pipeline.size() != 1 ||
+            result.pipeline[0].args.size() != files + 2 || result.arena.blockCount() != 1 ||
+            std::string(result.pipeline[0].args[files]) != lastFile) {
+            std::cerr << "Failed DoS protection test: " << size << "-byte line should parse"
+                      << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 9: A line at the system ARG_MAX is accepted; its expansion is still checked
+    {
+        size_t argMax = systemArgMax();
+        if (argMax > ninxsh::limits::MAX_ARG_MAX) {
+            std::cerr << "Failed DoS protection test: ARG_MAX not capped" << std::endl;
+            allTestsPassed = false;
+        }
+        std::string input = "echo " + std::string(argMax - 5, 'A');
+
+        ParsedCommand result = parseCommand(input);
+        ParsedCommand over = parseCommand(input + "A");
+
+        // The line fits, but its argv (with NULs and pointers) exceeds ARG_MAX
+        if (!result.hasError || result.errorMessage.find("arguments exceed") == std::string::npos ||
+            !over.hasError || over.errorMessage.find("maximum") == std::string::npos) {
+            std::cerr << "Failed DoS protection test: ARG_MAX boundary" << std::endl;
+            allTestsPassed = false;
+        }
+
+        std::string fitting = "echo " + std::string(argMax - 6 - 3 * sizeof(char*), 'A');
+        ParsedCommand accepted = parseCommand(fitting);
+        if (accepted.hasError || accepted.pipeline[0].args.size() != 3) {
+            std::cerr << "Failed DoS protection test: argv of exactly ARG_MAX bytes rejected"
+                      << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 10: LineReader discards an oversized line chunk by chunk and recovers
+    {
+        std::string big(ninxsh::limits::TEST_INPUT_1M, 'x');
+        std::istringstream in("short\n" + big + "\nafter\n" + std::string(100, 'y'));
+        LineReader reader(in, ninxsh::limits::TEST_INPUT_64K, 1000);
+
+        std::string line;
+        bool ok = reader.read(line) == LineReader::Status::Ok && line == "short";
+        ok = ok && reader.read(line) == LineReader::Status::TooLong && line.empty() &&
+             line.capacity() < ninxsh::limits::TEST_INPUT_64K;
+        ok = ok && reader.read(line) == LineReader::Status::Ok && line == "after";
+        ok = ok && reader.read(line) == LineReader::Status::Ok && line == std::string(100, 'y');
+        ok = ok && reader.read(line) == LineReader::Status::Eof;
+
+        // A line of exactly the budget, straddling chunk boundaries, is kept
+        std::istringstream exact(big + "\n");
+        LineReader exactReader(exact, big.size(), 999);
+        ok = ok && exactReader.read(line) == LineReader::Status::Ok && line == big;
+
+        if (!ok) {
+            std::cerr << "Failed DoS protection test: chunked line reader" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
     return allTestsPassed;
 }
@@ -0,0 +1,129 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+
+bool test_environment() {
+    bool allTestsPassed = true;
+
+    // Test 1: Load from an environ-style array, skipping malformed entries
+    {
+        std::vector<std::string> storage = {"HOME=/home/test", "EMPTY=", "EQ=a=b", "BROKEN",
+                                            "=nameless"};
+        std::vector<char*> envp;
+        for (std::string& entry : storage) {
+            envp.push_back(entry.data());
+        }
+        envp.push_back(nullptr);
+
+        Environment environment;
+        environment.load(envp.data());
+
+        if (environment.size() != 3 || std::string(environment.get("HOME")) != "/home/test" ||
+            std::string(environment.get("EMPTY")) != "" ||
+            std::string(environment.get("EQ")) != "a=b" || environment.get("BROKEN")) {
+            std::cerr << "Failed environment load test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 2: Set, overwrite and unset
+    {
+        Environment environment;
+        environment.set("EDITOR", "vi");
+        environment.set("EDITOR", "a much longer value than before");
+        bool removed = environment.unset("EDITOR");
+        bool removedTwice = environment.unset("EDITOR");
+
+        if (!removed || removedTwice || environment.get("EDITOR") || environment.size() != 0) {
+            std::cerr << "Failed environment set/unset test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 3: Thousands of variables survive growth and churn
+    {
+        Environment environment;
+        const int COUNT = 5000;
+        for (int i = 0; i < COUNT; ++i) {
+            environment.set("VAR_" + std::to_string(i), std::to_string(i * 7));
+        }
+        // Unset every other one, leaving tombstones behind, then reinsert a few
+        for (int i = 0; i < COUNT; i += 2) {
+            environment.unset("VAR_" + std::to_string(i));
+        }
+        for (int i = 0; i < 100; i += 2) {
+            environment.set("VAR_" + std::to_string(i), "back");
+        }
+
+        bool consistent = environment.size() == COUNT / 2 + 50;
+        for (int i = 0; i < COUNT && consistent; ++i) {
+            const char* value = environment.get("VAR_" + std::to_string(i));
+            if (i % 2 == 1) {
+                consistent = value && std::string(value) == std::to_string(i * 7);
+            } else if (i < 100) {
+                consistent = value && std::string(value) == "back";
+            } else {
+                consistent = value == nullptr;
+            }
+        }
+        if (!consistent || environment.capacity() * 7 < environment.size() * 10) {
+            std::cerr << "Failed environment growth test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 4: envp is cached until the table changes
+    {
+        Environment environment;
+        environment.set("A", "1");
+        environment.set("B", "2");
+
+        char** first = environment.envp();
+        char** second = environment.envp();
+        bool cached = first == second;
+
+        environment.set("C", "3");
+        char** rebuilt = environment.envp();
+        size_t entries = 0;
+        bool sawC = false;
+        while (rebuilt[entries]) {
+            sawC = sawC || std::string(rebuilt[entries]) == "C=3";
+            ++entries;
+        }
+
+        if (!cached || entries != 3 || !sawC) {
+            std::cerr << "Failed envp cache test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 5: lookupEnv reads the active table, falling back to the process environment
+    {
+        Environment environment;
+        environment.set("NINXSH_ONLY_IN_TABLE", "yes");
+
+        setActiveEnvironment(&environment);
+        const char* inTable = lookupEnv("NINXSH_ONLY_IN_TABLE");
+        const char* path = lookupEnv("PATH");
+        setActiveEnvironment(nullptr);
+
+        if (!inTable || std::string(inTable) != "yes" || path ||
+            lookupEnv("NINXSH_ONLY_IN_TABLE")) {
+            std::cerr << "Failed active environment test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 6: Variable name validation
+    {
+        if (!Environment::isValidName("_PATH2") || Environment::isValidName("2PATH") ||
+            Environment::isValidName("A-B") || Environment::isValidName("")) {
+            std::cerr << "Failed variable name validation test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    return allTestsPassed;
+}
@@ -4,10 +4,12 @@
 #include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <sstream>
 #include <string>
 #include <sys/wait.h>
 #include <unistd.h>
-#include <cstring>
+#include <vector>
 
 #include "command.hpp"
 #include "executor.hpp"
@@ -21,14 +23,8 @@ bool test_executor() {
         std::string outputFile = "/tmp/ninxsh_test_output.txt";
 
         // Create a test command to write date to the file
-        Command dateCmd;
-        dateCmd.args.push_back(strdup("date"));
-        dateCmd.args.push_back(nullptr);
-        dateCmd.outputFile = outputFile;
-        dateCmd.isBackground = false;
-
         ParsedCommand parsed;
-        parsed.pipeline.push_back(dateCmd);
+        parsed.addCommand({"date"}, "", outputFile);
 
         // Execute the command
         executeExternal(parsed);
@@ -52,14 +48,8 @@ bool test_executor() {
     // Test 2: Test background execution
     {
         // Create a test command that runs in the background
-        Command sleepCmd;
-        sleepCmd.args.push_back(strdup("sleep"));
-        sleepCmd.args.push_back(strdup("1"));
-        sleepCmd.args.push_back(nullptr);
-        sleepCmd.isBackground = true;
-
         ParsedCommand parsed;
-        parsed.pipeline.push_back(sleepCmd);
+        parsed.addCommand({"sleep", "1"}, "", "", true);
 
         // Execute the command and measure time
         auto start = std::chrono::steady_clock::now();
@@ -79,5 +69,94 @@ bool test_executor() {
         usleep(1100000);  // 1.1 seconds
     }
 
+    // Test 3: Both launch backends give the same output and exit statuses
+    {
+        std::string inputFile = "/tmp/ninxsh_backend_in.txt";
+        std::string outputFile = "/tmp/ninxsh_backend_out.txt";
+        {
+            std::ofstream file(inputFile);
+            file << "b\na\nc\n";
+        }
+
+        const LaunchBackend backends[] = {LaunchBackend::PosixSpawn, LaunchBackend::Fork};
+        for (LaunchBackend backend : backends) {
+            setLaunchBackend(backend);
+
+            ParsedCommand pipeline;
+            pipeline.addCommand({"sort"}, inputFile);
+            pipeline.addCommand({"tr", "a-z", "A-Z"}, "", outputFile);
+            int pipelineStatus = executeExternal(pipeline);
+
+            std::ifstream file(outputFile);
+            std::string content((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+
+            ParsedCommand failing;
+            failing.addCommand({"sh", "-c", "exit 3"});
+            ParsedCommand missing;
+            missing.addCommand({"ninxsh-no-such-command"});
+            ParsedCommand badRedirect;
+            badRedirect.addCommand({"cat"}, "/nonexistent/ninxsh_input");
+            ParsedCommand builtinStage;  // Builtin stages fork with either backend
+            builtinStage.addCommand({"cd", "/"});
+            builtinStage.addCommand({"true"});
+
+            if (pipelineStatus != 0 || content != "A\nB\nC\n" || executeExternal(failing) != 3 ||
+                executeExternal(missing) != STATUS_COMMAND_NOT_FOUND ||
+                executeExternal(badRedirect) != EXIT_FAILURE ||
+                executeExternal(builtinStage) != 0) {
+                std::cerr << "Failed launch backend test ("
+                          << (backend == LaunchBackend::Fork ? "fork" : "posix_spawn") << ")"
+                          << std::endl;
+                allTestsPassed = false;
+            }
+            unlink(outputFile.c_str());
+        }
+
+        setLaunchBackend(LaunchBackend::PosixSpawn);
+        unlink(inputFile.c_str());
+    }
+
+    // Test 4: Every stage's status and usage are reported, each stage timed
+    // until it exits rather than until the stages before it are reaped
+    {
+        ParsedCommand pipeline;
+        pipeline.addCommand({"sh", "-c", "sleep 0.3; exit 3"});
+        pipeline.addCommand({"sh", "-c", "i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done"});
+        pipeline.addCommand({"sh", "-c", "exit 5"});
+
+        PipelineReport report;
+        int status = executeExternal(pipeline, nullptr, nullptr, &report);
+
+        std::ostringstream printed;
+        printPipelineReport(pipeline, report, printed);
+
+        const std::vector<StageReport>& stages = report.stages;
+        bool statusesOk = status == 5 && stages.size() == 3 && stages[0].status == 3 &&
+                          stages[1].status == 0 && stages[2].status == 5;
+        // Only relative times, which hold however loaded the machine is: the
+        // fast last stage is reaped before the sleeping first one finishes
+        bool timingOk = statusesOk && stages[2].realSeconds < stages[0].realSeconds &&
+                        report.realSeconds >= stages[0].realSeconds &&
+                        stages[1].usage.ru_utime.tv_sec + stages[1].usage.ru_utime.tv_usec > 0;
+        if (!statusesOk || !timingOk || printed.str().find(" total\n") == std::string::npos ||
+            printed.str().find("sh -c exit 5\n") == std::string::npos) {
+            std::cerr << "Failed pipeline report test" << std::endl;
+            std::cerr << printed.str();
+            allTestsPassed = false;
+        }
+
+        // Stages that never start still get their status
+        ParsedCommand missing;
+        missing.addCommand({"ninxsh-no-such-command"});
+        missing.addCommand({"true"});
+        executeExternal(missing, nullptr, nullptr, &report);
+        if (report.stages.size() != 2 || report.stages[0].status != STATUS_COMMAND_NOT_FOUND ||
+            report.stages[1].status != 0) {
+            std::cerr << "Failed report for a stage that did not start" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
     return allTestsPassed;
 }
@@ -1,8 +1,15 @@
+#include <algorithm>
 #include <cassert>
 #include <cstdio>  // for remove()
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
 
 #include "../include/history.hpp"
 
@@ -65,7 +72,7 @@ public:
             if (commands.empty()) {
                 return "";
             }
-            return commands.back();
+            return std::string(commands.back());
         } else if (input[0] == '!') {
             // Check for !n format (execute command number n)
             std::string numberStr = input.substr(1);
@@ -78,7 +85,7 @@ public:
                     return "";
                 }
 
-                return commands[index];
+                return std::string(commands[index]);
             } catch (const std::exception& e) {
                 // If not a valid number, treat as a regular command
                 return input;
@@ -168,9 +175,205 @@ void testHistoryFile() {
     std::cout << "History file functionality tests passed!\n";
 }
 
+// Each shell appends as it goes; compaction by one doesn't lose the next
+// append of another, which still has the replaced file open
+void testHistoryAppend() {
+    std::string testFile = "/tmp/ninxsh_history_append_test";
+    remove(testFile.c_str());
+
+    {
+        History first(testFile, 3);
+        History second(testFile, 3);
+        assert(first.loadFromFile());
+        assert(second.loadFromFile());
+
+        first.addCommand("a1");
+        second.addCommand("b1");
+        first.addCommand("a2");
+
+        // Nothing saved at exit: the lines are already in the file
+        History reader(testFile, 100);
+        reader.loadFromFile();
+        assert(reader.size() == 3);
+        assert(reader.getCommand(0) == "a1");
+        assert(reader.getCommand(1) == "b1");
+        assert(reader.getCommand(2) == "a2");
+
+        // first has appended 7 > 2 * 3 lines and compacts to the newest 3
+        for (int i = 3; i <= 7; ++i) {
+            first.addCommand("a" + std::to_string(i));
+        }
+        second.addCommand("b2");
+    }
+
+    {
+        History reader(testFile, 100);
+        reader.loadFromFile();
+        assert(reader.size() == 4);
+        assert(reader.getCommand(0) == "a5");
+        assert(reader.getCommand(3) == "b2");
+    }
+
+    // Shells appending at once neither lose nor tear lines
+    const int shells = 4;
+    const int perShell = 200;
+    remove(testFile.c_str());
+    std::vector<pid_t> children;
+    for (int shell = 0; shell < shells; ++shell) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            History history(testFile, 10000);
+            history.loadFromFile();
+            for (int i = 0; i < perShell; ++i) {
+                history.addCommand("shell" + std::to_string(shell) + " command " +
+                                   std::to_string(i));
+            }
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    for (pid_t pid : children) {
+        waitpid(pid, nullptr, 0);
+    }
+
+    {
+        History reader(testFile, 10000);
+        reader.loadFromFile();
+        assert(reader.size() == static_cast<size_t>(shells * perShell));
+        for (const auto& command : reader.getCommands()) {
+            assert(command.rfind("shell", 0) == 0 && command.find(" command ") == 6);
+        }
+    }
+
+    remove(testFile.c_str());
+    std::cout << "History append tests passed!\n";
+}
+
+// The ring wraps many times over; chunks are freed as their commands expire
+void testHistoryRing() {
+    History history("", 100);
+    const std::string padding(200, 'x');
+    for (int i = 0; i < 10000; ++i) {
+        history.addCommand("cmd" + std::to_string(i) + " " + padding);
+    }
+    assert(history.size() == 100);
+    assert(history.getCommand(0) == "cmd9900 " + padding);
+    assert(history.getCommand(99) == "cmd9999 " + padding);
+    assert(history.getCommand(100) == "");
+    // 100 commands of ~208 bytes span one 64 KB chunk, or two across a boundary
+    assert(history.chunkCount() <= 2);
+
+    size_t index = 9900;
+    for (std::string_view command : history.getCommands()) {
+        assert(command == "cmd" + std::to_string(index++) + " " + padding);
+    }
+    assert(index == 10000);
+    assert(history.getCommands().back() == history.at(99));
+
+    // Commands larger than a chunk get their own, freed when they expire
+    const std::string large(History::CHUNK_SIZE * 2, 'y');
+    history.addCommand(large);
+    assert(history.getCommand(99) == large);
+    history.addCommand("small");
+    assert(history.getCommand(98) == large && history.getCommand(99) == "small");
+    for (int i = 0; i < 100; ++i) {
+        history.addCommand("after" + std::to_string(i));
+    }
+    assert(history.getCommand(0) == "after0" && history.getCommand(99) == "after99");
+    assert(history.chunkCount() == 1);
+
+    // A history that keeps a single command reuses its one chunk
+    History single("", 1);
+    for (int i = 0; i < 1000; ++i) {
+        single.addCommand(padding + std::to_string(i));
+    }
+    assert(single.size() == 1 && single.getCommand(0) == padding + "999");
+    assert(single.chunkCount() == 1);
+
+    std::cout << "History ring tests passed!\n";
+}
+
+// A history file that can't be written still loads; nothing is appended
+void testHistoryReadOnly() {
+    std::string testFile = "/tmp/ninxsh_history_readonly_test";
+    remove(testFile.c_str());
+    {
+        std::ofstream file(testFile);
+        file << "old1\nold2\n";
+    }
+    chmod(testFile.c_str(), 0444);
+
+    // Root may write anything, so the check runs as nobody
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (geteuid() == 0 && setuid(65534) != 0) {
+            _exit(1);
+        }
+        History history(testFile, 10);
+        bool loaded = history.loadFromFile();
+        history.addCommand("new");
+        _exit(loaded && history.size() == 3 && history.getCommand(1) == "old2" ? 0 : 1);
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::ifstream file(testFile);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    assert(content == "old1\nold2\n");
+
+    remove(testFile.c_str());
+    std::cout << "History read-only file tests passed!\n";
+}
+
+// A multi-line command is one entry of the file, and comes back whole
+void testHistoryMultiLine() {
+    std::string testFile = "/tmp/ninxsh_history_multiline_test";
+    remove(testFile.c_str());
+    const std::string multiLine = "echo \"a\nb\"";
+    const std::string continued = "ls \\\n-l";
+    const std::string backslashes = "printf 'x\\\\n'";
+
+    {
+        History history(testFile, 10);
+        assert(history.loadFromFile());
+        history.addCommand(multiLine);
+        history.addCommand(continued);
+        history.addCommand(backslashes);
+    }
+
+    {
+        std::ifstream file(testFile);
+        std::string content((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+        assert(std::count(content.begin(), content.end(), '\n') == 3);
+
+        History history(testFile, 10);
+        assert(history.loadFromFile());
+        assert(history.size() == 3);
+        assert(history.getCommand(0) == multiLine);
+        assert(history.getCommand(1) == continued);
+        assert(history.getCommand(2) == backslashes);
+
+        // And again after the file is rewritten
+        assert(history.saveToFile());
+        History reloaded(testFile, 10);
+        assert(reloaded.loadFromFile());
+        assert(reloaded.size() == 3 && reloaded.getCommand(0) == multiLine &&
+               reloaded.getCommand(2) == backslashes);
+    }
+
+    remove(testFile.c_str());
+    std::cout << "History multi-line command tests passed!\n";
+}
+
 void runHistoryTests() {
     testHistoryBasic();
+    testHistoryRing();
     testHistoryFile();
+    testHistoryAppend();
+    testHistoryReadOnly();
+    testHistoryMultiLine();
     testHistoryExpansion();
 
     std::cout << "All history tests passed!\n";
@@ -1,8 +1,12 @@
 #include <cassert>
-#include <cstring>
+#include <cerrno>
+#include <dirent.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "command.hpp"
@@ -17,15 +21,8 @@ bool test_io_redirection() {
         std::string outputFile = "/tmp/ninxsh_io_test.txt";
 
         // Prepare command: echo "test output" > outputFile
-        Command cmd;
-        cmd.args.push_back(strdup("echo"));
-        cmd.args.push_back(strdup("test output"));
-        cmd.args.push_back(nullptr);
-        cmd.outputFile = outputFile;
-        cmd.isBackground = false;
-
         ParsedCommand parsed;
-        parsed.pipeline.push_back(cmd);
+        parsed.addCommand({"echo", "test output"}, "", outputFile);
 
         // Execute command
         executeExternal(parsed);
@@ -61,16 +58,8 @@ bool test_io_redirection() {
         }
 
         // Prepare command: wc -l < inputFile > outputFile
-        Command cmd;
-        cmd.args.push_back(strdup("wc"));
-        cmd.args.push_back(strdup("-l"));
-        cmd.args.push_back(nullptr);
-        cmd.inputFile = inputFile;
-        cmd.outputFile = outputFile;
-        cmd.isBackground = false;
-
         ParsedCommand parsed;
-        parsed.pipeline.push_back(cmd);
+        parsed.addCommand({"wc", "-l"}, inputFile, outputFile);
 
         // Execute command
         executeExternal(parsed);
@@ -101,9 +90,60 @@ bool test_io_redirection() {
         }
     }
 
+    // Test 3: Here-document bodies of any size reach stdin without a temp file
+    {
+        std::string outputFile = "/tmp/ninxsh_heredoc_test.txt";
+        std::string bigBody;
+        for (int i = 0; i < 100000; ++i) {
+            bigBody += "line " + std::to_string(i) + "\n";
+        }
+
+        bool allMatched = true;
+        for (const std::string& body : {std::string("short\n"), bigBody}) {
+            // Upstream output is dropped: the body replaces the pipe
+            ParsedCommand parsed;
+            parsed.addCommand({"echo", "from the pipe"});
+            parsed.addCommand({"cat"}, "", outputFile);
+            parsed.setInputText(parsed.pipeline[1], body);
+            executeExternal(parsed);
+
+            std::ifstream file(outputFile);
+            std::string content((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+            allMatched = allMatched && content == body;
+        }
+        unlink(outputFile.c_str());
+
+        // A large body is sealed, so the command can't write through its stdin
+        ParsedCommand writer;
+        writer.addCommand({"sh", "-c", "echo x >&0 2>/dev/null"});
+        writer.setInputText(writer.pipeline[0], bigBody);
+
+        if (!allMatched || executeExternal(writer) == 0) {
+            std::cerr << "Here-document input test failed" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
     return allTestsPassed;
 }
 
+namespace {
+
+// Descriptors this process has open right now
+size_t countOpenFds() {
+    size_t count = 0;
+    if (DIR* dir = opendir("/dev/fd")) {
+        while (readdir(dir)) {
+            ++count;
+        }
+        closedir(dir);
+    }
+    return count;
+}
+
+}  // namespace
+
 bool test_pipeline() {
     bool allTestsPassed = true;
 
@@ -112,28 +152,10 @@ bool test_pipeline() {
         std::string outputFile = "/tmp/ninxsh_pipeline_test.txt";
 
         // Create the pipeline commands
-        Command lsCmd, grepCmd, wcCmd;
-
-        lsCmd.args.push_back(strdup("ls"));
-        lsCmd.args.push_back(strdup("-1"));
-        lsCmd.args.push_back(nullptr);
-        lsCmd.isBackground = false;
-
-        grepCmd.args.push_back(strdup("grep"));
-        grepCmd.args.push_back(strdup(".cpp"));
-        grepCmd.args.push_back(nullptr);
-        grepCmd.isBackground = false;
-
-        wcCmd.args.push_back(strdup("wc"));
-        wcCmd.args.push_back(strdup("-l"));
-        wcCmd.args.push_back(nullptr);
-        wcCmd.outputFile = outputFile;
-        wcCmd.isBackground = false;
-
         ParsedCommand parsed;
-        parsed.pipeline.push_back(lsCmd);
-        parsed.pipeline.push_back(grepCmd);
-        parsed.pipeline.push_back(wcCmd);
+        parsed.addCommand({"ls", "-1"});
+        parsed.addCommand({"grep", ".cpp"});
+        parsed.addCommand({"wc", "-l"}, "", outputFile);
 
         // Execute the pipeline
         executeExternal(parsed);
@@ -163,5 +185,92 @@ bool test_pipeline() {
         }
     }
 
+    // Test: 1000 stages under a descriptor limit far below the 2000 that
+    // creating every pipe up front would need
+    {
+        const int STAGES = 1000;
+        std::string outputFile = "/tmp/ninxsh_long_pipeline_test.txt";
+
+        ParsedCommand parsed;
+        parsed.addCommand({"echo", "through the pipeline"});
+        for (int i = 1; i < STAGES - 1; ++i) {
+            parsed.addCommand({"cat"});
+        }
+        parsed.addCommand({"cat"}, "", outputFile);
+
+        size_t fdsBefore = countOpenFds();
+        struct rlimit original;
+        getrlimit(RLIMIT_NOFILE, &original);
+        struct rlimit tight = original;
+        tight.rlim_cur = fdsBefore + 8;
+        setrlimit(RLIMIT_NOFILE, &tight);
+
+        int status = executeExternal(parsed);
+
+        setrlimit(RLIMIT_NOFILE, &original);
+        size_t fdsAfter = countOpenFds();
+
+        std::ifstream file(outputFile);
+        std::string content;
+        std::getline(file, content);
+        file.close();
+        unlink(outputFile.c_str());
+
+        if (status != 0 || content != "through the pipeline" || fdsAfter != fdsBefore) {
+            std::cerr << "Long pipeline test failed (status " << status << ", "
+                      << fdsBefore << " fds before, " << fdsAfter << " after)" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test: Process substitutions run alongside the command on /dev/fd pipes,
+    // and nothing is left open or unreaped afterwards
+    {
+        std::string first = "/tmp/ninxsh_procsub_a.txt";
+        std::string second = "/tmp/ninxsh_procsub_b.txt";
+        std::string outputFile = "/tmp/ninxsh_procsub_out.txt";
+        std::ofstream(first) << "b\na\nc\n";
+        std::ofstream(second) << "c\nb\na\n";
+
+        size_t fdsBefore = countOpenFds();
+        ParsedCommand compared =
+            parseCommand("cmp -s <(sort " + first + ") <(sort " + second + " | cat)");
+        int sameStatus = executeExternal(compared);
+
+        ParsedCommand teed =
+            parseCommand("tee >(tr a-z A-Z > " + outputFile + ") < " + first);
+        std::string stdoutCopy = "/tmp/ninxsh_procsub_tee.txt";
+        teed.pipeline[0].outputFile = stdoutCopy;
+        executeExternal(teed);
+
+        // A builtin sees the /dev/fd path, and the substituted command runs
+        std::string marker = "/tmp/ninxsh_procsub_marker";
+        std::string described = "/tmp/ninxsh_procsub_which.txt";
+        ParsedCommand which = parseCommand("which <(touch " + marker + ")");
+        which.pipeline[0].outputFile = described;
+        int whichStatus = executeExternal(which);
+        size_t fdsAfter = countOpenFds();
+        std::string whichOutput;
+        std::getline(std::ifstream(described), whichOutput);
+        bool touched = access(marker.c_str(), F_OK) == 0;
+
+        std::ifstream file(outputFile);
+        std::string content((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+        bool reaped = waitpid(-1, nullptr, WNOHANG) < 0 && errno == ECHILD;
+
+        if (sameStatus != 0 || content != "B\nA\nC\n" || fdsAfter != fdsBefore ||
+            !reaped || whichStatus != 0 || whichOutput.rfind("/dev/fd/", 0) != 0 || !touched) {
+            std::cerr << "Process substitution test failed" << std::endl;
+            allTestsPassed = false;
+        }
+        unlink(first.c_str());
+        unlink(second.c_str());
+        unlink(outputFile.c_str());
+        unlink(stdoutCopy.c_str());
+        unlink(marker.c_str());
+        unlink(described.c_str());
+    }
+
     return allTestsPassed;
 }
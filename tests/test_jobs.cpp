@@ -29,8 +29,9 @@ bool test_job_management() {
         }
 
         if (jobs.size() > 0) {
-            if (jobs[0].jobId != 1 || jobs[0].pid != testPid || jobs[0].command != testCommand ||
-                !jobs[0].isRunning || jobs[0].isStopped) {
+            const Job& job = jobs.front();
+            if (job.jobId != 1 || job.pid != testPid || job.command != testCommand ||
+                !job.isRunning || job.isStopped) {
                 std::cerr << "Job creation failed: job data is incorrect" << std::endl;
                 allTestsPassed = false;
             }
@@ -162,5 +163,27 @@ bool test_job_management() {
         }
     }
 
+    // Test 7: Lookups by pid stay right as jobs finish out of order
+    {
+        JobManager jobManager;
+        for (pid_t pid = 2001; pid <= 2100; ++pid) {
+            jobManager.addJob(pid, "job " + std::to_string(pid));
+        }
+
+        Job finished(0, 0, "");
+        bool completed = jobManager.completeJob(2050, finished) &&
+                         jobManager.completeJob(2001, finished) &&
+                         !jobManager.completeJob(2001, finished);
+
+        Job* later = jobManager.findJobByPid(2100);
+        Job* middle = jobManager.findJobByPid(2051);
+        if (!completed || finished.jobId != 1 || finished.isRunning ||
+            jobManager.getJobs().size() != 98 || !later || later->command != "job 2100" ||
+            !middle || middle->jobId != 51 || jobManager.findJobByPid(2050)) {
+            std::cerr << "Job pid index test failed" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
     return allTestsPassed;
 }
@@ -0,0 +1,260 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "command.hpp"
+#include "lexer.hpp"
+
+bool test_lexer() {
+    bool allTestsPassed = true;
+
+    // Test 1: Plain words are spans into the source, not copies
+    {
+        std::string input = "ls -l /tmp";
+        TokenStream stream = lexCommandLine(input);
+
+        if (stream.tokens.size() != 3 || !stream.scratch.empty()) {
+            std::cerr << "Failed plain word lexing test" << std::endl;
+            allTestsPassed = false;
+        } else {
+            for (const Token& token : stream.tokens) {
+                if (token.rewritten || stream.text(token).data() < input.data() ||
+                    stream.text(token).data() >= input.data() + input.size()) {
+                    std::cerr << "Failed zero-copy test: token not spanning the source"
+                              << std::endl;
+                    allTestsPassed = false;
+                }
+            }
+            if (stream.text(stream.tokens[2]) != "/tmp") {
+                std::cerr << "Failed plain word lexing test - wrong text" << std::endl;
+                allTestsPassed = false;
+            }
+        }
+    }
+
+    // Test 2: A fully quoted word still spans the source; a split one is rewritten
+    {
+        std::string input = "echo \"hello world\" a\"b c\"d";
+        TokenStream stream = lexCommandLine(input);
+
+        if (stream.tokens.size() != 3) {
+            std::cerr << "Failed quoted word lexing test - wrong token count" << std::endl;
+            allTestsPassed = false;
+        } else {
+            const Token& quoted = stream.tokens[1];
+            const Token& mixed = stream.tokens[2];
+            if (quoted.rewritten || !quoted.fromDoubleQuotes ||
+                stream.text(quoted) != "hello world") {
+                std::cerr << "Failed quoted word lexing test - quoted span" << std::endl;
+                allTestsPassed = false;
+            }
+            if (!mixed.rewritten || stream.text(mixed) != "ab cd") {
+                std::cerr << "Failed quoted word lexing test - rewritten word got '"
+                          << stream.text(mixed) << "'" << std::endl;
+                allTestsPassed = false;
+            }
+        }
+    }
+
+    // Test 3: Operators come out of the same pass, quoted operators do not
+    {
+        std::string input = "sort<in.txt|uniq '|' >out.txt &";
+        TokenStream stream = lexCommandLine(input);
+
+        std::vector<TokenKind> expected = {
+            TokenKind::Word,        TokenKind::RedirectIn, TokenKind::Word,
+            TokenKind::Pipe,        TokenKind::Word,       TokenKind::Word,
+            TokenKind::RedirectOut, TokenKind::Word,       TokenKind::Background};
+
+        bool kindsMatch = stream.tokens.size() == expected.size();
+        for (size_t i = 0; kindsMatch && i < expected.size(); ++i) {
+            kindsMatch = stream.tokens[i].kind == expected[i];
+        }
+        if (!kindsMatch || stream.text(stream.tokens[5]) != "|") {
+            std::cerr << "Failed operator lexing test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 4: Escaped or quoted & is an ordinary word
+    {
+        TokenStream stream = lexCommandLine("echo \\& '&'");
+
+        if (stream.tokens.size() != 3 || stream.tokens[1].kind != TokenKind::Word ||
+            stream.tokens[2].kind != TokenKind::Word) {
+            std::cerr << "Failed literal & lexing test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 5: Redirection without a file name is a parse error
+    {
+        ParsedCommand parsed = parseCommand("cat <");
+
+        if (!parsed.hasError) {
+            std::cerr << "Failed missing redirection target test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 6: Empty quotes produce an empty argument
+    {
+        ParsedCommand parsed = parseCommand("printf '%s' \"\"");
+
+        if (parsed.hasError || parsed.pipeline.size() != 1 ||
+            parsed.pipeline[0].args.size() != 4 || std::string(parsed.pipeline[0].args[2]) != "") {
+            std::cerr << "Failed empty quoted argument test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 7: The vector word-break scanner agrees with the scalar one
+    {
+        static const char alphabet[] = "abc/._-{}:,\"' \t\\|<>&$~0123456789";
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> charDist(0, sizeof(alphabet) - 2);
+        std::uniform_int_distribution<int> lengthDist(0, 200);
+        std::uniform_int_distribution<int> runDist(0, 40);
+
+        bool scannersAgree = true;
+        for (int round = 0; round < 500 && scannersAgree; ++round) {
+            // Long plain runs with the odd special byte, at every alignment
+            std::string input;
+            int length = lengthDist(rng);
+            while (static_cast<int>(input.size()) < length) {
+                input.append(runDist(rng), 'x');
+                input += alphabet[charDist(rng)];
+            }
+            for (size_t pos = 0; pos <= input.size() && scannersAgree; ++pos) {
+                scannersAgree = findWordBreak(input, pos) == findWordBreakScalar(input, pos);
+            }
+        }
+        if (!scannersAgree) {
+            std::cerr << "Failed word-break scanner test (" << wordBreakScannerName()
+                      << " disagrees with scalar)" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 8: Quotes and backslashes carry over to the next line
+    {
+        IncrementalLexer lexer;
+        lexer.feedLine("echo 'first");
+        bool openSingle = lexer.needsMore() && lexer.currentState().inSingleQuotes;
+        lexer.feedLine("second' \"a|b");
+        bool openDouble = lexer.needsMore() && lexer.currentState().inDoubleQuotes;
+        lexer.feedLine("c\" joined\\");
+        bool openEscape = lexer.needsMore() && lexer.currentState().pendingEscape;
+        lexer.feedLine("word \\");
+        lexer.feedLine("| wc -l");
+        bool done = !lexer.needsMore();
+
+        TokenStream stream = lexer.finish();
+        std::vector<std::string> expected = {"echo", "first\nsecond", "a|b\nc", "joinedword",
+                                             "|",    "wc",            "-l"};
+        bool tokensMatch = stream.tokens.size() == expected.size() && !stream.isIncomplete;
+        for (size_t i = 0; tokensMatch && i < expected.size(); ++i) {
+            tokensMatch = std::string(stream.text(stream.tokens[i])) == expected[i];
+        }
+        if (!openSingle || !openDouble || !openEscape || !done || !tokensMatch ||
+            stream.tokens[4].kind != TokenKind::Pipe) {
+            std::cerr << "Failed continuation lexing test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 9: A long pasted quoted block is one word spanning the joined text
+    {
+        IncrementalLexer lexer;
+        lexer.feedLine("cat \"");
+        std::string expected;
+        for (int i = 0; i < 500; ++i) {
+            std::string line = "line " + std::to_string(i);
+            lexer.feedLine(line);
+            expected += "\n" + line;
+        }
+        lexer.feedLine("\"");
+        expected += "\n";
+
+        TokenStream stream = lexer.finish();
+        // Plain runs extend the span in place, so nothing was copied to scratch
+        if (stream.tokens.size() != 2 || stream.tokens[1].rewritten ||
+            std::string(stream.text(stream.tokens[1])) != expected) {
+            std::cerr << "Failed multi-line quoted block test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 10: One-shot lexing flags unfinished input and still yields tokens
+    {
+        TokenStream open = lexCommandLine("echo \"unfinished");
+        TokenStream escaped = lexCommandLine("echo done\\");
+        TokenStream complete = lexCommandLine("echo 'done'");
+
+        if (!open.isIncomplete || open.tokens.size() != 2 || !escaped.isIncomplete ||
+            escaped.tokens.size() != 2 || std::string(escaped.text(escaped.tokens[1])) != "done" ||
+            complete.isIncomplete || !parseCommand("echo 'x").isIncomplete) {
+            std::cerr << "Failed incomplete input detection test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 11: Here-documents and here-strings
+    {
+        TokenStream stream = lexCommandLine("cat <<EOF <<-'END' <<< \"w x\" '<<' < f");
+        const TokenKind expected[] = {
+            TokenKind::Word,       TokenKind::HereDoc, TokenKind::Word, TokenKind::HereDoc,
+            TokenKind::Word,       TokenKind::HereString, TokenKind::Word, TokenKind::Word,
+            TokenKind::RedirectIn, TokenKind::Word};
+        bool kindsOk = stream.tokens.size() == 10;
+        for (size_t i = 0; kindsOk && i < 10; ++i) {
+            kindsOk = stream.tokens[i].kind == expected[i];
+        }
+
+        CommandTemplate tmpl = parseTemplate("cat <<EOF | sort <<-'END'");
+        std::vector<std::pair<std::string_view, bool>> delimiters = hereDocDelimiters(tmpl);
+        ParsedCommand parsed = expandTemplate(tmpl);
+
+        if (!kindsOk || stream.text(stream.tokens[3]) != "<<-" ||
+            stream.text(stream.tokens[6]) != "w x" || delimiters.size() != 2 ||
+            delimiters[0].first != "EOF" || delimiters[0].second || delimiters[1].first != "END" ||
+            !delimiters[1].second || !parsed.needsHereDocs() ||
+            !parsed.pipeline[0].hereDocExpands || parsed.pipeline[1].hereDocExpands ||
+            !parseCommand("cat <<").hasError || !parseCommand("cat <<<").hasError) {
+            std::cerr << "Failed here-document lexing test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 12: Process substitutions span their command up to the matching ')'
+    {
+        std::string input = "diff <(sort 'a)' | tr -d \"(\") >(cat <(echo x)) y";
+        TokenStream stream = lexCommandLine(input);
+        CommandTemplate unterminated = parseTemplate("cat <(ls -l");
+        CommandTemplate badInner = parseTemplate("cat <(sort <)");
+        ParsedCommand nested = parseCommand(input);
+        // Inner commands are parsed once, with the line
+        CommandTemplate outer = parseTemplate(input);
+        bool innerKept = outer.substitutions.size() == 2 &&
+                         outer.substitutions[0].stages.size() == 2 &&
+                         outer.substitutions[1].substitutions.size() == 1;
+
+        if (stream.tokens.size() != 4 || stream.tokens[1].kind != TokenKind::ProcessSubIn ||
+            stream.text(stream.tokens[1]) != "sort 'a)' | tr -d \"(\"" ||
+            stream.tokens[2].kind != TokenKind::ProcessSubOut ||
+            stream.text(stream.tokens[2]) != "cat <(echo x)" || !unterminated.hasError ||
+            !badInner.hasError || nested.hasError || nested.substitutions.size() != 2 ||
+            nested.substitutions[0].arg != 1 || nested.substitutions[0].isOutput ||
+            nested.substitutions[0].command->pipeline.size() != 2 ||
+            !nested.substitutions[1].isOutput || !innerKept ||
+            nested.substitutions[1].command->substitutions.size() != 1) {
+            std::cerr << "Failed process substitution lexing test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    return allTestsPassed;
+}
@@ -0,0 +1,108 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lint.hpp"
+
+bool test_lint() {
+    bool allTestsPassed = true;
+
+    // Test 1: Errors are reported against the right lines
+    {
+        std::string script = "echo ok\n"
+                             "cat <\n"
+                             "\n"
+                             "ls | wc -l > out.txt\n"
+                             "sort >";  // Last line without a newline
+        std::vector<LintError> errors = lintBuffer(script);
+
+        if (errors.size() != 2 || errors[0].line != 2 || errors[1].line != 5 ||
+            errors[0].message.find("missing file name") == std::string::npos) {
+            std::cerr << "Failed lint line reporting test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 2: A clean script has no errors
+    {
+        if (!lintBuffer("echo \"a | b\" '<' \\>\ngrep x < in | sort &\n").empty() ||
+            !lintBuffer("").empty()) {
+            std::cerr << "Failed clean script lint test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 3: Commands continued over several lines are checked as one
+    {
+        std::string script = "echo 'multi\n"
+                             "line' > \n"  // Error belongs to the command starting on line 1
+                             "echo \\\n"
+                             "ok\n"
+                             "echo \"never closed\n";
+        std::vector<LintError> errors = lintBuffer(script);
+
+        if (errors.size() != 2 || errors[0].line != 1 || errors[1].line != 5 ||
+            errors[1].message.find("unterminated double quote") == std::string::npos) {
+            std::cerr << "Failed multi-line lint test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 4: Many files on many workers give the same ordered report as one worker
+    {
+        std::vector<std::string> files;
+        for (int i = 0; i < 40; ++i) {
+            std::string path = "/tmp/ninxsh_lint_test_" + std::to_string(i) + ".sh";
+            std::ofstream file(path);
+            for (int line = 0; line < 200; ++line) {
+                file << (line == i ? "cat < \n" : "echo line | tr a-z A-Z > /dev/null\n");
+            }
+            files.push_back(path);
+        }
+        files.push_back("/tmp/ninxsh_lint_test_missing.sh");
+
+        std::ostringstream parallel;
+        std::ostringstream serial;
+        int parallelStatus = lintFiles(files, parallel, 8);
+        int serialStatus = lintFiles(files, serial, 1);
+
+        std::string firstError = "/tmp/ninxsh_lint_test_0.sh:1: ";
+        std::string lastError = "/tmp/ninxsh_lint_test_39.sh:40: ";
+        if (parallelStatus != 2 || serialStatus != 2 || parallel.str() != serial.str() ||
+            parallel.str().find(firstError) != 0 ||
+            parallel.str().find(lastError) == std::string::npos ||
+            parallel.str().find("missing.sh: ") == std::string::npos) {
+            std::cerr << "Failed parallel lint test" << std::endl;
+            allTestsPassed = false;
+        }
+
+        for (size_t i = 0; i + 1 < files.size(); ++i) {
+            std::remove(files[i].c_str());
+        }
+    }
+
+    // Test 5: Here-document bodies are skipped, not parsed as commands
+    {
+        std::string script = "cat <<EOF | sort\n"
+                             "not | | a command <\n"
+                             "EOF\n"
+                             "cat <<-'END'\n"
+                             "\t>\n"
+                             "\tEND\n"
+                             "cat <\n"  // Line 7: checked again after the bodies
+                             "tr a-z A-Z <<STOP\n"
+                             "never closed\n";
+        std::vector<LintError> errors = lintBuffer(script);
+
+        if (errors.size() != 2 || errors[0].line != 7 || errors[1].line != 8 ||
+            errors[1].message.find("wanted 'STOP'") == std::string::npos) {
+            std::cerr << "Failed here-document lint test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    return allTestsPassed;
+}
@@ -0,0 +1,78 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "limits.hpp"
+#include "parse_cache.hpp"
+
+bool test_parse_cache() {
+    bool allTestsPassed = true;
+
+    // Test 1: Repeated lines hit the cache
+    {
+        ParseCache cache;
+        cache.parse("ls -l | wc -l");
+        cache.parse("ls -l | wc -l");
+        ParsedCommand parsed = cache.parse("ls -l | wc -l");
+
+        if (cache.hits() != 2 || cache.misses() != 1 || cache.size() != 1) {
+            std::cerr << "Failed parse cache hit test: hits=" << cache.hits()
+                      << " misses=" << cache.misses() << std::endl;
+            allTestsPassed = false;
+        }
+        if (parsed.pipeline.size() != 2 || std::string(parsed.pipeline[1].args[1]) != "-l") {
+            std::cerr << "Failed parse cache hit test - wrong pipeline" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 2: A cache hit re-runs expansion against the current environment
+    {
+        ParseCache cache;
+        setenv("NINXSH_CACHE_VAR", "first", 1);
+        ParsedCommand before = cache.parse("echo $NINXSH_CACHE_VAR '$NINXSH_CACHE_VAR'");
+        setenv("NINXSH_CACHE_VAR", "second", 1);
+        ParsedCommand after = cache.parse("echo $NINXSH_CACHE_VAR '$NINXSH_CACHE_VAR'");
+        unsetenv("NINXSH_CACHE_VAR");
+
+        if (cache.hits() != 1 || std::string(before.pipeline[0].args[1]) != "first" ||
+            std::string(after.pipeline[0].args[1]) != "second" ||
+            std::string(after.pipeline[0].args[2]) != "$NINXSH_CACHE_VAR") {
+            std::cerr << "Failed parse cache expansion test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 3: Least recently used entries are evicted first
+    {
+        ParseCache cache(2);
+        cache.parse("echo a");
+        cache.parse("echo b");
+        cache.parse("echo a");  // a is now most recent
+        cache.parse("echo c");  // evicts b
+        cache.parse("echo a");
+        cache.parse("echo b");
+
+        if (cache.size() != 2 || cache.hits() != 2 || cache.misses() != 4) {
+            std::cerr << "Failed parse cache eviction test: hits=" << cache.hits()
+                      << " misses=" << cache.misses() << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 4: Long lines and errors bypass or survive the cache correctly
+    {
+        ParseCache cache;
+        std::string longLine = "echo " + std::string(ninxsh::limits::MAX_CACHED_LINE_LENGTH, 'x');
+        ParsedCommand parsed = cache.parse(longLine);
+        ParsedCommand error = cache.parse("cat <");
+        ParsedCommand errorAgain = cache.parse("cat <");
+
+        if (parsed.hasError || cache.size() != 1 || !error.hasError || !errorAgain.hasError) {
+            std::cerr << "Failed parse cache long line / error test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    return allTestsPassed;
+}
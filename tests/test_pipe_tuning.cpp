@@ -0,0 +1,147 @@
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "command.hpp"
+#include "executor.hpp"
+#include "jobs.hpp"
+#include "pipe_tuning.hpp"
+
+namespace {
+
+// Fork a child running argv with the given stdin/stdout (-1 to inherit)
+pid_t startChild(const std::vector<const char*>& argv, int in, int out, int spare) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (in >= 0) {
+            dup2(in, STDIN_FILENO);
+        }
+        if (out >= 0) {
+            dup2(out, STDOUT_FILENO);
+        }
+        close(spare);
+        execvp(argv[0], const_cast<char* const*>(argv.data()));
+        _exit(127);
+    }
+    return pid;
+}
+
+}  // namespace
+
+bool test_pipe_tuning() {
+    bool allTestsPassed = true;
+
+    // Test 1: Policy parsing
+    {
+        PipeBufferPolicy fixed;
+        PipeBufferPolicy kilobytes;
+        PipeBufferPolicy automatic;
+        PipeBufferPolicy huge;
+        PipeBufferPolicy rejected;
+
+        bool parsed = parsePipeBufferPolicy("131072", fixed) &&
+                      parsePipeBufferPolicy("256K", kilobytes) &&
+                      parsePipeBufferPolicy("auto", automatic) &&
+                      parsePipeBufferPolicy("999M", huge);
+        bool invalid = !parsePipeBufferPolicy("", rejected) &&
+                       !parsePipeBufferPolicy("0", rejected) &&
+                       !parsePipeBufferPolicy("12X", rejected) &&
+                       !parsePipeBufferPolicy("-5", rejected);
+
+        if (!parsed || !invalid || fixed.mode != PipeBufferPolicy::Mode::Fixed ||
+            fixed.bytes != 131072 || kilobytes.bytes != 256 * 1024 ||
+            automatic.mode != PipeBufferPolicy::Mode::Auto || huge.bytes != pipeMaxSize() ||
+            describePipeBufferPolicy(kilobytes) != "262144 bytes") {
+            std::cerr << "Failed pipe size policy parsing test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+#ifdef F_SETPIPE_SZ
+    // Test 2: A fixed policy sizes the pipes a pipeline is built from
+    {
+        PipeBufferPolicy policy;
+        parsePipeBufferPolicy("256K", policy);
+        setPipeBufferPolicy(policy);
+
+        JobManager jobManager;
+        ParsedCommand parsed;
+        parsed.addCommand({"sleep", "0.3"});
+        parsed.addCommand({"sleep", "0.3"}, "", "", true);
+        executeExternal(parsed, &jobManager);
+        setPipeBufferPolicy(PipeBufferPolicy());
+
+        int size = -1;
+        if (!jobManager.getJobs().empty()) {
+            pid_t reader = jobManager.getJobs().back().pid;
+            std::string path = "/proc/" + std::to_string(reader) + "/fd/0";
+            int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+            if (fd >= 0) {
+                size = fcntl(fd, F_GETPIPE_SZ);
+                close(fd);
+            }
+            waitpid(reader, nullptr, 0);
+        }
+        usleep(100000);
+        cleanupZombieProcesses();
+
+        if (size != 256 * 1024) {
+            std::cerr << "Failed fixed pipe size test (size " << size << ")" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 3: Auto mode grows the pipe of a writer stuck behind a slow reader
+    {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            std::cerr << "Failed to create pipe for auto pipe size test" << std::endl;
+            return false;
+        }
+        std::vector<pid_t> pids;
+        pids.push_back(startChild({"head", "-c", "4000000", "/dev/zero", nullptr}, -1, fds[1],
+                                  fds[0]));
+        pids.push_back(startChild({"sh", "-c", "sleep 0.3; cat > /dev/null", nullptr}, fds[0],
+                                  -1, fds[1]));
+        close(fds[1]);
+
+        std::vector<int> waitStatuses;
+        size_t resizes = waitAdaptively(pids, waitStatuses);
+        int size = fcntl(fds[0], F_GETPIPE_SZ);
+        close(fds[0]);
+
+        if (resizes == 0 || size <= 64 * 1024 || waitStatuses.size() != 2 ||
+            !WIFEXITED(waitStatuses[1]) || WEXITSTATUS(waitStatuses[1]) != 0) {
+            std::cerr << "Failed auto pipe size test (" << resizes << " resizes, size " << size
+                      << ")" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+#endif
+
+    // Test 4: A stage that is no longer our child is reported as failed
+    {
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(0);
+        }
+        waitpid(pid, nullptr, 0);
+
+        std::vector<int> waitStatuses;
+        int reapedStatus = 0;
+        waitAdaptively({pid}, waitStatuses,
+                       [&](size_t, int waitStatus, const struct rusage&) {
+                           reapedStatus = waitStatus;
+                       });
+        if (waitStatuses.size() != 1 || !WIFEXITED(waitStatuses[0]) ||
+            WEXITSTATUS(waitStatuses[0]) == 0 || reapedStatus != waitStatuses[0]) {
+            std::cerr << "Failed lost stage wait test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    return allTestsPassed;
+}
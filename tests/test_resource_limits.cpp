@@ -0,0 +1,238 @@
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "command.hpp"
+#include "executor.hpp"
+#include "jobs.hpp"
+#include "resource_limits.hpp"
+
+namespace {
+
+// pid's cgroup v2 path ("/ninxsh-12/job-1"), relative to the cgroup2 mount
+std::string cgroupOf(pid_t pid) {
+    std::ifstream file("/proc/" + std::to_string(pid) + "/cgroup");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            return line.substr(3);
+        }
+    }
+    return std::string();
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return !suffix.empty() && text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}  // namespace
+
+bool test_resource_limits() {
+    bool allTestsPassed = true;
+
+    // Test 1: Settings parse, merge and print back as typed
+    {
+        ResourceLimits limits;
+        bool parsed = parseLimitSetting("mem=512M", limits) &&
+                      parseLimitSetting("pids=64", limits) &&
+                      parseLimitSetting("cpu=50", limits) &&
+                      parseLimitSetting("nofile=256", limits) &&
+                      parseLimitSetting("core=0", limits) &&
+                      parseLimitSetting("fsize=unlimited", limits);
+        ResourceLimits rejected;
+        bool invalid = !parseLimitSetting("mem=", rejected) &&
+                       !parseLimitSetting("cpu=0", rejected) &&
+                       !parseLimitSetting("cpu=20000", rejected) &&
+                       !parseLimitSetting("pids=12K", rejected) &&
+                       !parseLimitSetting("mem=17179869185G", rejected) &&
+                       !parseLimitSetting("as=999999999999999G", rejected) &&
+                       !parseLimitSetting("bogus=1", rejected) &&
+                       !parseLimitSetting("nofile", rejected) && rejected.empty();
+
+        ResourceLimits overrides;
+        parseLimitSetting("nofile=32", overrides);
+        ResourceLimits merged = limits;
+        merged.merge(overrides);
+
+        ResourceLimits largest;  // The largest size a G suffix can reach
+        bool fits = parseLimitSetting("mem=17179869183G", largest) &&
+                    describeResourceLimits(largest) == "mem=17179869183G";
+
+        if (!parsed || !invalid || !fits || limits.memoryMax != 512ULL * 1024 * 1024 ||
+            !limits.usesCgroup() ||
+            describeResourceLimits(limits) !=
+                "cpu=50 mem=512M pids=64 fsize=unlimited core=0 nofile=256" ||
+            describeResourceLimits(merged) !=
+                "cpu=50 mem=512M pids=64 fsize=unlimited core=0 nofile=32" ||
+            describeResourceLimits(ResourceLimits()) != "none") {
+            std::cerr << "Failed limit setting parsing test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 2: A command started under limits sees its rlimits; the shell doesn't
+    {
+        const char* output = "/tmp/ninxsh_limit_test.txt";
+        struct rlimit before;
+        getrlimit(RLIMIT_NOFILE, &before);
+
+        ResourceLimits limits;
+        parseLimitSetting("nofile=40", limits);
+        setResourceLimits(limits);
+        ParsedCommand cmd;
+        cmd.addCommand({"sh", "-c", "ulimit -n"});
+        cmd.pipeline[0].outputFile = output;
+        int status = executeExternal(cmd);
+        setResourceLimits(ResourceLimits());
+
+        std::ifstream file(output);
+        std::string seen;
+        std::getline(file, seen);
+        struct rlimit after;
+        getrlimit(RLIMIT_NOFILE, &after);
+
+        if (status != 0 || seen != "40" || after.rlim_cur != before.rlim_cur) {
+            std::cerr << "Failed rlimit at spawn test: saw '" << seen << "'" << std::endl;
+            allTestsPassed = false;
+        }
+        std::remove(output);
+    }
+
+    // Test 3: A background job keeps its limits and jobs shows them
+    {
+        JobManager jobManager;
+        ResourceLimits limits;
+        parseLimitSetting("nofile=50", limits);
+        setResourceLimits(limits);
+        ParsedCommand cmd;
+        cmd.addCommand({"sleep", "0.1"});
+        cmd.pipeline[0].isBackground = true;
+        std::streambuf* saved = std::cout.rdbuf();
+        std::ostringstream launched;
+        std::cout.rdbuf(launched.rdbuf());
+        executeExternal(cmd, &jobManager);
+        std::cout.rdbuf(saved);
+        setResourceLimits(ResourceLimits());
+
+        std::ostringstream listing;
+        jobManager.printJobs(listing);
+        bool recorded = jobManager.getJobs().size() == 1 &&
+                        describeResourceLimits(jobManager.getJobs().front().limits) == "nofile=50";
+        if (!recorded || listing.str().find("nofile=50") == std::string::npos) {
+            std::cerr << "Failed background job limits test" << std::endl;
+            allTestsPassed = false;
+        }
+        if (!jobManager.getJobs().empty()) {
+            waitpid(jobManager.getJobs().front().pid, nullptr, 0);
+        }
+    }
+
+    // Test 4: Jobs get a cgroup of their own, entered by clone3 or by a forked
+    // child, which goes away with them; jobs reports its usage. Skipped where
+    // the shell has no writable cgroup2 subtree.
+    {
+        ResourceLimits limits;
+        parseLimitSetting("pids=64", limits);
+        std::streambuf* savedErr = std::cerr.rdbuf();
+        std::ostringstream warnings;  // Controllers need not be delegated to pass
+        std::cerr.rdbuf(warnings.rdbuf());
+        JobCgroup probe;
+        bool delegated = probe.create(limits);
+        std::cerr.rdbuf(savedErr);
+
+        if (!delegated) {
+            std::cout << "(no writable cgroup2 subtree, skipping cgroup tests) ";
+        } else {
+            std::string group = probe.path();
+            std::string root = group.substr(0, group.rfind('/'));
+            std::string expected = "/ninxsh-" + std::to_string(getpid()) + "/job-";
+            bool created = probe.fd() >= 0 && access(group.c_str(), F_OK) == 0 &&
+                           group.find(expected) != std::string::npos;
+
+            // The fork fallback: a child moves itself in and holds the group
+            int ready[2];
+            bool piped = pipe(ready) == 0;
+            pid_t holder = fork();
+            if (holder == 0) {
+                bool entered = enterCgroup(probe.procsPath());
+                if (write(ready[1], entered ? "y" : "n", 1) != 1) {
+                    _exit(1);
+                }
+                pause();
+                _exit(0);
+            }
+            char entered = 'n';
+            bool synced = piped && read(ready[0], &entered, 1) == 1;
+            close(ready[0]);
+            close(ready[1]);
+            std::string holderGroup = cgroupOf(holder);
+
+            // A group still in use outlives its release until it is idle
+            std::string released = probe.detach();
+            releaseCgroup(released);
+            bool keptWhileBusy = access(released.c_str(), F_OK) == 0;
+            kill(holder, SIGKILL);
+            waitpid(holder, nullptr, 0);
+            releaseIdleCgroups();
+            bool removedWhenIdle = access(released.c_str(), F_OK) != 0;
+
+            // A command launched under the limits (by clone3 where it can)
+            const char* output = "/tmp/ninxsh_cgroup_test.txt";
+            setResourceLimits(limits);
+            ParsedCommand cmd;
+            cmd.addCommand({"sh", "-c", "grep ^0:: /proc/self/cgroup"});
+            cmd.pipeline[0].outputFile = output;
+            int status = executeExternal(cmd);
+            std::ifstream file(output);
+            std::string launchedGroup;
+            std::getline(file, launchedGroup);
+            std::remove(output);
+
+            // A background job: jobs reads its usage from the group
+            JobManager jobManager;
+            ParsedCommand job;
+            job.addCommand({"sleep", "0.2"});
+            job.pipeline[0].isBackground = true;
+            std::streambuf* saved = std::cout.rdbuf();
+            std::ostringstream launched;
+            std::cout.rdbuf(launched.rdbuf());
+            executeExternal(job, &jobManager);
+            std::cout.rdbuf(saved);
+            setResourceLimits(ResourceLimits());
+
+            std::ostringstream listing;
+            jobManager.printJobs(listing);
+            bool jobGrouped = jobManager.getJobs().size() == 1 &&
+                              !jobManager.getJobs().front().cgroup.empty();
+            std::string jobGroup = jobGrouped ? jobManager.getJobs().front().cgroup : "";
+            bool usage = listing.str().find("pids ") != std::string::npos &&
+                         listing.str().find("/64") != std::string::npos &&
+                         listing.str().find("cpu -") == std::string::npos;
+            if (!jobManager.getJobs().empty()) {
+                pid_t pid = jobManager.getJobs().front().pid;
+                waitpid(pid, nullptr, 0);
+                jobManager.removeJob(pid);
+            }
+            bool jobReleased = !jobGrouped || access(jobGroup.c_str(), F_OK) != 0;
+            bool rootRemoved = access(root.c_str(), F_OK) != 0;
+
+            if (!created || !synced || entered != 'y' || !endsWith(group, holderGroup) ||
+                !keptWhileBusy || !removedWhenIdle || status != 0 ||
+                launchedGroup.find(expected) == std::string::npos || !jobGrouped ||
+                !usage || !jobReleased || !rootRemoved) {
+                std::cerr << "Failed job cgroup test: '" << holderGroup << "', '"
+                          << launchedGroup << "', '" << listing.str() << "'" << std::endl;
+                allTestsPassed = false;
+            }
+        }
+    }
+
+    return allTestsPassed;
+}
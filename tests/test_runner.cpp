@@ -11,6 +11,14 @@ bool test_pipeline();
 bool test_dos_protection();  // Added for DoS protection tests
 bool test_job_management();  // Added for job management tests
 bool test_quote_handling();  // Added for quote handling tests
+bool test_lexer();           // Added for single-pass lexer tests
+bool test_parse_cache();     // Added for parse cache tests
+bool test_environment();     // Added for environment table tests
+bool test_lint();            // Added for lint mode tests
+bool test_command_hash();    // Added for command hash tests
+bool test_pipe_tuning();     // Added for pipe buffer sizing tests
+bool test_resource_limits();  // Added for per-job resource limit tests
+bool test_script();           // Added for script mode tests
 void runHistoryTests();      // Added for history tests
 
 // Main test runner
@@ -38,6 +46,14 @@ int main() {
     RUN_TEST(test_dos_protection);
     RUN_TEST(test_job_management);
     RUN_TEST(test_quote_handling);
+    RUN_TEST(test_lexer);
+    RUN_TEST(test_parse_cache);
+    RUN_TEST(test_environment);
+    RUN_TEST(test_lint);
+    RUN_TEST(test_command_hash);
+    RUN_TEST(test_pipe_tuning);
+    RUN_TEST(test_resource_limits);
+    RUN_TEST(test_script);
 
     // Run history tests (they use their own testing framework)
     std::cout << "Running history tests... " << std::endl;
@@ -0,0 +1,136 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "script.hpp"
+
+bool test_script() {
+    bool allTestsPassed = true;
+
+    // Test 1: Commands are split out with their continuation lines and bodies
+    {
+        std::string script = "#!/usr/bin/env ninxsh\n"
+                             "\n"
+                             "  # comment\n"
+                             "echo 'multi\n"
+                             "# not a comment' | cat\n"
+                             "cat <<-END | sort\n"
+                             "\tb $HOME\n"
+                             "\ta\n"
+                             "\tEND\n"
+                             "echo last";  // No final newline
+        ScriptSplitter splitter(script);
+        std::vector<size_t> lines;
+        std::vector<std::string> texts;
+        std::vector<std::string> bodies;
+        ScriptCommand command;
+        while (splitter.next(command)) {
+            lines.push_back(command.line);
+            texts.emplace_back(command.text);
+            bodies.insert(bodies.end(), command.hereDocs.begin(), command.hereDocs.end());
+            if (!command.error.empty() || !command.unterminatedHereDoc.empty()) {
+                lines.push_back(0);
+            }
+        }
+
+        if (lines != std::vector<size_t>{4, 6, 10} ||
+            texts[0] != "echo 'multi\n# not a comment' | cat" || texts[2] != "echo last" ||
+            bodies != std::vector<std::string>{"b $HOME\na\n"}) {
+            std::cerr << "Failed script splitting test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 2: Malformed commands carry their error and first line
+    {
+        ScriptSplitter splitter("ls >\n"
+                                "cat <<STOP\n"
+                                "body\n");
+        ScriptCommand first;
+        ScriptCommand second;
+        ScriptCommand end;
+        bool split = splitter.next(first) && splitter.next(second) && !splitter.next(end);
+
+        if (!split || first.line != 1 || first.error.empty() || second.line != 2 ||
+            !second.error.empty() || second.unterminatedHereDoc != "STOP" ||
+            second.hereDocs != std::vector<std::string>{"body\n"}) {
+            std::cerr << "Failed script error test" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 3: Parse-ahead hands over every command in order, well past the
+    // point where the worker has to wait for the shell to catch up
+    {
+        const size_t count = 3 * ParseAhead::MAX_AHEAD;
+        std::string script;
+        for (size_t i = 0; i < count; ++i) {
+            script += "echo " + std::to_string(i) + "\n";
+        }
+
+        size_t seen = 0;
+        bool inOrder = true;
+        {
+            ParseAhead commands(script);
+            ScriptCommand command;
+            while (commands.next(command)) {
+                inOrder = inOrder && command.line == seen + 1 && command.tmpl.words.size() == 2 &&
+                          command.text == "echo " + std::to_string(seen);
+                ++seen;
+            }
+        }
+
+        // Stopping early leaves nothing running
+        {
+            ParseAhead commands(script);
+            ScriptCommand command;
+            commands.next(command);
+        }
+
+        // A short text is split without a worker, to the same result
+        std::vector<size_t> shortLines;
+        {
+            ParseAhead commands("echo a\n\necho 'b\nc'\necho d");
+            ScriptCommand command;
+            while (commands.next(command)) {
+                shortLines.push_back(command.line);
+            }
+        }
+
+        if (seen != count || !inOrder || shortLines != std::vector<size_t>{1, 3, 5}) {
+            std::cerr << "Failed parse-ahead test: " << seen << " commands" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    // Test 4: A slow first command lets the worker fill up to MAX_AHEAD, and
+    // the shell then takes it all; once that batch has run the worker goes on
+    {
+        const size_t count = 3 * ParseAhead::MAX_AHEAD;
+        std::string script;
+        for (size_t i = 0; i < count; ++i) {
+            script += "export A=" + std::to_string(i) + "\n";
+        }
+
+        size_t seen = 0;
+        {
+            ParseAhead commands(script);
+            ScriptCommand command;
+            while (commands.next(command)) {
+                if (seen++ == 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                }
+            }
+        }
+
+        if (seen != count) {
+            std::cerr << "Failed parse-ahead slow command test: " << seen << " commands"
+                      << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
+    return allTestsPassed;
+}
@@ -3,11 +3,15 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "child_watcher.hpp"
+#include "command.hpp"
 #include "executor.hpp"
+#include "jobs.hpp"
 
 // Signal handling is hard to test programmatically, but we can check if our
 // handlers are properly set up and if zombie processes are cleaned up
@@ -78,5 +82,30 @@ bool test_signal_handling() {
         }
     }
 
+    // Test 3: Finished background jobs are reaped and reported once
+    {
+        JobManager jobManager;
+        ChildWatcher watcher(jobManager);
+
+        ParsedCommand job;
+        job.addCommand({"sh", "-c", "exit 3"}, "", "", true);
+        executeExternal(job, &jobManager);
+        ParsedCommand foreground;
+        foreground.addCommand({"true"});
+        executeExternal(foreground, &jobManager);
+        usleep(200000);  // Let the job exit
+
+        std::ostringstream notices;
+        std::ostringstream again;
+        size_t reported = watcher.reap(notices);
+        size_t reportedAgain = watcher.reap(again);
+
+        if (reported != 1 || notices.str() != "[1]  Exit 3                 sh -c exit 3\n" ||
+            !jobManager.getJobs().empty() || reportedAgain != 0 || !again.str().empty()) {
+            std::cerr << "Child watcher failed to report a finished job" << std::endl;
+            allTestsPassed = false;
+        }
+    }
+
     return allTestsPassed;
 }
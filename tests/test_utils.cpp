@@ -1,7 +1,9 @@
 #include <cassert>
 #include <iostream>
 #include <string>
+#include <unistd.h>
 
+#include "prompt.hpp"
 #include "utils.hpp"
 
 bool test_utils() {
@@ -45,7 +47,65 @@ bool test_utils() {
         }
     }
 
-    // Test 3: String tokenization
+    // Test 3: Braced forms, defaults and special parameters
+    {
+        setenv("NINXSH_TEST_VAR", "value", 1);
+        setenv("NINXSH_TEST_EMPTY", "", 1);
+        unsetenv("NINXSH_TEST_UNSET");
+
+        ExpansionContext context;
+        context.lastStatus = 42;
+        context.lastBackgroundPid = 4242;
+        context.pipeStatus = {0, 141, 42};
+
+        struct Case {
+            const char* input;
+            std::string expected;
+        };
+        const Case cases[] = {
+            {"${NINXSH_TEST_VAR}s", "values"},
+            {"$NINXSH_TEST_VAR.txt", "value.txt"},
+            {"${NINXSH_TEST_UNSET:-fallback}", "fallback"},
+            {"${NINXSH_TEST_EMPTY:-fallback}", "fallback"},
+            {"${NINXSH_TEST_EMPTY-fallback}", ""},
+            {"${NINXSH_TEST_UNSET:-${NINXSH_TEST_VAR}}", "value"},
+            {"${NINXSH_TEST_VAR:-fallback}", "value"},
+            {"$?:$!", "42:4242"},
+            {"$$", std::to_string(getpid())},
+            {"$PIPESTATUS", "0 141 42"},
+            {"${PIPESTATUS[1]}:${PIPESTATUS[@]}", "141:0 141 42"},
+            {"${PIPESTATUS[7]}x${PIPESTATUS[bad]}", "x"},
+            {"cost $5 ${unterminated", "cost $5 ${unterminated"},
+            {"trailing $", "trailing $"},
+        };
+
+        for (const Case& c : cases) {
+            std::string expanded = expandEnvVars(c.input, context);
+            if (expanded != c.expected) {
+                std::cerr << "Failed braced expansion test for '" << c.input << "'" << std::endl;
+                std::cerr << "  Expected: " << c.expected << std::endl;
+                std::cerr << "  Got: " << expanded << std::endl;
+                allTestsPassed = false;
+            }
+        }
+
+        // Strings well past the old 2KB cutoff are still expanded
+        std::string longInput;
+        std::string longExpected;
+        for (int i = 0; i < 1000; ++i) {
+            longInput += "$NINXSH_TEST_VAR/";
+            longExpected += "value/";
+        }
+        if (expandEnvVars(longInput) != longExpected) {
+            std::cerr << "Failed long string expansion test" << std::endl;
+            allTestsPassed = false;
+        }
+
+        unsetenv("NINXSH_TEST_VAR");
+        unsetenv("NINXSH_TEST_EMPTY");
+    }
+
+    // Test 4: String tokenization
     {
         std::string input = "This is a test";
         std::vector<std::string> tokens = tokenize(input, ' ');
@@ -64,7 +124,7 @@ bool test_utils() {
         }
     }
 
-    // Test 4: String trimming
+    // Test 5: String trimming
     {
         std::string input = "  whitespace  ";
         std::string trimmed = trim(input);
@@ -78,7 +138,7 @@ bool test_utils() {
         }
     }
 
-    // Test 5: Terminal utility functions
+    // Test 6: Terminal utility functions
     {
         try {
             // Test username function
@@ -118,5 +178,35 @@ bool test_utils() {
         }
     }
 
+    // Test 7: Logical paths and the cached prompt's path segment
+    {
+        if (logicalPath("/a/b", "../c/./d/") != "/a/c/d" || logicalPath("/a", "/x/../..") != "/" ||
+            logicalPath("", "rel") != "" || displayPath("/home/u/src", "/home/u") != "~/src" ||
+            displayPath("/home/user", "/home/u") != "/home/user") {
+            std::cerr << "Failed logical path test" << std::endl;
+            allTestsPassed = false;
+        }
+
+        const char* savedPwd = getenv("PWD");
+        std::string oldPwd = savedPwd ? savedPwd : "";
+        Prompt prompt;
+        setenv("PWD", "/prompt/first", 1);
+        std::string first = prompt.text();
+        setenv("PWD", "/prompt/second", 1);
+        std::string second = prompt.text();
+        if (first.find("/prompt/first") == std::string::npos ||
+            second.find("/prompt/second") == std::string::npos ||
+            first.substr(0, first.find('/')) != second.substr(0, second.find('/'))) {
+            std::cerr << "Failed prompt path test: '" << first << "', '" << second << "'"
+                      << std::endl;
+            allTestsPassed = false;
+        }
+        if (savedPwd) {
+            setenv("PWD", oldPwd.c_str(), 1);
+        } else {
+            unsetenv("PWD");
+        }
+    }
+
     return allTestsPassed;
 }